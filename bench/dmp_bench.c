@@ -0,0 +1,410 @@
+/**
+ * dmp_bench.c
+ *
+ * Microbenchmarks for the diff building blocks
+ *
+ * Run `make bench && ./dmp_bench` and compare the MB/s columns.  Set
+ * DMP_CPU (see dmp_cpu_name) to time the kernels of a lower CPU level.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dmp.h"
+
+#define BENCH_SECONDS	0.25
+
+/* the Railgun_Doublet search that dmp_strstr used to be built on, with its
+ * 16-bit loads done through memcpy so the comparison is well defined
+ */
+static const char *railgun_doublet(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	const char *target = haystack + ln, *target_max = haystack + lh;
+	uint16_t pattern, probe;
+	uint32_t count, count_static;
+
+	if (ln == 0)
+		return haystack;
+	if (ln == 1)
+		return memchr(haystack, *needle, lh);
+	if (ln > lh)
+		return NULL;
+
+	count_static = ln - 2;
+	memcpy(&pattern, needle, sizeof(pattern));
+
+	for (;;) {
+		memcpy(&probe, target - ln, sizeof(probe));
+		if (pattern == probe) {
+			count = count_static;
+			while (count && needle[2 + (count_static - count)] ==
+				(target - ln)[2 + (count_static - count)])
+				count--;
+			if (count == 0)
+				return target - ln;
+		}
+		target++;
+		if (target > target_max)
+			return NULL;
+	}
+}
+
+static const char *libc_memmem(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	return memmem(haystack, lh, needle, ln);
+}
+
+typedef const char *(*search_fn)(const char *, uint32_t, const char *, uint32_t);
+
+static const struct {
+	const char *name;
+	search_fn fn;
+} g_searches[] = {
+	{ "dmp_strstr", dmp_strstr },
+	{ "railgun", railgun_doublet },
+	{ "memmem", libc_memmem },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t g_seed = 12345;
+
+static uint32_t next_rand(void)
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return (g_seed >> 16) & 0x7fff;
+}
+
+static void fill_random(char *buf, uint32_t len)
+{
+	uint32_t i;
+	for (i = 0; i < len; ++i)
+		buf[i] = (char)(' ' + next_rand() % 95);
+}
+
+static void fill_english(char *buf, uint32_t len)
+{
+	static const char *words[] = {
+		"the", "of", "and", "a", "to", "in", "is", "you", "that", "it",
+		"he", "was", "for", "on", "are", "as", "with", "his", "they", "at",
+		"diff", "match", "patch", "text", "common", "middle", "line",
+	};
+	uint32_t i = 0;
+
+	while (i < len) {
+		const char *w = words[next_rand() % (sizeof(words) / sizeof(*words))];
+		while (*w && i < len)
+			buf[i++] = *w++;
+		if (i < len)
+			buf[i++] = (next_rand() % 12) ? ' ' : '\n';
+	}
+}
+
+static void fill_same(char *buf, uint32_t len)
+{
+	memset(buf, 'a', len);
+}
+
+static void bench_search(
+	const char *label, const char *haystack, uint32_t lh,
+	const char *needle, uint32_t ln)
+{
+	size_t s;
+
+	printf("%-28s", label);
+
+	for (s = 0; s < sizeof(g_searches) / sizeof(*g_searches); ++s) {
+		const char *expect = memmem(haystack, lh, needle, ln), *found;
+		double start = now(), elapsed;
+		int rounds = 0;
+
+		/* repeat for a fixed amount of time since some are quadratic */
+		do {
+			found = g_searches[s].fn(haystack, lh, needle, ln);
+			if (found != expect) {
+				printf("\n%s returned the wrong match\n", g_searches[s].name);
+				exit(1);
+			}
+			rounds++;
+		} while ((elapsed = now() - start) < BENCH_SECONDS);
+
+		printf(" %10.0f", (double)lh * rounds / elapsed / (1 << 20));
+	}
+
+	printf("\n");
+}
+
+/* the byte loop that dmp_common_prefix used to be */
+static uint32_t bytewise_prefix(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	const char *start = t1, *end = t1 + (l1 < l2 ? l1 : l2);
+
+	for (; t1 < end && *t1 == *t2; t1++, t2++);
+
+	return (uint32_t)(t1 - start);
+}
+
+static void bench_common(void)
+{
+	static const uint32_t lens[] = { 16, 256, 1 << 20 };
+	uint32_t len = 1 << 20;
+	char *a = malloc(len), *b = malloc(len);
+	size_t l;
+
+	if (!a || !b)
+		exit(1);
+
+	fill_english(a, len);
+	memcpy(b, a, len);
+
+	printf("\n%-28s %10s %10s %10s\n", "common text MB/s",
+		"prefix", "suffix", "bytewise");
+
+	for (l = 0; l < sizeof(lens) / sizeof(*lens); ++l) {
+		uint32_t (*fns[3])(const char *, uint32_t, const char *, uint32_t) =
+			{ dmp_common_prefix, dmp_common_suffix, bytewise_prefix };
+		char label[64];
+		size_t f;
+
+		snprintf(label, sizeof(label), "identical, %u bytes", lens[l]);
+		printf("%-28s", label);
+
+		for (f = 0; f < 3; ++f) {
+			double start = now(), elapsed;
+			uint64_t bytes = 0;
+
+			do {
+				uint32_t i;
+				for (i = 0; i < 64; ++i)
+					bytes += fns[f](a, lens[l], b, lens[l]);
+			} while ((elapsed = now() - start) < BENCH_SECONDS);
+
+			printf(" %10.0f", (double)bytes / elapsed / (1 << 20));
+		}
+		printf("\n");
+	}
+
+	free(a);
+	free(b);
+}
+
+/* reallocations the old growth rule (start at 8 records, double up to
+ * 128 and then add 128 at a time) needed to reach `nodes` records
+ */
+static uint32_t old_pool_grows(uint32_t nodes)
+{
+	uint32_t size = 8, grows = 0;
+
+	while (size < nodes) {
+		size = (size > 128) ? size + 128 : size * 2;
+		grows++;
+	}
+
+	return grows;
+}
+
+/* copy `text` with about `per_mille` edits for every 1000 bytes */
+static uint32_t make_edits(char *out, const char *text, uint32_t len, int per_mille)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < len; ++i) {
+		uint32_t r = next_rand() % 2000;
+		if (r < (uint32_t)per_mille)
+			continue;
+		if (r < 2 * (uint32_t)per_mille)
+			out[n++] = (char)(' ' + next_rand() % 95);
+		out[n++] = text[i];
+	}
+
+	return n;
+}
+
+static void bench_pool(void)
+{
+	static const int rates[] = { 1, 10, 100 };
+	uint32_t len = 200000, len2;
+	char *text = malloc(len), *edited = malloc(2 * len);
+	size_t r;
+
+	if (!text || !edited)
+		exit(1);
+
+	printf("\n%-28s %10s %10s %10s %10s %10s\n", "pool reallocs per diff",
+		"records", "old", "unsized", "estimate", "hinted");
+
+	fill_english(text, len);
+
+	for (r = 0; r < sizeof(rates) / sizeof(*rates); ++r) {
+		dmp_options opts;
+		dmp_diff *diff;
+		dmp_stats st;
+		uint32_t hunks, unsized, estimate, hinted;
+		char label[64];
+
+		len2 = make_edits(edited, text, len, rates[r]);
+		dmp_options_init(&opts);
+		opts.timeout = 0;
+
+		dmp_diff_new(&diff, &opts, text, len, edited, len2);
+		dmp_diff_stats(diff, &st);
+		hunks = dmp_diff_hunks(diff);
+		estimate = st.pool_grows;
+		dmp_diff_free(diff);
+
+		opts.expected_hunks = 1;
+		dmp_diff_new(&diff, &opts, text, len, edited, len2);
+		dmp_diff_stats(diff, &st);
+		unsized = st.pool_grows;
+		dmp_diff_free(diff);
+
+		opts.expected_hunks = hunks;
+		dmp_diff_new(&diff, &opts, text, len, edited, len2);
+		dmp_diff_stats(diff, &st);
+		hinted = st.pool_grows;
+		dmp_diff_free(diff);
+
+		snprintf(label, sizeof(label), "%d edits per 1000 bytes", rates[r]);
+		printf("%-28s %10u %10u %10u %10u %10u\n", label, st.nodes_used,
+			old_pool_grows(st.nodes_used + 1), unsized, estimate, hinted);
+	}
+
+	free(text);
+	free(edited);
+}
+
+/* a CSV-like log of `len` bytes, and a copy with a few records changed,
+ * dropped and added
+ */
+static void make_log(
+	char *t1, uint32_t *l1, char *t2, uint32_t *l2, uint32_t len)
+{
+	uint32_t i, n1 = 0, n2 = 0;
+
+	for (i = 0; n1 + 64 < len; ++i) {
+		int n = sprintf(t1 + n1, "%u,%08x,event-%u,%u\n",
+			i, next_rand(), i % 13, next_rand() % 100000);
+		n1 += n;
+		if (next_rand() % 2000 == 0)
+			n2 += sprintf(t2 + n2, "%u,changed,%u\n", i, next_rand());
+		else if (next_rand() % 2000 != 0)
+			memcpy(t2 + n2, t1 + n1 - n, n), n2 += n;
+	}
+
+	*l1 = n1;
+	*l2 = n2;
+}
+
+static void bench_records(void)
+{
+	static const struct {
+		const char *name;
+		int algorithm;
+		uint32_t threads;
+	} runs[] = {
+		{ "histogram", DMP_ALGORITHM_HISTOGRAM, 1 },
+		{ "records", DMP_ALGORITHM_RECORDS, 1 },
+		{ "records x4", DMP_ALGORITHM_RECORDS, 4 },
+	};
+	uint32_t len = 64 << 20, l1, l2;
+	char *t1 = malloc(len), *t2 = malloc(len);
+	size_t r;
+
+	if (!t1 || !t2)
+		exit(1);
+
+	make_log(t1, &l1, t2, &l2, len);
+
+	printf("\n%-28s", "64MB log diff MB/s");
+	for (r = 0; r < sizeof(runs) / sizeof(*runs); ++r)
+		printf(" %10s", runs[r].name);
+	printf("\n%-28s", "");
+
+	for (r = 0; r < sizeof(runs) / sizeof(*runs); ++r) {
+		dmp_options opts;
+		dmp_diff *diff;
+		double start;
+
+		dmp_options_init(&opts);
+		opts.timeout = 0;
+		opts.algorithm = runs[r].algorithm;
+		opts.threads = runs[r].threads;
+
+		start = now();
+		dmp_diff_new(&diff, &opts, t1, l1, t2, l2);
+		printf(" %10.0f", l1 / (now() - start) / 1e6);
+		dmp_diff_free(diff);
+	}
+	printf("\n");
+
+	free(t1);
+	free(t2);
+}
+
+int main(void)
+{
+	uint32_t lh = 1 << 20, ln;
+	char *haystack = malloc(lh), *needle = malloc(lh);
+	size_t s;
+
+	if (!haystack || !needle)
+		return 1;
+
+	printf("kernels: %s\n\n", dmp_cpu_name());
+
+	printf("%-28s", "strstr MB/s");
+	for (s = 0; s < sizeof(g_searches) / sizeof(*g_searches); ++s)
+		printf(" %10s", g_searches[s].name);
+	printf("\n");
+
+	/* needles that do not occur, so the whole haystack is scanned */
+	fill_random(haystack, lh);
+	for (ln = 2; ln <= 256; ln *= 4) {
+		char label[64];
+		fill_random(needle, ln);
+		needle[0] = '\x01';
+		snprintf(label, sizeof(label), "random, needle %u", ln);
+		bench_search(label, haystack, lh, needle, ln);
+	}
+
+	fill_english(haystack, lh);
+	for (ln = 4; ln <= 256; ln *= 4) {
+		char label[64];
+		fill_english(needle, ln);
+		needle[ln - 1] = '!';
+		snprintf(label, sizeof(label), "english, needle %u", ln);
+		bench_search(label, haystack, lh, needle, ln);
+	}
+
+	/* every position is a first/last byte candidate */
+	fill_same(haystack, lh);
+	for (ln = 16; ln <= 1024; ln *= 8) {
+		char label[64];
+		fill_same(needle, ln);
+		needle[ln / 2] = 'b';
+		snprintf(label, sizeof(label), "aaa..ab..a, needle %u", ln);
+		bench_search(label, haystack, lh, needle, ln);
+	}
+
+	free(haystack);
+	free(needle);
+
+	bench_common();
+	bench_pool();
+	bench_records();
+	return 0;
+}
@@ -36,6 +36,23 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/* Declares a public function.  libdmp is built with -fvisibility=hidden,
+ * so these are the only symbols that a shared libdmp exports.  Windows
+ * users of a DLL built with DMP_SHARED and DMP_EXPORTS should define
+ * DMP_SHARED too.
+ */
+#if defined(_WIN32) && defined(DMP_SHARED)
+# if defined(DMP_EXPORTS)
+#  define DMP_EXTERN extern __declspec(dllexport)
+# else
+#  define DMP_EXTERN extern __declspec(dllimport)
+# endif
+#elif defined(__GNUC__) && __GNUC__ >= 4
+# define DMP_EXTERN extern __attribute__((visibility("default")))
+#else
+# define DMP_EXTERN extern
+#endif
+
 /**
  * Public: Each hunk of diff describes one of these operations.
  */
@@ -45,6 +62,49 @@ typedef enum {
 	DMP_DIFF_INSERT = 1
 } dmp_operation_t;
 
+/**
+ * Public: Algorithms that can be used to compute a diff.
+ *
+ * MYERS is the byte-level Myers bisection diff used by upstream.  PATIENCE
+ * and HISTOGRAM work on lines (as in git): they anchor the diff on lines
+ * that are rare in both texts and only fall back to the Myers diff for the
+ * regions between those anchors, which is usually faster on large source
+ * files and gives more readable results.  RECORDS is for very large files
+ * of newline-terminated records such as CSV exports and logs: each record
+ * is hashed (on `threads` threads), the arrays of hashes are diffed, and
+ * only the records that changed are diffed byte by byte.
+ */
+typedef enum {
+	DMP_ALGORITHM_MYERS = 0,
+	DMP_ALGORITHM_PATIENCE = 1,
+	DMP_ALGORITHM_HISTOGRAM = 2,
+	DMP_ALGORITHM_RECORDS = 3
+} dmp_algorithm_t;
+
+/**
+ * Public: Phases of the diff engine reported by profiling builds.
+ */
+typedef enum {
+	DMP_PHASE_TRIM = 0,    /* common prefix and suffix removal */
+	DMP_PHASE_CONTAIN = 1, /* search for one text inside the other */
+	DMP_PHASE_BISECT = 2,  /* Myers middle snake search */
+	DMP_PHASE_CLEANUP = 3, /* dmp_diff_cleanup_merge passes */
+	DMP_PHASE_COUNT = 4
+} dmp_phase_t;
+
+/**
+ * Public: Callback made at the start and the end of each engine phase.
+ *
+ * Only libraries built with `DMP_PROFILE` defined make these calls.  The
+ * lengths are those of the two texts the phase is working on (0 for the
+ * cleanup passes, which work on hunks); `done` is 0 when the phase starts
+ * and 1 when it ends.  Phases of nested diffs
+ * start and end in between, except that a bisect and a cleanup pass end
+ * before the nested work that they hand off to begins.
+ */
+typedef void (*dmp_phase_callback)(
+	void *cb_ref, dmp_phase_t phase, int done, uint32_t len1, uint32_t len2);
+
 /**
  * Public: Options structure configures behavior of diff functions.
  */
@@ -94,8 +154,56 @@ typedef struct {
 
 	/* Should the diff trim the common suffix? */
 	int trim_common_suffix; /* = 1 */
+
+	/* Which `dmp_algorithm_t` engine should compute the diff? */
+	int algorithm; /* = DMP_ALGORITHM_MYERS */
+
+	/* Give up once the texts are known to be more than this many inserted
+	 * plus deleted characters apart (0 for no limit).  The rest of the
+	 * diff is then filled in with plain DELETE / INSERT pairs.
+	 */
+	uint32_t max_edits; /* = 0 */
+
+	/* Optional 64-bit content hashes of `text1` and `text2` (0 if not
+	 * known).  When both are set and differ, the texts are taken to be
+	 * different without comparing their bytes; equal hashes still have
+	 * the bytes compared, so a collision cannot hide a change.
+	 * These describe one specific pair of texts, so be sure to reset them
+	 * before reusing the options for a different pair.
+	 */
+	uint64_t text1_hash; /* = 0 */
+	uint64_t text2_hash; /* = 0 */
+
+	/* Roughly how many hunks the diff is expected to have (0 if not
+	 * known).  This only sizes the initial allocation of diff records;
+	 * when it is 0, a size is estimated from the texts.
+	 */
+	uint32_t expected_hunks; /* = 0 */
+
+	/* Threads that may split up the record scan and hashing of the
+	 * RECORDS algorithm (0 or 1 to do it all on the calling thread).
+	 */
+	uint32_t threads; /* = 1 */
+
+	/* Look for blocks of at least this many bytes that were moved from
+	 * one place to another (0 to not look for moves).  See
+	 * `dmp_diff_foreach_moves`.
+	 */
+	uint32_t move_min_len; /* = 0 */
+
+	/* Called at engine phase boundaries by a `DMP_PROFILE` build. */
+	dmp_phase_callback phase_cb; /* = NULL */
+	void *phase_cb_ref;          /* = NULL */
 } dmp_options;
 
+/**
+ * Public: Status returned when texts are more than `max_edits` apart.
+ *
+ * This is a positive value so that it will not be mistaken for a failure
+ * by callers that only check for a negative return.
+ */
+#define DMP_TOO_DIFFERENT 1
+
 /**
  * Public: Main diff object.
  *
@@ -106,8 +214,96 @@ typedef struct {
  */
 typedef struct dmp_diff dmp_diff;
 
+/**
+ * Public: A diff that is computed a step at a time.
+ *
+ * This is an opaque structure holding the partial state of a diff that
+ * was started with `dmp_diff_job_start` (see there).
+ */
+typedef struct dmp_diff_job dmp_diff_job;
+
+/**
+ * Public: Status returned by `dmp_diff_job_step` while work remains.
+ *
+ * This is distinct from `DMP_TOO_DIFFERENT`, and positive so that it is
+ * not mistaken for a failure.
+ */
+#define DMP_JOB_MORE 2
+
+/**
+ * Public: Cache of finished diffs.
+ *
+ * This is an opaque structure that remembers recent diffs keyed by the
+ * content hashes of both texts and the options used, so that requests
+ * for the same pair of texts can share one immutable diff.
+ */
+typedef struct dmp_cache dmp_cache;
+
+/**
+ * Public: Result of a three-way merge.
+ *
+ * This is an opaque structure holding the regions of a merge, which
+ * point into the base and the two derived texts that were merged.
+ */
+typedef struct dmp_merge dmp_merge;
+
+/**
+ * Public: Each region of a three-way merge is one of these kinds.
+ */
+typedef enum {
+	DMP_MERGE_UNCHANGED = 0, /* neither side changed the base */
+	DMP_MERGE_A = 1,         /* only `a` changed the base */
+	DMP_MERGE_B = 2,         /* only `b` changed the base */
+	DMP_MERGE_BOTH = 3,      /* both sides made the same change */
+	DMP_MERGE_CONFLICT = 4   /* the sides made different changes */
+} dmp_merge_t;
+
 typedef struct dmp_patch dmp_patch;
 
+/**
+ * Public: Per-phase counters and timers of a diff.
+ *
+ * These are only gathered by libraries built with `DMP_PROFILE` defined
+ * (`make PROFILE=1`), which otherwise leave the engine untouched.  Ticks
+ * are CPU timestamp counter cycles on x86 and nanoseconds elsewhere, and
+ * only count time spent in the phase itself, not in nested diffs.
+ */
+typedef struct {
+	uint64_t calls[DMP_PHASE_COUNT]; /* times each phase was entered */
+	uint64_t ticks[DMP_PHASE_COUNT]; /* time spent in each phase */
+	uint64_t bytes[DMP_PHASE_COUNT]; /* text lengths handed to each phase */
+	uint64_t bisect_steps;           /* `d` iterations over all bisects */
+	uint32_t bisect_max_d;           /* largest `d` one bisect reached */
+} dmp_profile;
+
+/**
+ * Public: Totals and engine counters for a diff.
+ *
+ * The totals are gathered while the diff is built, so reading them does
+ * not require another walk over the hunks.  `levenshtein` is the upstream
+ * `diff_levenshtein` value, i.e. the larger of the inserted and deleted
+ * byte counts summed over each run of changes between equalities.
+ */
+typedef struct {
+	uint32_t equals, inserts, deletes;  /* number of hunks of each kind */
+	uint32_t equal_bytes, insert_bytes, delete_bytes;
+	uint32_t levenshtein;
+
+	uint32_t bisect_calls;  /* number of Myers bisections run */
+	uint32_t max_depth;     /* most parts waiting on the engine's stack */
+	uint32_t contain_checks; /* "one text inside the other" searches run */
+	uint32_t contain_skips;  /* ...ruled out without searching */
+	uint32_t contain_hits;   /* ...that found the shorter text */
+	uint64_t contain_bytes;  /* bytes of the longer texts searched */
+	uint32_t nodes_used;    /* diff records ever taken from the pool */
+	uint32_t nodes_freed;   /* diff records returned to the pool */
+	uint32_t pool_grows;    /* times the pool of records was reallocated */
+	int timed_out;          /* did the `timeout` deadline cut a bisect? */
+	int too_different;      /* was the `max_edits` budget exceeded? */
+	uint32_t moves;         /* moved blocks found with `move_min_len` */
+	uint32_t bitpar_calls;  /* short texts diffed with bit vectors */
+} dmp_stats;
+
 /**
  * Public: Callback function for iterating over a diff.
  *
@@ -131,6 +327,35 @@ typedef struct dmp_patch dmp_patch;
 typedef int (*dmp_diff_callback)(
 	void *cb_ref, dmp_operation_t op, const void *data, uint32_t len);
 
+/**
+ * Public: Callback function for iterating over a diff with its moves.
+ *
+ * This is `dmp_diff_callback` with one more parameter.
+ *
+ * move - 0 for most hunks.  A block of text that was moved is reported
+ *        as a DELETE at its old place and an INSERT at its new place,
+ *        and `move` is the same non-zero number for both of them.  Moves
+ *        are numbered from 1 in the order of their INSERT hunks.
+ */
+typedef int (*dmp_diff_move_callback)(
+	void *cb_ref, dmp_operation_t op, const void *data, uint32_t len,
+	uint32_t move);
+
+/**
+ * Public: One diff hunk in a flat array from `dmp_diff_to_array`.
+ *
+ * The data for the hunk is at `offset` in `text1` if `side` is 0 or in
+ * `text2` if `side` is 1.  DELETE and EQUAL hunks always use `text1` and
+ * INSERT hunks use `text2`, so within each side the offsets are sorted
+ * and can be binary searched.
+ */
+typedef struct {
+	int op;          /* a `dmp_operation_t` value */
+	int side;        /* 0 for `text1` or 1 for `text2` */
+	uint32_t offset; /* byte offset of the data in that text */
+	uint32_t len;    /* bytes of data in this hunk */
+} dmp_hunk;
+
 /**
  * Public: Initialize options structure to default values.
  *
@@ -142,7 +367,7 @@ typedef int (*dmp_diff_callback)(
  *
  * Returns 0 on success, -1 on failure.
  */
-extern int dmp_options_init(dmp_options *opts);
+DMP_EXTERN int dmp_options_init(dmp_options *opts);
 
 /**
  * Public: Calculate the diff between two texts.
@@ -161,11 +386,19 @@ extern int dmp_options_init(dmp_options *opts);
  * text2 - The TO text for the right side of the diff.
  * len2 - The number of bytes of data in `text2`.
  *
+ * Identical texts are detected up front (by pointer, by content hashes
+ * in `options`, or by a plain `memcmp`) and produce a single EQUAL hunk
+ * without running the diff engine or allocating any diff records.
+ *
  * Returns 0 if the diff was successfully generated, -1 on failure.  The
- * only current failure scenario would be a failed allocation.  Otherwise,
- * some sort of diff should be generated..
+ * only current failure scenario would be a failed allocation, in which
+ * case `*diff` is set to NULL and nothing needs to be freed.  Otherwise,
+ * some sort of diff should be generated..  If `options->max_edits` is set
+ * and the texts turn out to be further apart than that, this returns
+ * `DMP_TOO_DIFFERENT` with a valid (but coarse) diff that must still be
+ * freed.
  */
-extern int dmp_diff_new(
+DMP_EXTERN int dmp_diff_new(
 	dmp_diff **diff,
 	const dmp_options *options,
 	const char *text1,
@@ -193,20 +426,154 @@ extern int dmp_diff_new(
  * only current failure scenario would be a failed allocation.  Otherwise,
  * some sort of diff should be generated..
  */
-extern int dmp_diff_from_strs(
+DMP_EXTERN int dmp_diff_from_strs(
 	dmp_diff **diff,
 	const dmp_options *options,
 	const char *text1,
 	const char *text2);
 
+/**
+ * Public: Start a diff that is computed a step at a time.
+ *
+ * This is for callers such as event loops that cannot block for as long
+ * as `dmp_diff_new` may take.  Nothing is diffed yet: the work is done by
+ * calls to `dmp_diff_job_step`, each bounded by a budget, and the diff is
+ * taken with `dmp_diff_job_finish`.  The state between steps, including a
+ * bisect that is under way, is kept in the job, so steps can be spread out
+ * over time and between other work on the same thread.
+ *
+ * The result is a minimal diff of the same texts as `dmp_diff_new` would
+ * give, though not always with the same hunks, as the merge cleanup runs
+ * once at the end rather than after each part.  The `timeout` option is
+ * not used, since the caller decides how long to keep stepping and can
+ * cancel the job instead.  The line, record and move algorithms are not
+ * resumable, and run in one go on the first step.
+ *
+ * job - Pointer to a `dmp_diff_job` pointer that will be allocated.  You
+ *       must call `dmp_diff_job_finish()` or `dmp_diff_job_cancel()` on
+ *       this pointer when done.
+ * options - `dmp_options` structure to control diff, or NULL to use defaults.
+ *       The job keeps a copy of it.
+ * text1 - The FROM text, which must outlive the job and the diff.
+ * len1 - The number of bytes of data in `text1`.
+ * text2 - The TO text, which must outlive the job and the diff.
+ * len2 - The number of bytes of data in `text2`.
+ *
+ * Returns 0 on success or -1 on allocation failure, in which case `*job`
+ * is set to NULL.
+ */
+DMP_EXTERN int dmp_diff_job_start(
+	dmp_diff_job **job,
+	const dmp_options *options,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2);
+
+/**
+ * Public: Do some of the work of a diff job.
+ *
+ * The budget counts the diagonals that the Myers bisect examines (each
+ * costs a comparison and maybe a scan of equal bytes) plus one for each
+ * part of the texts handled, and a step stops at the first point past
+ * it where the work can be suspended.  Each step makes some progress, so
+ * a loop of steps always ends.
+ *
+ * job - The job to work on.
+ * max_diagonals - Budget for this step, or 0 to run to the end.
+ *
+ * Returns `DMP_JOB_MORE` if there is work left, 0 once the diff is done,
+ * or -1 on allocation failure (the job must still be cancelled).
+ */
+DMP_EXTERN int dmp_diff_job_step(dmp_diff_job *job, uint32_t max_diagonals);
+
+/**
+ * Public: Finish a diff job and take its diff.
+ *
+ * Any work that is left is done now, without a budget.  The job is freed
+ * whether this succeeds or not.
+ *
+ * job - The job to finish.
+ * diff - Pointer to a `dmp_diff` pointer that gets the diff.  You must
+ *        call `dmp_diff_free()` on this pointer when done.
+ *
+ * Returns the same values as `dmp_diff_new`.
+ */
+DMP_EXTERN int dmp_diff_job_finish(dmp_diff_job *job, dmp_diff **diff);
+
+/**
+ * Public: Cancel a diff job and free its partial state.
+ *
+ * job - The job to cancel, or NULL.
+ */
+DMP_EXTERN void dmp_diff_job_cancel(dmp_diff_job *job);
+
+/**
+ * Public: Callback that decides if two elements of a sequence are equal.
+ *
+ * cb_ref - The reference pointer passed to `dmp_diff_seq`.
+ * a - Pointer to an element of the FROM sequence.
+ * b - Pointer to an element of the TO sequence.
+ *
+ * Returns non-zero if the elements are equal.
+ */
+typedef int (*dmp_seq_callback)(void *cb_ref, const void *a, const void *b);
+
+/**
+ * Public: Generate a diff of two arrays of fixed-size elements.
+ *
+ * This runs the Myers diff over elements instead of bytes, for diffing
+ * sequences such as token IDs or line hashes without encoding them as
+ * text.  Elements are equal if their bytes are, or if `eq` says so when
+ * it is given.  Without `eq`, 4 and 8 byte elements are compared as
+ * whole words and runs of equal elements are found with the same
+ * vectorized scans as for texts.
+ *
+ * Every length in the resulting diff counts elements: the hunks that
+ * `dmp_diff_foreach` reports (whose data points at their first element),
+ * the offsets of `dmp_diff_to_array` and `dmp_diff_map_offset`, and the
+ * `*_bytes` totals of `dmp_diff_stats`.  The delta encodings and
+ * `dmp_diff_update` only apply to diffs of texts and fail on these, and
+ * `dmp_diff_print_raw` prints just the hunk lengths.
+ * The `timeout` and `max_edits` options apply (counting elements) and
+ * the `algorithm` and `check_lines` options are ignored.
+ *
+ * diff - Pointer to a `dmp_diff` pointer that will be allocated.  You must
+ *        call `dmp_diff_free()` on this pointer when done.
+ * options - `dmp_options` structure to control diff, or NULL to use defaults.
+ * elem_size - Bytes in each element, which must be at least 1.
+ * a - The FROM array, which must outlive the diff.
+ * na - The number of elements in `a`.
+ * b - The TO array, which must outlive the diff.
+ * nb - The number of elements in `b`.
+ * eq - Element comparison callback, or NULL to compare bytes.
+ * eq_ref - A reference pointer that will be passed to `eq`.
+ *
+ * Returns the same values as `dmp_diff_new`, and -1 as well if either
+ * array is larger than 4GB.
+ */
+DMP_EXTERN int dmp_diff_seq(
+	dmp_diff **diff,
+	const dmp_options *options,
+	uint32_t elem_size,
+	const void *a,
+	uint32_t    na,
+	const void *b,
+	uint32_t    nb,
+	dmp_seq_callback eq,
+	void *eq_ref);
+
 /**
  * Public: Free the diff structure.
  *
- * Call this when you are done with the diff data.
+ * Call this when you are done with the diff data.  A diff returned by
+ * `dmp_cache_diff` may be shared, in which case this just drops your
+ * reference to it.  Threads holding references to the same shared diff
+ * may drop them concurrently.
  *
  * diff - The `dmp_diff` object to be freed.
  */
-extern void dmp_diff_free(dmp_diff *diff);
+DMP_EXTERN void dmp_diff_free(dmp_diff *diff);
 
 /**
  * Public: Iterate over changes in a diff list.
@@ -220,56 +587,519 @@ extern void dmp_diff_free(dmp_diff *diff);
  * Returns 0 if iteration completed successfully, or any non-zero value
  * that was returned by the `cb` callback function to terminate iteration.
  */
-extern int dmp_diff_foreach(
+DMP_EXTERN int dmp_diff_foreach(
+	const dmp_diff *diff,
+	dmp_diff_callback cb,
+	void *cb_ref);
+
+/**
+ * Public: Iterate over changes in a diff list, along with moved blocks.
+ *
+ * This visits the same hunks as `dmp_diff_foreach`, so that moved text
+ * can be shown as such.  Moves are only found in diffs made with the
+ * `move_min_len` option, and `dmp_diff_update` forgets them.
+ *
+ * diff - The `dmp_diff` object to iterate over.
+ * cb - The callback function to invoke on each hunk.
+ * cb_ref - A reference pointer that will be passed to callback.
+ *
+ * Returns 0 if iteration completed successfully, or any non-zero value
+ * that was returned by the `cb` callback function to terminate iteration.
+ */
+DMP_EXTERN int dmp_diff_foreach_moves(
 	const dmp_diff *diff,
+	dmp_diff_move_callback cb,
+	void *cb_ref);
+
+/**
+ * Public: Iterate over a slice of the hunks in a diff list.
+ *
+ * Invoke a callback on hunks `from_hunk` up to (but not including)
+ * `to_hunk`, counted in the order `dmp_diff_foreach` visits them, so
+ * that the work on a large diff can be split between threads.  Every
+ * function that takes a `const dmp_diff *` may be called from several
+ * threads at once on the same diff; only `dmp_diff_update` and the last
+ * `dmp_diff_free` of a diff need it to be otherwise unused.  Starting
+ * past the first hunk uses the same hunk index as `dmp_diff_map_offset`.
+ *
+ * diff - The `dmp_diff` object to iterate over.
+ * from_hunk - Index of the first hunk to visit.
+ * to_hunk - Index just past the last hunk to visit.  Values beyond
+ *           `dmp_diff_hunks()` are clamped to it.
+ * cb - The callback function to invoke on each hunk.
+ * cb_ref - A reference pointer that will be passed to callback.
+ *
+ * Returns 0 if iteration completed successfully (or the slice was
+ * empty), or any non-zero value that was returned by the `cb` callback
+ * function to terminate iteration.
+ */
+DMP_EXTERN int dmp_diff_foreach_range(
+	const dmp_diff *diff,
+	uint32_t from_hunk,
+	uint32_t to_hunk,
 	dmp_diff_callback cb,
 	void *cb_ref);
 
 /**
  * Public: Count the number of diff hunks.
  *
- * This computes the number of hunks in a diff object.  This is the
- * number of times that your iterator function would be invoked.
+ * This returns the number of hunks in a diff object, which is counted
+ * when the diff is generated.  This is the number of times that your
+ * iterator function would be invoked.
  *
  * diff - The `dmp_diff` object.
  *
  * Returns a count of the number of hunks in the diff.
  */
-extern uint32_t dmp_diff_hunks(const dmp_diff *diff);
+DMP_EXTERN uint32_t dmp_diff_hunks(const dmp_diff *diff);
+
+/**
+ * Public: Export the diff hunks as a flat array.
+ *
+ * This compacts the diff into a newly allocated contiguous array of
+ * `dmp_hunk` records, in the same order as `dmp_diff_foreach` would
+ * visit them.
+ *
+ * hunks - Pointer to the array that will be allocated.  You must call
+ *         `free()` on this pointer when done.  This is set to NULL for a
+ *         diff with no hunks.
+ * count - Output of the number of entries in the array.
+ * diff - The `dmp_diff` object.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+DMP_EXTERN int dmp_diff_to_array(
+	dmp_hunk **hunks, uint32_t *count, const dmp_diff *diff);
+
+/**
+ * Public: Export the diff hunks into caller-supplied memory.
+ *
+ * This is like `dmp_diff_to_array` but fills in at most `size` entries
+ * of the `hunks` buffer.  Size the buffer with `dmp_diff_hunks`.
+ *
+ * Returns the total number of hunks in the diff, which is more than
+ * `size` if the array was truncated.
+ */
+DMP_EXTERN uint32_t dmp_diff_to_array_buf(
+	dmp_hunk *hunks, uint32_t size, const dmp_diff *diff);
+
+/**
+ * Public: Map a location in `text1` to the matching location in `text2`.
+ *
+ * This is the `diff_xIndex` function of other diff-match-patch versions,
+ * handy for moving cursors or annotations across an edit.  A location
+ * inside deleted text maps to the place where the deletion was.  The
+ * first call builds an index of the hunk offsets inside the diff so
+ * that every lookup is a binary search.
+ *
+ * diff - The `dmp_diff` object.
+ * offset - Byte offset into `text1`.
+ *
+ * Returns the corresponding byte offset into `text2`.
+ */
+DMP_EXTERN uint32_t dmp_diff_map_offset(
+	const dmp_diff *diff, uint32_t offset);
+
+/**
+ * Public: Map many locations in `text1` to locations in `text2`.
+ *
+ * This gives the same results as calling `dmp_diff_map_offset` for each
+ * entry, but when `offsets` is sorted in ascending order, all of them are
+ * mapped in a single pass over the diff without building the index.
+ *
+ * diff - The `dmp_diff` object.
+ * out - Array of `count` entries to be filled with `text2` offsets.
+ * offsets - Array of `count` byte offsets into `text1`.
+ * count - The number of offsets to map.
+ */
+DMP_EXTERN void dmp_diff_map_offsets(
+	const dmp_diff *diff, uint32_t *out, const uint32_t *offsets,
+	uint32_t count);
+
+/**
+ * Public: Update a diff after a small edit to `text2`.
+ *
+ * For an editor where `text2` changes a little at a time while `text1`
+ * stays fixed, this avoids diffing the whole document again.  The hunks
+ * around the edit are cut at the nearest EQUAL hunks, only the text in
+ * between is diffed again, and the result is spliced into the existing
+ * diff.  The window is found with a binary search of the hunk index of
+ * `dmp_diff_map_offset` (built on first use and then kept up to date),
+ * and the work scales with its size, plus a pass over the hunks after it
+ * when the edit changes the length of `text2` or the number of hunks.
+ *
+ * The caller makes the edit and passes the resulting text2, which may be
+ * the old buffer edited in place or a new one.  Hunks of the diff are
+ * moved to point into it, so the old buffer is no longer referenced (for
+ * a new buffer, that takes a pass over all of the hunks).  `text1` must
+ * not change.  The `max_edits` budget is not applied to updates.
+ *
+ * diff - The `dmp_diff` object to update.  Diffs from `dmp_cache_diff` or
+ *        `dmp_diff_from_delta` cannot be updated.
+ * options - Options for diffing the window, NULL for defaults.
+ * text2 - The edited `text2`.
+ * offset - Byte offset of the edit in `text2`.
+ * removed_len - Bytes of the old `text2` that were removed at `offset`.
+ * inserted_len - Bytes that were inserted at `offset` in their place.
+ *
+ * Returns 0 on success, -1 if the diff cannot be updated or on allocation
+ * failure (which leaves the diff as it was).
+ */
+DMP_EXTERN int dmp_diff_update(
+	dmp_diff *diff,
+	const dmp_options *options,
+	const char *text2,
+	uint32_t    offset,
+	uint32_t    removed_len,
+	uint32_t    inserted_len);
+
+/**
+ * Public: Get totals and engine counters for a diff.
+ *
+ * diff - The `dmp_diff` object.
+ * stats - Structure to be filled in, generally created on the stack.
+ */
+DMP_EXTERN void dmp_diff_stats(const dmp_diff *diff, dmp_stats *stats);
+
+/**
+ * Public: Get the per-phase profile of a diff.
+ *
+ * diff - The `dmp_diff` object.
+ * profile - Structure to be filled in, generally created on the stack.
+ *
+ * Returns 0 on success, -1 (with `profile` zeroed) if the library was
+ * built without `DMP_PROFILE`.
+ */
+DMP_EXTERN int dmp_diff_profile(const dmp_diff *diff, dmp_profile *profile);
+
+/**
+ * Public: Check if two texts are within a given edit distance.
+ *
+ * This computes the number of inserted plus deleted characters needed to
+ * turn `text1` into `text2` (the "D" of the Myers diff), but stops as soon
+ * as that is known to be more than `max_edits`.  No diff is built, and
+ * the cost is O(max_edits * (len1 + len2)) time and O(max_edits) memory,
+ * so far-apart texts are rejected quickly.
+ *
+ * distance - Output of the edit distance if it is within `max_edits`.
+ * text1 - The FROM text for the left side of the comparison.
+ * len1 - The number of bytes of data in `text1`.
+ * text2 - The TO text for the right side of the comparison.
+ * len2 - The number of bytes of data in `text2`.
+ * max_edits - Largest distance that the caller is interested in.
+ *
+ * Returns 0 if the distance was computed, `DMP_TOO_DIFFERENT` if the texts
+ * are more than `max_edits` apart, or -1 on allocation failure or if the
+ * search would need more than INT_MAX / 2 diagonals (both `max_edits` and
+ * the changed middle of the texts past about 2^30 bytes).
+ */
+DMP_EXTERN int dmp_diff_distance_bounded(
+	uint32_t   *distance,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2,
+	uint32_t    max_edits);
+
+/**
+ * Public: Compute the edit distance between two texts, and maybe a diff.
+ *
+ * The distance is the number of inserted plus deleted bytes, as for
+ * `dmp_diff_distance_bounded()`, but it is found with a bit-parallel
+ * algorithm that handles 64 bytes of the shorter text per word operation
+ * for each byte of the other, which is much faster than a diff for short
+ * strings and has no bound to give.  If `diff` is not NULL, a minimal
+ * diff is also traced back from the bit vectors and returned there.
+ * That keeps a vector per byte of `text2`, so past about 16MB of them the
+ * diff is built with `dmp_diff_new()` and no timeout instead.
+ *
+ * distance - Output of the edit distance.
+ * diff - NULL, or pointer to a `dmp_diff` pointer that will be allocated.
+ *        You must call `dmp_diff_free()` on this pointer when done.
+ * text1 - The FROM text for the left side of the comparison.
+ * len1 - The number of bytes of data in `text1`.
+ * text2 - The TO text for the right side of the comparison.
+ * len2 - The number of bytes of data in `text2`.
+ *
+ * Returns 0 on success, or -1 on allocation failure.
+ */
+DMP_EXTERN int dmp_edit_distance(
+	uint32_t   *distance,
+	dmp_diff  **diff,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2);
+
+/**
+ * Public: Create a cache of diff results.
+ *
+ * cache - Pointer to a `dmp_cache` pointer that will be allocated.  You
+ *         must call `dmp_cache_free()` on this pointer when done.
+ * max_bytes - Memory cap for cached texts and diff records.  Once it is
+ *         reached, the least recently used diffs are evicted.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+DMP_EXTERN int dmp_cache_new(dmp_cache **cache, size_t max_bytes);
+
+/**
+ * Public: Drop all cached diffs.
+ *
+ * Diffs that callers still hold stay valid until they are freed.
+ */
+DMP_EXTERN void dmp_cache_clear(dmp_cache *cache);
+
+/**
+ * Public: Free the cache and drop all cached diffs.
+ */
+DMP_EXTERN void dmp_cache_free(dmp_cache *cache);
+
+/**
+ * Public: Calculate a diff, reusing a cached result when possible.
+ *
+ * This works like `dmp_diff_new` except that the texts are looked up in
+ * the cache by their `dmp_hash64` values (or by `options->text1_hash`
+ * and `options->text2_hash` if the caller already knows them), their
+ * lengths and the options that affect the diff, and a cached diff is only
+ * returned once its copy of the texts compares equal to them (so a hash
+ * collision is just a miss).  On a miss, the texts are copied into
+ * storage owned by the diff, so the result does not depend on the
+ * caller's buffers and the diff text pointers will not point into `text1`
+ * or `text2`.
+ *
+ * The returned diff must be treated as read-only, since other callers may
+ * be holding the same object, and it must be released with
+ * `dmp_diff_free()`.  Diffs cut short by `timeout` are returned but not
+ * cached, as are pairs of texts too large for the cache's memory cap
+ * (those reference the caller's buffers, as with `dmp_diff_new`).
+ *
+ * The cache is not thread-safe; serialize calls that share a cache.  The
+ * diffs it returns can be read and freed from any thread.
+ *
+ * Returns the same values as `dmp_diff_new` (including a cached
+ * `DMP_TOO_DIFFERENT` status).
+ */
+DMP_EXTERN int dmp_cache_diff(
+	dmp_diff **diff,
+	dmp_cache *cache,
+	const dmp_options *options,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2);
 
-extern void dmp_diff_print_raw(FILE *fp, const dmp_diff *diff);
+/**
+ * Public: Serialize a diff as a compact binary delta.
+ *
+ * The delta records EQUAL and DELETE hunks as ranges of `text1` to copy
+ * or skip, and stores only the INSERT data literally, with all lengths
+ * as varints.  Together with `text1` it is enough to rebuild `text2`
+ * using `dmp_binary_apply`.  The delta does not identify `text1` beyond
+ * its length, so store it alongside the version it was made from.
+ *
+ * delta - Pointer to the delta buffer that will be allocated.  You must
+ *         call `free()` on this pointer when done.
+ * delta_len - Output of the number of bytes in the delta.
+ * diff - The `dmp_diff` object.
+ *
+ * Returns 0 on success, -1 on allocation failure or if the delta would
+ * not fit in 4GB.
+ */
+DMP_EXTERN int dmp_diff_to_binary(
+	char **delta, uint32_t *delta_len, const dmp_diff *diff);
 
-extern int dmp_patch_new(
+/**
+ * Public: Rebuild `text2` from `text1` and a binary delta.
+ *
+ * text2 - Pointer to the text that will be allocated.  It is followed by
+ *         a NUL byte (not counted in `len2`).  You must call `free()` on
+ *         this pointer when done.
+ * len2 - Output of the number of bytes in `text2`.
+ * text1 - The FROM text that the delta was made against.
+ * len1 - The number of bytes of data in `text1`.
+ * delta - Delta created by `dmp_diff_to_binary`.
+ * delta_len - The number of bytes of data in `delta`.
+ *
+ * Returns 0 on success, -1 on allocation failure or if the delta is
+ * malformed or does not match the length of `text1`.
+ */
+DMP_EXTERN int dmp_binary_apply(
+	char **text2,
+	uint32_t *len2,
+	const char *text1,
+	uint32_t len1,
+	const char *delta,
+	uint32_t delta_len);
+
+/**
+ * Public: Encode a diff in the tab-separated delta format.
+ *
+ * This produces the same text as `diff_toDelta` in the JavaScript and
+ * other ports, e.g. "=3\t-2\t+ing": EQUAL and DELETE hunks are written
+ * as lengths in UTF-16 code units and INSERT data is URI-encoded (with
+ * spaces left as-is).  The texts should be UTF-8; where the byte-level
+ * diff splits a multibyte character, the split bytes are written as part
+ * of the neighbouring delete and insert.
+ *
+ * delta - Pointer to the NUL-terminated delta that will be allocated.
+ *         You must call `free()` on this pointer when done.
+ * delta_len - Output of the length of the delta.
+ * diff - The `dmp_diff` object.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+DMP_EXTERN int dmp_diff_to_delta(
+	char **delta, uint32_t *delta_len, const dmp_diff *diff);
+
+/**
+ * Public: Decode a diff from the tab-separated delta format.
+ *
+ * This is the inverse of `dmp_diff_to_delta` (`diff_fromDelta` in the
+ * other ports).  EQUAL and DELETE hunks of the new diff point into
+ * `text1`, which must outlive the diff, while the decoded INSERT data is
+ * owned by the diff.
+ *
+ * diff - Pointer to a `dmp_diff` pointer that will be allocated.  You must
+ *        call `dmp_diff_free()` on this pointer when done.
+ * text1 - The FROM text that the delta was made against.
+ * len1 - The number of bytes of data in `text1`.
+ * delta - The delta text.
+ * delta_len - The number of bytes of data in `delta`.
+ *
+ * Returns 0 on success, -1 on allocation failure or if the delta is
+ * malformed or does not cover exactly `text1`.
+ */
+DMP_EXTERN int dmp_diff_from_delta(
+	dmp_diff **diff,
+	const char *text1,
+	uint32_t    len1,
+	const char *delta,
+	uint32_t    delta_len);
+
+/**
+ * Public: Callback function for iterating over a three-way merge.
+ *
+ * Each region covers `base_len` bytes of the base and the matching text
+ * of both sides, so concatenating the `base` data of all regions gives
+ * back the base (and likewise for `a` and `b`).
+ *
+ * Returns 0 to keep iterating or non-zero to stop iteration.
+ */
+typedef int (*dmp_merge_callback)(
+	void *cb_ref, dmp_merge_t kind,
+	const char *base, uint32_t base_len,
+	const char *a, uint32_t a_len,
+	const char *b, uint32_t b_len);
+
+/**
+ * Public: Merge two texts that were both edited from a common base.
+ *
+ * This diffs `base` against `a` and against `b` (trimming the text that
+ * all three share only once) and walks the changes of both diffs in base
+ * order.  Changes that touch different parts of the base are combined,
+ * while overlapping changes become a conflict region unless both sides
+ * turned that part of the base into the same text.  The merge points
+ * into all three texts, which must outlive it.
+ *
+ * merge - Pointer to a `dmp_merge` pointer that will be allocated.  You
+ *         must call `dmp_merge_free()` on this pointer when done.
+ * options - Diff options to use for both diffs, NULL for defaults.
+ *
+ * Returns 0 if the merge was generated (check `dmp_merge_conflicts` to
+ * see if it is clean), -1 on allocation failure.
+ */
+DMP_EXTERN int dmp_merge3(
+	dmp_merge **merge,
+	const dmp_options *options,
+	const char *base,
+	uint32_t    base_len,
+	const char *a,
+	uint32_t    a_len,
+	const char *b,
+	uint32_t    b_len);
+
+/**
+ * Public: Free a three-way merge.
+ */
+DMP_EXTERN void dmp_merge_free(dmp_merge *merge);
+
+/**
+ * Public: Count the conflict regions of a three-way merge.
+ */
+DMP_EXTERN uint32_t dmp_merge_conflicts(const dmp_merge *merge);
+
+/**
+ * Public: Iterate over the regions of a three-way merge in order.
+ *
+ * Returns 0 after visiting every region, or the non-zero value returned
+ * by the callback to stop the iteration.
+ */
+DMP_EXTERN int dmp_merge_foreach(
+	const dmp_merge *merge,
+	dmp_merge_callback cb,
+	void *cb_ref);
+
+/**
+ * Public: Build the merged text.
+ *
+ * Each region contributes the text of the side that changed it.  For
+ * conflict regions the text from `a` is used; use `dmp_merge_foreach` to
+ * resolve conflicts any other way.
+ *
+ * text - Pointer to the NUL-terminated text that will be allocated.  You
+ *        must call `free()` on this pointer when done.
+ * len - Output of the length of the merged text.
+ * merge - The `dmp_merge` object.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+DMP_EXTERN int dmp_merge_text(
+	char **text, uint32_t *len, const dmp_merge *merge);
+
+DMP_EXTERN void dmp_diff_print_raw(FILE *fp, const dmp_diff *diff);
+
+DMP_EXTERN int dmp_patch_new(
 	dmp_patch     **patch,
 	const char      *text1,
 	uint32_t         len1,
 	const dmp_diff *diff);
 
-extern void dmp_patch_free(dmp_patch *patch);
+DMP_EXTERN void dmp_patch_free(dmp_patch *patch);
 
 /*
  * Utility functions
  */
 
-extern uint32_t dmp_common_prefix(
+DMP_EXTERN uint32_t dmp_common_prefix(
 	const char *t1, uint32_t l1, const char *t2, uint32_t l2);
 
-extern uint32_t dmp_common_suffix(
+DMP_EXTERN uint32_t dmp_common_suffix(
 	const char *t1, uint32_t l1, const char *t2, uint32_t l2);
 
-extern int dmp_has_prefix(
+DMP_EXTERN int dmp_has_prefix(
 	const char *text, uint32_t tlen, const char *pfx, uint32_t plen);
 
-extern int dmp_has_suffix(
+DMP_EXTERN int dmp_has_suffix(
 	const char *text, uint32_t tlen, const char *sfx, uint32_t slen);
 
-extern int dmp_strcmp(
+DMP_EXTERN int dmp_strcmp(
 	const char *t1, uint32_t l1, const char *t2, uint32_t l2);
 
-extern const char *dmp_strstr(
+DMP_EXTERN const char *dmp_strstr(
 	const char *haystack, uint32_t lh, const char *needle, uint32_t ln);
 
-extern void dmp_build_texts_from_diff(
+/* Name of the instruction set used by the byte comparison functions, which
+ * is the best one the CPU has unless the DMP_CPU environment variable names
+ * a lower one ("generic", "sse2", "avx2" or "avx512")
+ */
+DMP_EXTERN const char *dmp_cpu_name(void);
+
+/* XXH64 of the data, so values match other XXH64 implementations */
+DMP_EXTERN uint64_t dmp_hash64(
+	const void *data, uint32_t len, uint64_t seed);
+
+DMP_EXTERN void dmp_build_texts_from_diff(
 	char **t1, uint32_t *l1, char **t2, uint32_t *l2, const dmp_diff *diff);
 
 #endif
@@ -14,7 +14,12 @@
 
 #include "dmp.h"
 #include "dmp_pool.h"
+#include "dmp_diff.h"
+#include "dmp_profile.h"
+#include "dmp_atomic.h"
+#include "dmp_cpu.h"
 #include <sys/types.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <ctype.h>
@@ -24,49 +29,99 @@
 
 #define START_POOL	8
 
-struct dmp_diff {
-	dmp_pool pool;
-	dmp_range list;
-	double deadline;
-	/* original parameters */
-	const char *t1, *t2;
-	uint32_t l1, l2;
-	/* used by bisect */
-	int *v1, *v2;
-	uint32_t v_alloc;
-};
-
-static double dmp_time(void);
-
-static int diff_main(
-	dmp_range *, dmp_diff *, const dmp_options *,
-	const char *, uint32_t, const char *, uint32_t);
+/* most nodes a single dmp_diff_main call or cleanup pass adds to the pool:
+ * sentinel, prefix, suffix and up to three for the middle
+ */
+#define MAIN_NODES	6
+#define CLEANUP_NODES	2
 
-static int diff_bisect(
-	dmp_range *, dmp_diff *, const dmp_options *,
-	const char *, uint32_t, const char *, uint32_t);
+/* diffs typically end up with about a hunk for every few dozen bytes of
+ * the untrimmed middle of the texts, so start the pool at that estimate
+ * (but cap it, as the estimate is far too high for texts that barely
+ * differ and the pool still grows geometrically past it)
+ */
+#define ESTIMATE_BYTES_PER_NODE	64
+#define ESTIMATE_MAX_NODES	(1 << 16)
 
-static int diff_cleanup_merge(dmp_diff *diff, dmp_range *list);
+static int engine_push(
+	dmp_diff *, const char *, uint32_t, const char *, uint32_t, int);
+static int engine_run(dmp_diff *, uint64_t);
 
-static dmp_diff *alloc_diff(const dmp_options *opts)
+dmp_diff *dmp_diff_alloc(const dmp_options *opts)
 {
 	dmp_diff *diff = malloc(sizeof(dmp_diff));
 	if (!diff)
 		return NULL;
 
 	memset(diff, 0, sizeof(*diff));
+	DMP_PROFILE_INIT(diff, opts);
 
 	diff->deadline = (opts && opts->timeout > 0) ?
 		dmp_time() + opts->timeout : -1.0;
-
-	if (dmp_pool_alloc(&diff->pool, START_POOL) < 0) {
-		free(diff);
-		diff = NULL;
-	}
+	diff->max_edits = opts ? opts->max_edits : 0;
 
 	return diff;
 }
 
+static int texts_identical(
+	const dmp_options *opts,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	if (len1 != len2)
+		return 0;
+	if (text1 == text2 || !len1)
+		return 1;
+
+	/* the caller's content hashes can rule a match out without reading
+	 * the texts, but equal hashes may still be a collision
+	 */
+	if (opts && opts->text1_hash && opts->text2_hash &&
+		opts->text1_hash != opts->text2_hash)
+		return 0;
+
+	return !memcmp(text1, text2, len1);
+}
+
+static uint32_t estimate_nodes(uint32_t len1, uint32_t len2)
+{
+	uint64_t est = ((uint64_t)len1 + len2) / ESTIMATE_BYTES_PER_NODE;
+	return (uint32_t)(est < ESTIMATE_MAX_NODES ? est : ESTIMATE_MAX_NODES) +
+		MAIN_NODES;
+}
+
+/* a caller's hint (up to the most hunks the texts can give) gets some
+ * headroom, as records freed during the diff are not all reused
+ */
+static uint32_t initial_nodes(
+	const dmp_options *opts, uint32_t len1, uint32_t len2)
+{
+	uint64_t most = (uint64_t)len1 + len2 + 1, hint;
+
+	if (!opts || !opts->expected_hunks)
+		return START_POOL;
+
+	hint = (opts->expected_hunks < most) ? opts->expected_hunks : most;
+	hint += hint / 8 + 2 * MAIN_NODES;
+	return (hint < INT32_MAX) ? (uint32_t)hint : INT32_MAX;
+}
+
+/* unchanged texts are a single EQUAL kept inside the diff itself */
+static void diff_same(dmp_diff *diff, const char *text, uint32_t len)
+{
+	dmp_pool_init_borrowed(&diff->pool, diff->same, 2);
+	diff->list.start = diff->list.end = -1;
+
+	if (len > 0) {
+		dmp_range_init(
+			&diff->pool, &diff->list, DMP_DIFF_EQUAL, text, 0, len);
+		diff->stats.equals = 1;
+		diff->stats.equal_bytes = len;
+	}
+}
+
 int dmp_diff_new(
 	dmp_diff **diff_ptr,
 	const dmp_options *options,
@@ -76,10 +131,11 @@ int dmp_diff_new(
 	uint32_t    len2)
 {
 	dmp_diff *diff;
+	int error;
 
 	assert(diff_ptr);
 
-	*diff_ptr = diff = alloc_diff(options);
+	*diff_ptr = diff = dmp_diff_alloc(options);
 	if (!diff)
 		return -1;
 
@@ -88,7 +144,37 @@ int dmp_diff_new(
 	diff->t2 = text2;
 	diff->l2 = len2;
 
-	return diff_main(&diff->list, diff, options, text1, len1, text2, len2);
+	if (texts_identical(options, text1, len1, text2, len2)) {
+		diff_same(diff, text1, len1);
+		return 0;
+	}
+
+	if (dmp_pool_alloc(&diff->pool, initial_nodes(options, len1, len2)) < 0) {
+		free(diff);
+		*diff_ptr = NULL;
+		return -1;
+	}
+
+	if (options && options->move_min_len > 0)
+		error = dmp_diff_moves(
+			&diff->list, diff, options, text1, len1, text2, len2);
+	else if (options && options->algorithm == DMP_ALGORITHM_RECORDS)
+		error = dmp_diff_records(
+			&diff->list, diff, options, text1, len1, text2, len2);
+	else if (options && options->algorithm != DMP_ALGORITHM_MYERS)
+		error = dmp_diff_lines(
+			&diff->list, diff, options, text1, len1, text2, len2);
+	else
+		error = dmp_diff_main(
+			&diff->list, diff, options, text1, len1, text2, len2);
+
+	if (error < 0) {
+		dmp_diff_free(diff);
+		*diff_ptr = NULL;
+	} else if (diff->too_different)
+		error = DMP_TOO_DIFFERENT;
+
+	return error;
 }
 
 int dmp_diff_from_strs(
@@ -106,7 +192,71 @@ int dmp_diff_from_strs(
 		diff, options, text1, strlen(text1), text2, strlen(text2));
 }
 
-static int diff_main(
+/* tally edits emitted by the engine against the `max_edits` budget */
+static void count_edits(dmp_diff *diff, uint32_t edits)
+{
+	diff->edits += edits;
+	if (diff->max_edits > 0 && diff->edits > diff->max_edits)
+		diff->too_different = 1;
+}
+
+#define MIDDLE_SAMPLES	6
+#define MIDDLE_WINDOW	64
+
+/* look for the short text inside the long one, once both ends are trimmed
+ *
+ * Trimming leaves texts whose first bytes and last bytes differ, so the
+ * short text can only start at offsets 1 through l_long - l_short - 1.
+ * When that leaves just a few offsets (the texts are close in length,
+ * which is common for bisect splits), a few sampled bytes of the short
+ * text are compared at each offset and the search is only run if some
+ * offset matches all of them.
+ */
+static const char *find_middle(
+	dmp_diff *diff,
+	const char *t_long, uint32_t l_long,
+	const char *t_short, uint32_t l_short)
+{
+	uint32_t gap = l_long - l_short, i, j;
+	const char *found;
+
+	if (gap < 2) {
+		diff->stats.contain_skips++;
+		return NULL;
+	}
+
+	if (gap - 1 <= MIDDLE_WINDOW && l_short > MIDDLE_SAMPLES) {
+		uint64_t candidates = (gap - 1 == 64) ?
+			~(uint64_t)0 : ((uint64_t)1 << (gap - 1)) - 1;
+
+		for (i = 0; i < MIDDLE_SAMPLES && candidates != 0; ++i) {
+			uint32_t at = (uint32_t)(
+				(uint64_t)(l_short - 1) * i / (MIDDLE_SAMPLES - 1));
+			const char *probe = t_long + 1 + at;
+			uint64_t hits = 0;
+
+			for (j = 0; j < gap - 1; ++j)
+				hits |= (uint64_t)(probe[j] == t_short[at]) << j;
+			candidates &= hits;
+		}
+
+		if (!candidates) {
+			diff->stats.contain_skips++;
+			return NULL;
+		}
+	}
+
+	diff->stats.contain_checks++;
+	diff->stats.contain_bytes += l_long - 2;
+
+	found = dmp_strstr(t_long + 1, l_long - 2, t_short, l_short);
+	if (found)
+		diff->stats.contain_hits++;
+
+	return found;
+}
+
+int dmp_diff_main(
 	dmp_range  *out,
 	dmp_diff  *diff,
 	const dmp_options *opts,
@@ -115,30 +265,51 @@ static int diff_main(
 	const char *text2,
 	uint32_t    len2)
 {
-	const char *t_short, *t_long, *found;
-	uint32_t l_short, l_long, common;
+	uint32_t common;
 	dmp_pool *pool = &diff->pool;
 
+	out->start = out->end = -1;
+
+	/* every node this call adds itself, so none of the inserts can fail */
+	if (dmp_pool_reserve(pool, MAIN_NODES) < 0)
+		return -1;
+
+	diff->depth++;
+
 	/* check for one-sided diffs */
 
 	if (!text1 || !len1) {
 		dmp_range_init(
 			pool, out, DMP_DIFF_INSERT, text2, 0, len2);
-		return pool->error;
+		count_edits(diff, len2);
+		goto finish;
 	}
 
 	if (!text2 || !len2) {
 		dmp_range_init(
 			pool, out, DMP_DIFF_DELETE, text1, 0, len1);
-		return pool->error;
+		count_edits(diff, len1);
+		goto finish;
 	}
 
 	/* allocate sentinel */
 	if (dmp_range_init(pool, out, DMP_DIFF_EQUAL, text1, len1, 0) < 0)
 		goto finish;
 
+	/* once the edit budget is blown, the details no longer matter */
+	if (diff->too_different) {
+		dmp_range_insert(
+			pool, out, -1, DMP_DIFF_DELETE, text1, 0, len1);
+		dmp_range_insert(
+			pool, out, -1, DMP_DIFF_INSERT, text2, 0, len2);
+		count_edits(diff, len1 + len2);
+		goto finish;
+	}
+
 	/* trim common prefix */
 
+	DMP_PROFILE_BEGIN(diff, DMP_PHASE_TRIM, len1, len2);
+
 	common = dmp_common_prefix(text1, len1, text2, len2);
 	if (common > 0) {
 		dmp_range_insert(
@@ -162,144 +333,194 @@ static int diff_main(
 		len2 -= common;
 	}
 
+	DMP_PROFILE_END(diff, DMP_PHASE_TRIM, len1, len2);
+
+	/* the top level knows how much of the texts is left to diff now */
+	if (diff->depth == 1 && !(opts && opts->expected_hunks))
+		dmp_pool_reserve(pool, estimate_nodes(len1, len2));
+
 	/* after trimming, check for degenerate cases */
 
 	if (!len1) {
 		if (len2)
 			dmp_range_insert(
 				pool, out, -1, DMP_DIFF_INSERT, text2, 0, len2);
+		count_edits(diff, len2);
 		goto finish;
 	} else if (!len2) {
 		dmp_range_insert(
 			pool, out, -1, DMP_DIFF_DELETE, text1, 0, len1);
+		count_edits(diff, len1);
 		goto finish;
 	}
 
-	/* check for "common middle" - i.e. one text inside the other */
+	/* the engine takes the middle from here, working through it on the
+	 * stack in the diff rather than by recursing
+	 */
+	diff->engine.out = out;
+	if (engine_push(diff, text1, len1, text2, len2, 0) == 0)
+		engine_run(diff, 0);
 
-	if (len1 <= len2) {
-		t_short = text1;
-		l_short = len1;
-		t_long  = text2;
-		l_long  = len2;
-	} else {
-		t_short = text2;
-		l_short = len2;
-		t_long  = text1;
-		l_long  = len1;
-	}
+	if (!pool->error)
+		dmp_diff_cleanup_merge(diff, out);
 
-	if ((found = dmp_strstr(t_long, l_long, t_short, l_short)) != NULL) {
-		int op = (t_short == text1) ? DMP_DIFF_INSERT : DMP_DIFF_DELETE;
-		uint32_t found_at = (found - t_long);
+finish:
+	if (diff->depth == 1)
+		dmp_diff_tally(diff, out);
+	else
+		dmp_range_normalize(pool, out);
+	diff->depth--;
 
-		dmp_range_insert(
-			pool, out, -1, op, t_long, 0, found_at);
-		dmp_range_insert(
-			pool, out, -1, DMP_DIFF_EQUAL, t_short, 0, l_short);
-		found_at += l_short;
-		dmp_range_insert(
-			pool, out, -1, op, t_long, found_at, l_long - found_at);
+	return pool->error;
+}
 
-		goto finish;
-	}
+/* the diff engine
+ *
+ * dmp_diff_main trims the texts and leaves the rest to this: the Myers
+ * diff, with the recursion of the bisect replaced by a stack of the parts
+ * still to be diffed in diff->engine, and the loop of the bisect able to
+ * stop between any two `d` iterations (which is what lets a dmp_diff_job
+ * spread the work over steps).  The leftmost part is always on top, so
+ * hunks are appended to the output in order and nothing needs splicing,
+ * and the stack only grows by one entry per level of the split.
+ */
 
-	if (l_short == 1) {
-		/* this speed up applies after testing for short inside long above */
-		dmp_range_insert(
-			pool, out, -1, DMP_DIFF_DELETE, text1, 0, len1);
-		dmp_range_insert(
-			pool, out, -1, DMP_DIFF_INSERT, text2, 0, len2);
-		goto finish;
+#define ENGINE_STACK	16
+
+static int engine_push(dmp_diff *diff,
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2, int equal)
+{
+	dmp_engine *eng = &diff->engine;
+	dmp_work *item;
+
+	if (eng->depth == eng->alloc) {
+		uint32_t alloc = eng->alloc ? 2 * eng->alloc : ENGINE_STACK;
+		dmp_work *grown = realloc(eng->stack, alloc * sizeof(*grown));
+		if (!grown)
+			return (diff->pool.error = -1);
+		eng->stack = grown;
+		eng->alloc = alloc;
 	}
 
-	/* TODO: "half match" and "line mode" optimizations */
+	item = &eng->stack[eng->depth++];
+	item->t1 = t1;
+	item->l1 = l1;
+	item->t2 = t2;
+	item->l2 = l2;
+	item->equal = equal;
 
-	/* full Myers bisect diff */
+	if (eng->depth > diff->stats.max_depth)
+		diff->stats.max_depth = eng->depth;
 
-	if (!pool->error)
-		diff_bisect(out, diff, opts, text1, len1, text2, len2);
+	return 0;
+}
 
-	if (!pool->error)
-		diff_cleanup_merge(diff, out);
+static void engine_emit(
+	dmp_diff *diff, int op, const char *text, uint32_t offset, uint32_t len)
+{
+	dmp_pool *pool = &diff->pool;
 
-finish:
-	dmp_range_normalize(pool, out);
+	if (len > 0 && dmp_pool_reserve(pool, 1) == 0)
+		dmp_range_insert(pool, diff->engine.out, -1, op, text, offset, len);
+}
 
-	return pool->error;
+static void engine_replace(
+	dmp_diff *diff, const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	engine_emit(diff, DMP_DIFF_DELETE, t1, 0, l1);
+	engine_emit(diff, DMP_DIFF_INSERT, t2, 0, l2);
+	count_edits(diff, l1 + l2);
 }
 
-static int diff_bisect_split(
-	dmp_range *out,
-	dmp_diff *diff,
-	const dmp_options *opts,
-	const char *t1,
-	int t1pivot,
-	uint32_t t1len,
-	const char *t2,
-	int t2pivot,
-	uint32_t t2len)
+static int engine_bisect_begin(
+	dmp_diff *diff, const char *t1, uint32_t l1, const char *t2, uint32_t l2)
 {
-	dmp_range l1, l2;
-	int rv = diff_main(&l1, diff, opts, t1, t1pivot, t2, t2pivot);
+	dmp_engine *eng = &diff->engine;
+
+	eng->cur.t1 = t1;
+	eng->cur.l1 = l1;
+	eng->cur.t2 = t2;
+	eng->cur.l2 = l2;
+	eng->v_offset = eng->max_d = (l1 + l2 + 1) / 2;
+	eng->v_length = 2 * eng->max_d;
+	eng->delta = (int)l1 - (int)l2;
+	eng->front = (eng->delta % 2 != 0);
+	eng->k1start = eng->k1end = eng->k2start = eng->k2end = 0;
+	eng->d = 0;
+
+	diff->stats.bisect_calls++;
+
+	if ((int)diff->v_alloc < eng->v_length) {
+		int *v = malloc(2 * (size_t)eng->v_length * sizeof(int));
+		if (!v)
+			return (diff->pool.error = -1);
+
+		free(diff->v1);
+		diff->v1 = v;
+		diff->v_alloc = eng->v_length;
+	}
+	memset(diff->v1, 0xff, 2 * (size_t)eng->v_length * sizeof(int));
+	diff->v1[eng->v_offset + 1] = 0;
+	diff->v1[eng->v_length + eng->v_offset + 1] = 0;
 
-	if (rv == 0)
-		rv = diff_main(&l2, diff, opts,
-			t1 + t1pivot, t1len - t1pivot, t2 + t2pivot, t2len - t2pivot);
+	eng->bisecting = 1;
+	return 0;
+}
 
-	if (rv == 0) {
-		dmp_range_splice(&diff->pool, out, -1, &l1);
-		dmp_range_splice(&diff->pool, out, -1, &l2);
-	}
+/* split the bisected texts at (x, y), the left part on top */
+static int engine_bisect_split(dmp_diff *diff, uint32_t x, uint32_t y)
+{
+	dmp_engine *eng = &diff->engine;
+	const dmp_work *cur = &eng->cur;
+
+	eng->bisecting = 0;
+	DMP_PROFILE_BISECT_STEPS(diff, eng->d + 1);
 
-	return rv;
+	if (engine_push(diff,
+			cur->t1 + x, cur->l1 - x, cur->t2 + y, cur->l2 - y, 0) < 0)
+		return -1;
+	return engine_push(diff, cur->t1, x, cur->t2, y, 0);
 }
 
 /* bisect diff - find "middle snake" of a diff
  * See Myers 1986: An O(ND) Difference Algorithm and Its Variations.
+ *
+ * This runs the bisect on for `d` iterations until it splits, gives up,
+ * or `spent` reaches `budget`; returns 1 if it is not finished.
  */
-static int diff_bisect(
-	dmp_range *out,
-	dmp_diff *diff,
-	const dmp_options *opts,
-	const char *t1,
-	uint32_t t1len,
-	const char *t2,
-	uint32_t t2len)
-{
-	int max_d, v_offset, v_length, d;
-	int delta, front, k1start, k1end, k2start, k2end, *v1, *v2;
-
-	v_offset = max_d = (t1len + t2len + 1) / 2;
-	v_length = 2 * max_d;
-	delta = (int)t1len - (int)t2len;
-	front = (delta % 2 != 0);
-	k1start = k1end = k2start = k2end = 0;
-
-	if ((int)diff->v_alloc < v_length) {
-		size_t asize = v_length * sizeof(int);
-		diff->v1 = diff->v1 ? realloc(diff->v1, asize) : malloc(asize);
-		diff->v2 = diff->v2 ? realloc(diff->v2, asize) : malloc(asize);
-		diff->v_alloc = v_length;
-
-		if (!diff->v1 || !diff->v2)
-			return -1;
-	}
-	v1 = diff->v1;
-	v2 = diff->v2;
-	/* initialize arrays to -1 (except v_offset + 1 element to 0) */
-	memset(v1, 0xff, v_length * sizeof(int));
-	memset(v2, 0xff, v_length * sizeof(int));
-	v1[v_offset + 1] = 0;
-	v2[v_offset + 1] = 0;
+static int engine_bisect(dmp_diff *diff, uint64_t budget, uint64_t *spent)
+{
+	dmp_engine *eng = &diff->engine;
+	const char *t1 = eng->cur.t1, *t2 = eng->cur.t2;
+	uint32_t t1len = eng->cur.l1, t2len = eng->cur.l2;
+	int v_offset = eng->v_offset, v_length = eng->v_length;
+	int delta = eng->delta, *v1 = diff->v1, *v2 = diff->v1 + v_length;
+	const dmp_kernels *kern = dmp_cpu_kernels();
+	int d, first = eng->d;
+
+	DMP_PROFILE_BEGIN(diff, DMP_PHASE_BISECT, t1len, t2len);
 
-	for (d = 0; d < max_d; d++) {
+	for (d = first; d < eng->max_d; eng->d = ++d) {
 		int k1, k2;
 
-		/* TODO: bail out if deadline is reached */
+		/* every call gets at least one iteration done */
+		if (budget && *spent >= budget && d > first) {
+			DMP_PROFILE_END(diff, DMP_PHASE_BISECT, t1len, t2len);
+			return 1;
+		}
+		*spent += 2 * (uint64_t)d + 2;
+
+		if (diff->deadline > 0 && dmp_time() > diff->deadline) {
+			diff->stats.timed_out = 1;
+			break;
+		}
+
+		if (diff->max_edits > 0 && d > 0 &&
+			diff->edits + 2 * d - 1 > diff->max_edits)
+			break;
 
 		/* advance the front contour */
-		for (k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+		for (k1 = -d + eng->k1start; k1 <= d - eng->k1end; k1 += 2) {
 			int k1off = v_offset + k1;
 			uint32_t x1, y1;
 
@@ -309,28 +530,32 @@ static int diff_bisect(
 				x1 = v1[k1off - 1] + 1;
 			y1 = x1 - k1;
 
-			while (x1 < t1len && y1 < t2len && t1[x1] == t2[y1])
-				x1++, y1++;
+			if (x1 < t1len && y1 < t2len && t1[x1] == t2[y1]) {
+				uint32_t snake = kern->common_prefix(
+					t1 + x1, t1len - x1, t2 + y1, t2len - y1);
+				x1 += snake;
+				y1 += snake;
+			}
 
 			v1[k1off] = x1;
-			if (x1 > t1len) /* ran off the right of the graph */
-				k1end += 2;
-			else if (y1 > t2len) /* ran off bottom of the graph */
-				k1start += 2;
-			else if (front) {
+			if (x1 > t1len)
+				eng->k1end += 2;
+			else if (y1 > t2len)
+				eng->k1start += 2;
+			else if (eng->front) {
 				int k2off = v_offset + delta - k1;
 				if (k2off >= 0 && k2off < v_length && v2[k2off] != -1) {
-					/* mirror x2 onto top-left coordinate system */
 					uint32_t x2 = (int)t1len - v2[k2off];
-					if (x1 >= x2)
-						return diff_bisect_split(
-							out, diff, opts, t1, x1, t1len, t2, y1, t2len);
+					if (x1 >= x2) {
+						DMP_PROFILE_END(diff, DMP_PHASE_BISECT, t1len, t2len);
+						return engine_bisect_split(diff, x1, y1);
+					}
 				}
 			}
 		}
 
 		/* advance the reverse contour */
-		for (k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+		for (k2 = -d + eng->k2start; k2 <= d - eng->k2end; k2 += 2) {
 			int k2off = v_offset + k2;
 			uint32_t x2, y2;
 
@@ -340,136 +565,464 @@ static int diff_bisect(
 				x2 = v2[k2off - 1] + 1;
 			y2 = x2 - k2;
 
-			while (x2 < t1len && y2 < t2len &&
-				   t1[t1len - x2 - 1] == t2[t2len - y2 - 1])
-				x2++, y2++;
+			if (x2 < t1len && y2 < t2len &&
+				t1[t1len - x2 - 1] == t2[t2len - y2 - 1]) {
+				uint32_t snake = kern->common_suffix(
+					t1, t1len - x2, t2, t2len - y2);
+				x2 += snake;
+				y2 += snake;
+			}
 
 			v2[k2off] = x2;
-			if (x2 > t1len) /* ran off the left of the graph */
-				k2end += 2;
-			else if (y2 > t2len) /* ran off top of the graph */
-				k2start += 2;
-			else if (!front) {
+			if (x2 > t1len)
+				eng->k2end += 2;
+			else if (y2 > t2len)
+				eng->k2start += 2;
+			else if (!eng->front) {
 				int k1off = v_offset + delta - k2;
 				if (k1off >= 0 && k1off < v_length && v1[k1off] != -1) {
-					/* mirror x2 onto top-left coordinate system */
 					uint32_t x1 = v1[k1off], y1 = v_offset + x1 - k1off;
 					x2 = t1len - x2;
-					if (x1 >= x2)
-						return diff_bisect_split(
-							out, diff, opts, t1, x1, t1len, t2, y1, t2len);
+					if (x1 >= x2) {
+						DMP_PROFILE_END(diff, DMP_PHASE_BISECT, t1len, t2len);
+						return engine_bisect_split(diff, x1, y1);
+					}
 				}
 			}
 		}
 	}
 
-	/* diff took too long or # diffs == # chars (i.e. no commonality) */
-	dmp_range_insert(&diff->pool, out, -1, DMP_DIFF_DELETE, t1, 0, t1len);
-	dmp_range_insert(&diff->pool, out, -1, DMP_DIFF_INSERT, t2, 0, t2len);
+	DMP_PROFILE_BISECT_STEPS(diff, d);
+	DMP_PROFILE_END(diff, DMP_PHASE_BISECT, t1len, t2len);
 
+	/* out of time or edit budget, or nothing in common */
+	eng->bisecting = 0;
+	engine_replace(diff, t1, t1len, t2, t2len);
 	return diff->pool.error;
 }
 
-static int diff_cleanup_merge(dmp_diff *diff, dmp_range *list)
+/* trim one part of the texts and diff what is left, unless it takes a
+ * bisect, which is only set up here
+ */
+static int engine_diff(dmp_diff *diff, const dmp_work *item)
 {
-	dmp_pool *pool = &diff->pool;
-	int i, before, common, changes;
-	int count_delete, count_insert, len_delete, len_insert;
-	dmp_node *ins = NULL, *del = NULL, *last = NULL, *node, *next;
+	const char *text1 = item->t1, *text2 = item->t2;
+	const char *t_short, *t_long, *found;
+	uint32_t len1 = item->l1, len2 = item->l2, l_short, l_long, common;
 
-	count_insert = count_delete = 0;
-	len_insert = len_delete = 0;
-	before = -1;
+	if (!len1 || !len2 || diff->too_different) {
+		engine_replace(diff, text1, len1, text2, len2);
+		return diff->pool.error;
+	}
 
-	dmp_range_normalize(pool, list);
+	DMP_PROFILE_BEGIN(diff, DMP_PHASE_TRIM, len1, len2);
 
-	/* ensure EQUAL at end to guarantee termination of cleanup passes */
-	node = dmp_node_at(pool, list->end);
-	if (node->op != DMP_DIFF_EQUAL)
-		dmp_range_insert(
-			pool, list, -1, DMP_DIFF_EQUAL, node->text, node->len, 0);
+	common = dmp_common_prefix(text1, len1, text2, len2);
+	engine_emit(diff, DMP_DIFF_EQUAL, text1, 0, common);
+	text1 += common;
+	len1  -= common;
+	text2 += common;
+	len2  -= common;
 
-	/* first pass - look for groups of consecutive inserts and deletes
-	 * that can be merged or that have unnoticed common prefixes/suffixes
-	 * that can be extracted
-	 */
+	/* the suffix waits under whatever the middle turns into */
+	common = dmp_common_suffix(text1, len1, text2, len2);
+	if (common > 0) {
+		if (engine_push(diff, text1 + len1 - common, common, NULL, 0, 1) < 0)
+			return -1;
+		len1 -= common;
+		len2 -= common;
+	}
 
-	for (i = list->start; i != -1; i = node->next) {
-		node = dmp_node_at(pool, i);
+	DMP_PROFILE_END(diff, DMP_PHASE_TRIM, len1, len2);
 
-		switch (node->op) {
-		case DMP_DIFF_INSERT:
-			count_insert++;
-			len_insert += node->len;
-			if (!ins)
-				ins = node;
-			else {
-				last->next = node->next; /* collapse node */
-				dmp_node_release(pool, i);
-			}
-			break;
-		case DMP_DIFF_DELETE:
-			count_delete++;
-			len_delete += node->len;
-			if (!del)
-				del = node;
-			else {
-				last->next = node->next; /* collapse node */
-				dmp_node_release(pool, i);
-			}
-			break;
-		case DMP_DIFF_EQUAL:
-			if (count_delete + count_insert > 0) {
-				if (count_delete > 0 && count_insert > 0) {
-					/* factor out common prefix */
-					common = dmp_common_prefix(
-						ins->text, len_insert, del->text, len_delete);
+	if (!len1 || !len2) {
+		engine_replace(diff, text1, len1, text2, len2);
+		return diff->pool.error;
+	}
 
-					if (common > 0) {
-						if (before == -1) {
-							dmp_range_insert(pool, list, 0,
-								DMP_DIFF_EQUAL, ins->text, 0, common);
-						} else {
-							last = dmp_node_at(pool, before);
-							last->len += common;
-						}
-						ins->text  += common;
-						len_insert -= common;
-						del->text  += common;
-						len_delete -= common;
-					}
+	/* check for "common middle" - i.e. one text inside the other */
 
-					/* factor out common suffix */
-					common = dmp_common_suffix(
-						ins->text, len_insert, del->text, len_delete);
-					if (common > 0) {
-						node->text -= common;
-						node->len  += common;
-						len_insert -= common;
-						len_delete -= common;
-					}
-				}
-				/* merge deletes */
-				if (del)
-					del->len = len_delete;
-				/* merge inserts */
-				if (ins)
-					ins->len = len_insert;
-			}
-			else if (last && last->op == DMP_DIFF_EQUAL) {
-				/* merge this equality with the previous one */
-				last->len += node->len;
-				last->next = node->next;
-				dmp_node_release(pool, i);
-			}
+	if (len1 <= len2) {
+		t_short = text1;
+		l_short = len1;
+		t_long  = text2;
+		l_long  = len2;
+	} else {
+		t_short = text2;
+		l_short = len2;
+		t_long  = text1;
+		l_long  = len1;
+	}
 
-			count_insert = count_delete = 0;
-			len_insert = len_delete = 0;
-			ins = del = NULL;
-			before = i;
-			break;
-		default:
-			/* skip me */
+	DMP_PROFILE_BEGIN(diff, DMP_PHASE_CONTAIN, len1, len2);
+	found = find_middle(diff, t_long, l_long, t_short, l_short);
+	DMP_PROFILE_END(diff, DMP_PHASE_CONTAIN, len1, len2);
+
+	if (found != NULL) {
+		int op = (t_short == text1) ? DMP_DIFF_INSERT : DMP_DIFF_DELETE;
+		uint32_t found_at = (found - t_long);
+
+		engine_emit(diff, op, t_long, 0, found_at);
+		engine_emit(diff, DMP_DIFF_EQUAL, t_short, 0, l_short);
+		found_at += l_short;
+		engine_emit(diff, op, t_long, found_at, l_long - found_at);
+		count_edits(diff, l_long - l_short);
+		return diff->pool.error;
+	}
+
+	if (l_short == 1) {
+		/* this speed up applies after testing for short inside long above */
+		engine_replace(diff, text1, len1, text2, len2);
+		return diff->pool.error;
+	}
+
+	/* TODO: "half match" and "line mode" optimizations */
+
+	/* texts that fit in a machine word take a few word operations per
+	 * byte, where the Myers bisect would have to go through contours
+	 */
+	if (len1 <= DMP_BITPAR_MAX && len2 <= DMP_BITPAR_MAX) {
+		uint32_t lcs;
+
+		if (dmp_diff_bitpar(
+				diff->engine.out, diff, text1, len1, text2, len2, &lcs) == 0)
+			count_edits(diff, len1 + len2 - 2 * lcs);
+		return diff->pool.error;
+	}
+
+	return engine_bisect_begin(diff, text1, len1, text2, len2);
+}
+
+/* work through the stack until it is empty, or until `budget` diagonals
+ * (if not 0) have been spent; returns 1 if there is still work left
+ */
+static int engine_run(dmp_diff *diff, uint64_t budget)
+{
+	dmp_engine *eng = &diff->engine;
+	uint64_t spent = 0;
+	int error = 0;
+
+	while (!error) {
+		dmp_work item;
+
+		if (eng->bisecting) {
+			error = engine_bisect(diff, budget, &spent);
+			continue;
+		}
+
+		if (!eng->depth)
+			break;
+		if (budget && spent >= budget)
+			return 1;
+
+		/* a part that does not reach the bisect still counts as work */
+		spent++;
+		item = eng->stack[--eng->depth];
+		if (item.equal)
+			engine_emit(diff, DMP_DIFF_EQUAL, item.t1, 0, item.l1);
+		else
+			error = engine_diff(diff, &item);
+		if (!error)
+			error = diff->pool.error;
+	}
+
+	/* after a failure, what is left on the stack is of no use */
+	if (error < 0) {
+		eng->depth = 0;
+		eng->bisecting = 0;
+	}
+
+	return error;
+}
+
+/* resumable diffs (see dmp_diff_job_start)
+ *
+ * A job runs the diff engine with a budget per step, and runs the merge
+ * cleanup once over the whole list at the end.
+ */
+
+struct dmp_diff_job {
+	dmp_diff *diff;
+	dmp_options opts;
+	/* some other algorithm that runs in one go on the first step */
+	int whole;
+	int done;
+};
+
+int dmp_diff_job_start(
+	dmp_diff_job **job_ptr,
+	const dmp_options *options,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	dmp_diff_job *job;
+	dmp_diff *diff;
+
+	assert(job_ptr);
+
+	*job_ptr = NULL;
+
+	if ((job = calloc(1, sizeof(*job))) == NULL)
+		return -1;
+
+	if (options)
+		job->opts = *options;
+
+	if ((diff = dmp_diff_alloc(options)) == NULL) {
+		free(job);
+		return -1;
+	}
+
+	/* the caller paces the work, and cancels it if it takes too long */
+	diff->deadline = -1.0;
+	diff->t1 = text1;
+	diff->l1 = len1;
+	diff->t2 = text2;
+	diff->l2 = len2;
+	job->diff = diff;
+	job->whole = options && (options->move_min_len > 0 ||
+		options->algorithm != DMP_ALGORITHM_MYERS);
+
+	/* as in dmp_diff_new, with nothing left for the steps to do */
+	if (texts_identical(options, text1, len1, text2, len2)) {
+		diff_same(diff, text1, len1);
+		job->done = 1;
+		*job_ptr = job;
+		return 0;
+	}
+
+	if (dmp_pool_alloc(&diff->pool, initial_nodes(options, len1, len2)) < 0) {
+		free(diff);
+		free(job);
+		return -1;
+	}
+
+	if (!job->whole) {
+		if (!(options && options->expected_hunks))
+			dmp_pool_reserve(&diff->pool, estimate_nodes(len1, len2));
+
+		/* allocate sentinel */
+		dmp_range_init(
+			&diff->pool, &diff->list, DMP_DIFF_EQUAL, text1, 0, 0);
+		diff->engine.out = &diff->list;
+		engine_push(diff, text1, len1, text2, len2, 0);
+
+		if (diff->pool.error < 0) {
+			dmp_diff_job_cancel(job);
+			return -1;
+		}
+	}
+
+	*job_ptr = job;
+	return 0;
+}
+
+static int job_run_whole(dmp_diff_job *job)
+{
+	dmp_diff *diff = job->diff;
+	const dmp_options *opts = &job->opts;
+
+	if (opts->move_min_len > 0)
+		return dmp_diff_moves(
+			&diff->list, diff, opts, diff->t1, diff->l1, diff->t2, diff->l2);
+	if (opts->algorithm == DMP_ALGORITHM_RECORDS)
+		return dmp_diff_records(
+			&diff->list, diff, opts, diff->t1, diff->l1, diff->t2, diff->l2);
+	return dmp_diff_lines(
+		&diff->list, diff, opts, diff->t1, diff->l1, diff->t2, diff->l2);
+}
+
+int dmp_diff_job_step(dmp_diff_job *job, uint32_t max_diagonals)
+{
+	dmp_diff *diff = job->diff;
+	int error;
+
+	if (job->done)
+		return diff->pool.error;
+
+	if (job->whole) {
+		job->done = 1;
+		if (job_run_whole(job) < 0)
+			return (diff->pool.error = -1);
+		return 0;
+	}
+
+	if ((error = engine_run(diff, max_diagonals)) > 0)
+		return DMP_JOB_MORE;
+
+	job->done = 1;
+
+	if (!error)
+		error = dmp_diff_cleanup_merge(diff, &diff->list);
+	if (error < 0)
+		return (diff->pool.error = -1);
+
+	dmp_diff_tally(diff, &diff->list);
+	return 0;
+}
+
+int dmp_diff_job_finish(dmp_diff_job *job, dmp_diff **diff_ptr)
+{
+	int error;
+
+	assert(diff_ptr);
+
+	*diff_ptr = NULL;
+
+	while ((error = dmp_diff_job_step(job, 0)) == DMP_JOB_MORE)
+		/* keep going */;
+
+	if (error < 0) {
+		dmp_diff_job_cancel(job);
+		return -1;
+	}
+
+	*diff_ptr = job->diff;
+	error = job->diff->too_different ? DMP_TOO_DIFFERENT : 0;
+
+	free(job);
+	return error;
+}
+
+void dmp_diff_job_cancel(dmp_diff_job *job)
+{
+	if (!job)
+		return;
+
+	dmp_diff_free(job->diff);
+	free(job);
+}
+
+int dmp_diff_cleanup_merge(dmp_diff *diff, dmp_range *list)
+{
+	dmp_pool *pool = &diff->pool;
+	int i, next_i, before, common, changes;
+	int count_delete, count_insert, len_delete, len_insert;
+	dmp_pos ins_at = -1, del_at = -1;
+	dmp_node *ins, *del, *last = NULL, *node, *next;
+
+	count_insert = count_delete = 0;
+	len_insert = len_delete = 0;
+	before = -1;
+
+	if (dmp_pool_reserve(pool, CLEANUP_NODES) < 0)
+		return -1;
+
+	DMP_PROFILE_BEGIN(diff, DMP_PHASE_CLEANUP, 0, 0);
+
+	dmp_range_normalize(pool, list);
+
+	/* nothing but empty hunks, which normalizing has dropped */
+	if (list->start < 0) {
+		list->end = -1;
+		DMP_PROFILE_END(diff, DMP_PHASE_CLEANUP, 0, 0);
+		return 0;
+	}
+
+	/* ensure EQUAL at end to guarantee termination of cleanup passes */
+	node = dmp_node_at(pool, list->end);
+	if (node->op != DMP_DIFF_EQUAL)
+		dmp_range_insert(
+			pool, list, -1, DMP_DIFF_EQUAL, node->text, node->len, 0);
+
+	/* first pass - look for groups of consecutive inserts and deletes
+	 * that can be merged or that have unnoticed common prefixes/suffixes
+	 * that can be extracted
+	 *
+	 * collapsed nodes are released onto the free list (which reuses their
+	 * `next` link), so the walk saves the next position up front and does
+	 * not make a collapsed node the `last` one
+	 */
+
+	for (i = list->start; i != -1; i = next_i) {
+		node = dmp_node_at(pool, i);
+		next_i = node->next;
+
+		switch (node->op) {
+		case DMP_DIFF_INSERT:
+			count_insert++;
+			len_insert += node->len;
+			if (ins_at < 0)
+				ins_at = i;
+			else {
+				last->next = node->next; /* collapse node */
+				dmp_node_release(pool, i);
+				continue;
+			}
+			break;
+		case DMP_DIFF_DELETE:
+			count_delete++;
+			len_delete += node->len;
+			if (del_at < 0)
+				del_at = i;
+			else {
+				last->next = node->next; /* collapse node */
+				dmp_node_release(pool, i);
+				continue;
+			}
+			break;
+		case DMP_DIFF_EQUAL:
+			if (count_delete + count_insert > 0) {
+				if (count_delete > 0 && count_insert > 0) {
+					ins = dmp_node_at(pool, ins_at);
+					del = dmp_node_at(pool, del_at);
+
+					/* factor out common prefix */
+					common = dmp_common_prefix(
+						ins->text, len_insert, del->text, len_delete);
+
+					if (common > 0) {
+						if (before == -1) {
+							/* may grow the pool, so refetch nodes after */
+							dmp_range_insert(pool, list, 0,
+								DMP_DIFF_EQUAL, ins->text, 0, common);
+							node = dmp_node_at(pool, i);
+							ins  = dmp_node_at(pool, ins_at);
+							del  = dmp_node_at(pool, del_at);
+						} else {
+							last = dmp_node_at(pool, before);
+							last->len += common;
+						}
+						ins->text  += common;
+						len_insert -= common;
+						del->text  += common;
+						len_delete -= common;
+					}
+
+					/* factor out common suffix */
+					common = dmp_common_suffix(
+						ins->text, len_insert, del->text, len_delete);
+					if (common > 0) {
+						node->text -= common;
+						node->len  += common;
+						len_insert -= common;
+						len_delete -= common;
+					}
+				}
+				/* merge deletes */
+				if (del_at >= 0)
+					dmp_node_at(pool, del_at)->len = len_delete;
+				/* merge inserts */
+				if (ins_at >= 0)
+					dmp_node_at(pool, ins_at)->len = len_insert;
+			}
+			else if (last && last->op == DMP_DIFF_EQUAL) {
+				/* merge this equality with the previous one */
+				last->len += node->len;
+				last->next = node->next;
+				dmp_node_release(pool, i);
+				continue;
+			}
+
+			count_insert = count_delete = 0;
+			len_insert = len_delete = 0;
+			ins_at = del_at = -1;
+			before = i;
+			break;
+		default:
+			/* skip me */
 			break;
 		}
 
@@ -489,9 +1042,12 @@ static int diff_cleanup_merge(dmp_diff *diff, dmp_range *list)
 			break;
 		next = dmp_node_at(pool, node->next);
 
-		if (last->op == DMP_DIFF_EQUAL && next->op == DMP_DIFF_EQUAL) {
-			if (last->len > 0 &&
-				dmp_has_suffix(node->text, node->len, last->text, last->len))
+		/* an equality emptied by a previous shift is logically gone (the
+		 * upstream code splices it out), so it must not be extended here
+		 */
+		if (last->op == DMP_DIFF_EQUAL && next->op == DMP_DIFF_EQUAL &&
+			last->len > 0) {
+			if (dmp_has_suffix(node->text, node->len, last->text, last->len))
 			{
 				node->text -= last->len;
 				next->text -= last->len;
@@ -515,17 +1071,87 @@ static int diff_cleanup_merge(dmp_diff *diff, dmp_range *list)
 	/* remove 0-len nodes */
 	dmp_range_normalize(pool, list);
 
+	DMP_PROFILE_END(diff, DMP_PHASE_CLEANUP, 0, 0);
+
 	/* if shifts were made, diff needs reordering and another shift sweep */
 	if (changes > 0)
-		return diff_cleanup_merge(diff, list);
+		return dmp_diff_cleanup_merge(diff, list);
 
 	return pool->error;
 }
 
+void dmp_diff_tally(dmp_diff *diff, dmp_range *list)
+{
+	dmp_pool *pool = &diff->pool;
+	dmp_stats *st = &diff->stats;
+	dmp_pos last_nonzero = -1, *pos = &list->start;
+	uint32_t ins = 0, del = 0;
+
+	st->equals = st->inserts = st->deletes = 0;
+	st->equal_bytes = st->insert_bytes = st->delete_bytes = 0;
+	st->levenshtein = 0;
+	st->moves = 0;
+
+	/* same walk as dmp_range_normalize, gathering totals on the way */
+	while (*pos != -1) {
+		dmp_node *node = dmp_node_at(pool, *pos);
+
+		if (!node->len) {
+			*pos = node->next;
+			dmp_node_release(pool, dmp_node_pos(pool, node));
+			continue;
+		}
+
+		switch (node->op) {
+		case DMP_DIFF_INSERT:
+			st->inserts++;
+			st->insert_bytes += node->len;
+			ins += node->len;
+			if (node->move)
+				st->moves++;
+			break;
+		case DMP_DIFF_DELETE:
+			st->deletes++;
+			st->delete_bytes += node->len;
+			del += node->len;
+			break;
+		default:
+			st->equals++;
+			st->equal_bytes += node->len;
+			st->levenshtein += (ins > del) ? ins : del;
+			ins = del = 0;
+			break;
+		}
+
+		last_nonzero = *pos;
+		pos = &node->next;
+	}
+
+	st->levenshtein += (ins > del) ? ins : del;
+
+	if (last_nonzero >= 0)
+		list->end = last_nonzero;
+}
+
+void dmp_diff_stats(const dmp_diff *diff, dmp_stats *stats)
+{
+	*stats = diff->stats;
+	stats->nodes_used  = diff->pool.pool_used - 1;
+	stats->nodes_freed = diff->pool.released;
+	stats->pool_grows  = diff->pool.grows;
+	stats->too_different = diff->too_different;
+}
+
 void dmp_diff_free(dmp_diff *diff)
 {
+	/* holders of a shared diff may drop their references concurrently */
+	if (dmp_atomic_dec(&diff->refs) > 0)
+		return;
+
+	free(diff->owned);
+	free(diff->map);
 	free(diff->v1);
-	free(diff->v2);
+	free(diff->engine.stack);
 	dmp_pool_free(&diff->pool);
 	free(diff);
 }
@@ -546,18 +1172,231 @@ int dmp_diff_foreach(
 	return rval;
 }
 
+int dmp_diff_foreach_moves(
+	const dmp_diff *diff,
+	dmp_diff_move_callback cb,
+	void *cb_ref)
+{
+	int pos, rval = 0;
+	const dmp_node *node;
+
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		rval = cb(cb_ref, node->op, node->text, node->len, node->move);
+		if (rval != 0)
+			break;
+	}
+
+	return rval;
+}
+
 uint32_t dmp_diff_hunks(const dmp_diff *diff)
+{
+	return diff->stats.equals + diff->stats.inserts + diff->stats.deletes;
+}
+
+uint32_t dmp_diff_to_array_buf(
+	dmp_hunk *hunks, uint32_t size, const dmp_diff *diff)
 {
 	int pos;
 	const dmp_node *node;
-	uint32_t count = 0;
+	uint32_t count = 0, off1 = 0, off2 = 0;
 
-	dmp_range_foreach(&diff->pool, &diff->list, pos, node)
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		if (count < size) {
+			dmp_hunk *h = &hunks[count];
+			h->op = node->op;
+			h->side = (node->op == DMP_DIFF_INSERT);
+			h->offset = h->side ? off2 : off1;
+			h->len = node->len;
+		}
 		count++;
 
+		if (node->op != DMP_DIFF_INSERT)
+			off1 += node->len;
+		if (node->op != DMP_DIFF_DELETE)
+			off2 += node->len;
+	}
+
 	return count;
 }
 
+int dmp_diff_to_array(
+	dmp_hunk **hunks, uint32_t *count, const dmp_diff *diff)
+{
+	uint32_t n = dmp_diff_hunks(diff);
+
+	assert(hunks && count);
+
+	*hunks = NULL;
+	*count = 0;
+
+	if (!n)
+		return 0;
+
+	if ((*hunks = malloc(n * sizeof(dmp_hunk))) == NULL)
+		return -1;
+
+	*count = dmp_diff_to_array_buf(*hunks, n, diff);
+	return 0;
+}
+
+static dmp_map_entry *build_map(const dmp_diff *diff)
+{
+	int pos;
+	const dmp_node *node;
+	uint32_t i = 0, end1 = 0, end2 = 0;
+	dmp_map_entry *map = malloc(dmp_diff_hunks(diff) * sizeof(*map));
+
+	if (!map)
+		return NULL;
+
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		if (node->op != DMP_DIFF_INSERT)
+			end1 += node->len;
+		if (node->op != DMP_DIFF_DELETE)
+			end2 += node->len;
+		map[i].end1 = end1;
+		map[i].end2 = end2;
+		map[i].op   = node->op;
+		map[i].pos  = pos;
+		i++;
+	}
+
+	return map;
+}
+
+/* The hunk index, built on first use.  Readers of a const diff may get
+ * here from several threads at once, so each builds a private index and
+ * only the first one to finish is published; the others free theirs.
+ * Returns NULL (and callers walk the list instead) if out of memory.
+ */
+static const dmp_map_entry *diff_map(const dmp_diff *diff)
+{
+	dmp_diff *d = (dmp_diff *)diff;
+	dmp_map_entry *map = dmp_atomic_load_ptr(&d->map);
+
+	if (map || !dmp_diff_hunks(diff))
+		return map;
+
+	if ((map = build_map(diff)) == NULL)
+		return NULL;
+
+	if (!dmp_atomic_publish_ptr(&d->map, map)) {
+		free(map);
+		map = dmp_atomic_load_ptr(&d->map);
+	}
+
+	return map;
+}
+
+uint32_t dmp_diff_map_offset(const dmp_diff *diff, uint32_t offset)
+{
+	const dmp_map_entry *map = diff_map(diff);
+	uint32_t lo = 0, hi = dmp_diff_hunks(diff), last1 = 0, last2 = 0;
+
+	if (!map) {
+		uint32_t out;
+		dmp_diff_map_offsets(diff, &out, &offset, 1);
+		return out;
+	}
+
+	/* find the first hunk that extends past offset in text1 */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (map[mid].end1 > offset)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	if (lo > 0) {
+		last1 = map[lo - 1].end1;
+		last2 = map[lo - 1].end2;
+	}
+
+	/* a location inside a deletion maps to where the deletion was */
+	if (lo < dmp_diff_hunks(diff) && map[lo].op == DMP_DIFF_DELETE)
+		return last2;
+
+	return last2 + (offset - last1);
+}
+
+int dmp_diff_foreach_range(
+	const dmp_diff *diff,
+	uint32_t from_hunk,
+	uint32_t to_hunk,
+	dmp_diff_callback cb,
+	void *cb_ref)
+{
+	const dmp_map_entry *map;
+	const dmp_node *node = NULL;
+	dmp_pos pos = diff->list.start;
+	uint32_t count;
+	int rval = 0;
+
+	if (to_hunk > dmp_diff_hunks(diff))
+		to_hunk = dmp_diff_hunks(diff);
+	if (from_hunk >= to_hunk)
+		return 0;
+
+	/* seek with the hunk index, or by walking the list without one */
+	if (from_hunk > 0 && (map = diff_map(diff)) != NULL)
+		pos = map[from_hunk].pos;
+	else {
+		for (count = from_hunk; count > 0; pos = node->next) {
+			node = dmp_node_at(&diff->pool, pos);
+			if (node->len > 0)
+				count--;
+		}
+	}
+
+	for (count = to_hunk - from_hunk; count > 0; pos = node->next) {
+		node = dmp_node_at(&diff->pool, pos);
+		if (node->len == 0)
+			continue;
+		if ((rval = cb(cb_ref, node->op, node->text, node->len)) != 0)
+			break;
+		count--;
+	}
+
+	return rval;
+}
+
+void dmp_diff_map_offsets(
+	const dmp_diff *diff, uint32_t *out, const uint32_t *offsets, uint32_t n)
+{
+	uint32_t i, end1 = 0, end2 = 0, last1 = 0, last2 = 0;
+	dmp_pos pos = diff->list.start;
+	const dmp_node *node = NULL;
+
+	for (i = 0; i < n; ++i) {
+		/* out of order offsets restart the walk rather than fail */
+		if (i > 0 && offsets[i] < offsets[i - 1]) {
+			pos = diff->list.start;
+			node = NULL;
+			end1 = end2 = last1 = last2 = 0;
+		}
+
+		while (end1 <= offsets[i] && pos >= 0) {
+			last1 = end1;
+			last2 = end2;
+			node  = dmp_node_at(&diff->pool, pos);
+			pos   = node->next;
+			if (node->op != DMP_DIFF_INSERT)
+				end1 += node->len;
+			if (node->op != DMP_DIFF_DELETE)
+				end2 += node->len;
+		}
+
+		if (end1 <= offsets[i])  /* past the end of text1 */
+			out[i] = end2 + (offsets[i] - end1);
+		else if (node->op == DMP_DIFF_DELETE)
+			out[i] = last2;
+		else
+			out[i] = last2 + (offsets[i] - last1);
+	}
+}
+
 static void print_bytes(FILE *fp, const char *bytes, uint32_t len)
 {
 	uint32_t i;
@@ -576,6 +1415,16 @@ void dmp_diff_print_raw(FILE *fp, const dmp_diff *diff)
 	int pos, ct = 0, ct0 = 0;
 	const dmp_node *node;
 
+	/* sequence diffs have no text to show, just the hunk lengths */
+	if (diff->seq_size) {
+		fputs("\n", fp);
+		dmp_range_foreach(&diff->pool, &diff->list, pos, node)
+			fprintf(fp, "%c%u ", (node->op < 0) ? '-' :
+				(node->op > 0) ? '+' : '=', node->len);
+		fputs("\n", fp);
+		return;
+	}
+
 	fputs("\n> \"", fp);
 	print_bytes(fp, diff->t1, diff->l1);
 	fputs("\"\n", fp);
@@ -590,9 +1439,370 @@ void dmp_diff_print_raw(FILE *fp, const dmp_diff *diff)
 		fputs(node->next >= 0 ? "\", " : "\"\n", fp);
 	}
 
-	fputs("< \"", fp);
-	print_bytes(fp, diff->t2, diff->l2);
-	fputs("\"\n", fp);
+	/* diffs decoded from a delta have no contiguous text2 */
+	if (diff->t2) {
+		fputs("< \"", fp);
+		print_bytes(fp, diff->t2, diff->l2);
+		fputs("\"\n", fp);
+	}
+}
+
+/* move a pointer into the old text2 to the same spot in the edited text2 */
+static const char *rebase_text(
+	const dmp_diff *diff, const char *old_t2, const char *text,
+	const char *text2, uint32_t offset, uint32_t removed, uint32_t inserted)
+{
+	uintptr_t at = (uintptr_t)text, t1 = (uintptr_t)diff->t1;
+	uintptr_t t2 = (uintptr_t)old_t2;
+
+	/* text1 is unchanged, even if it is the same buffer as text2 */
+	if (at >= t1 && at < t1 + diff->l1)
+		return text;
+	if (at < t2 || at >= t2 + diff->l2)
+		return text;
+
+	if (at - t2 < offset)
+		return text2 + (at - t2);
+	return text2 + (at - t2) - removed + inserted;
+}
+
+/* first hunk of the index that ends past `offset` in text2 (or that ends
+ * at it too, if `reach` is set)
+ */
+static uint32_t map_find2(
+	const dmp_map_entry *map, uint32_t n, uint32_t offset, int reach)
+{
+	uint32_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (map[mid].end2 > offset || (reach && map[mid].end2 == offset))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+#define map_start1(MAP, I)	((I) ? (MAP)[(I) - 1].end1 : 0)
+#define map_start2(MAP, I)	((I) ? (MAP)[(I) - 1].end2 : 0)
+
+/* add (or with `sign` -1, take away) the totals of the hunks from `pos`
+ * up to `stop`, a part of the list that starts and ends at an EQUAL or at
+ * an end of the list so that no run of changes crosses its edges
+ */
+static void part_totals(
+	dmp_stats *st, const dmp_pool *pool, dmp_pos pos, dmp_pos stop, int sign)
+{
+	uint32_t ins = 0, del = 0;
+
+	for (; pos != stop && pos >= 0; pos = dmp_node_at(pool, pos)->next) {
+		const dmp_node *node = dmp_node_at(pool, pos);
+		uint32_t len = node->len;
+
+		switch (node->op) {
+		case DMP_DIFF_INSERT:
+			st->inserts += sign;
+			st->insert_bytes += sign * len;
+			ins += len;
+			break;
+		case DMP_DIFF_DELETE:
+			st->deletes += sign;
+			st->delete_bytes += sign * len;
+			del += len;
+			break;
+		default:
+			st->equals += sign;
+			st->equal_bytes += sign * len;
+			st->levenshtein += sign * ((ins > del) ? ins : del);
+			ins = del = 0;
+			break;
+		}
+	}
+
+	st->levenshtein += sign * ((ins > del) ? ins : del);
+}
+
+static void set_totals(dmp_stats *st, const dmp_stats *from)
+{
+	st->equals = from->equals;
+	st->inserts = from->inserts;
+	st->deletes = from->deletes;
+	st->equal_bytes = from->equal_bytes;
+	st->insert_bytes = from->insert_bytes;
+	st->delete_bytes = from->delete_bytes;
+	st->levenshtein = from->levenshtein;
+	st->moves = from->moves;
+}
+
+int dmp_diff_update(
+	dmp_diff *diff,
+	const dmp_options *options,
+	const char *text2,
+	uint32_t    offset,
+	uint32_t    removed_len,
+	uint32_t    inserted_len)
+{
+	dmp_pool *pool = &diff->pool;
+	const char *old_t2 = diff->t2;
+	dmp_map_entry *map = NULL;
+	dmp_node *node;
+	dmp_range sub, right = { -1, -1 };
+	dmp_stats saved, rest;
+	dmp_pos pos, scan, next, stop, start = -1, end = -1, from;
+	uint32_t n, i, e, first = 0, after, count, p1, p2, k = 0, j = 0;
+	uint32_t c1s = 0, c2s = 0, c1e = diff->l1, c2e = diff->l2;
+	uint32_t edit_end = offset + removed_len, new_l2;
+	int too_different, error;
+
+	/* shared diffs are immutable and decoded diffs have no text2 */
+	if (dmp_atomic_load(&diff->refs) > 0 || diff->owned ||
+		!diff->t2 || !text2 || offset > diff->l2 || removed_len > diff->l2 - offset ||
+		inserted_len > UINT32_MAX - (diff->l2 - removed_len))
+		return -1;
+
+	new_l2 = diff->l2 - removed_len + inserted_len;
+
+	/* the window is found with the hunk index, which is kept up to date
+	 * from here on
+	 */
+	if ((n = dmp_diff_hunks(diff)) > 0) {
+		if (!diff_map(diff))
+			return -1;
+		map = diff->map;
+	} else {
+		/* an index kept from before the diff emptied holds nothing */
+		free(diff->map);
+		diff->map = NULL;
+	}
+
+	/* find the EQUAL hunks around the edit to cut the old diff at; the
+	 * cut keeps a non-empty part of each, so whole runs of edits next to
+	 * the edit are re-diffed and never end up next to new ones
+	 */
+	i = map_find2(map, n, offset, 1);
+	if (i >= n || map[i].op != DMP_DIFF_EQUAL ||
+		map_start2(map, i) >= offset)
+		i = map_find2(map, n, offset, 0);
+
+	if (i < n && map[i].op == DMP_DIFF_EQUAL &&
+		map_start2(map, i) < offset) {
+		/* the edit starts inside this EQUAL */
+		start = map[i].pos;
+		first = i;
+		k   = offset - map_start2(map, i);
+		c1s = map_start1(map, i) + k;
+		c2s = offset;
+	} else {
+		/* or in the changes after the EQUAL before it */
+		for (e = i; e > 0 && map[e - 1].op != DMP_DIFF_EQUAL; --e)
+			/* back up */;
+		if (e > 0) {
+			first = e - 1;
+			start = map[first].pos;
+			k   = map[first].end1 - map_start1(map, first);
+			c1s = map[first].end1;
+			c2s = map[first].end2;
+		}
+	}
+
+	/* the first EQUAL from there on that runs past the edit */
+	for (e = map_find2(map, n, edit_end, 0);
+		e < n && map[e].op != DMP_DIFF_EQUAL; ++e)
+		/* skip changes */;
+	if (e < n) {
+		end = map[e].pos;
+		j   = (edit_end > map_start2(map, e)) ?
+			edit_end - map_start2(map, e) : 0;
+		c1e = map_start1(map, e) + j;
+		c2e = map_start2(map, e) + j;
+		after = e + 1;
+	} else
+		after = n;
+
+	if (dmp_pool_reserve(pool, 1) < 0) {
+		pool->error = 0;
+		return -1;
+	}
+
+	/* totals of the rest of the diff, without the hunks of the window */
+	saved = rest = diff->stats;
+	stop = (end >= 0) ? dmp_node_at(pool, end)->next : -1;
+	part_totals(&rest, pool,
+		(start >= 0) ? start : diff->list.start, stop, -1);
+
+	/* an edit inside one EQUAL splits it, so make the right half now */
+	if (start >= 0 && start == end) {
+		node = dmp_node_at(pool, start);
+		dmp_range_init(pool, &right, DMP_DIFF_EQUAL,
+			node->text, j, node->len - j);
+		if (right.start < 0)
+			return -1;
+	}
+
+	/* re-diff just the window between the cuts, without a budget */
+	diff->deadline = (options && options->timeout > 0) ?
+		dmp_time() + options->timeout : -1.0;
+	diff->max_edits = 0;
+	too_different = diff->too_different;
+	diff->too_different = 0;
+
+	error = dmp_diff_main(&sub, diff, options,
+		diff->t1 + c1s, c1e - c1s,
+		text2 + c2s, (c2e - c2s) - removed_len + inserted_len);
+	diff->too_different = too_different;
+	if (error < 0) {
+		/* give back what the failed update took; the diff is unchanged */
+		for (scan = sub.start; scan >= 0; scan = next) {
+			next = dmp_node_at(pool, scan)->next;
+			dmp_node_release(pool, scan);
+		}
+		if (right.start >= 0)
+			dmp_node_release(pool, right.start);
+		pool->error = 0;
+		set_totals(&diff->stats, &saved);
+		return error;
+	}
+
+	/* drop the old hunks of the window and trim the ones at the cuts */
+	scan = (start >= 0) ? dmp_node_at(pool, start)->next : diff->list.start;
+	while (right.start < 0 && scan != end && scan >= 0) {
+		next = dmp_node_at(pool, scan)->next;
+		dmp_node_release(pool, scan);
+		scan = next;
+	}
+
+	if (right.start >= 0) {
+		dmp_node_at(pool, right.start)->next =
+			dmp_node_at(pool, start)->next;
+		end = right.start;
+	} else if (end >= 0) {
+		node = dmp_node_at(pool, end);
+		node->text += j;
+		node->len  -= j;
+	}
+
+	if (start >= 0) {
+		dmp_node_at(pool, start)->len  = k;
+		dmp_node_at(pool, start)->next = end;
+	} else
+		diff->list.start = end;
+
+	/* hunks after the window move with the edited text2, or all of them
+	 * if it is in a new buffer (EQUAL and DELETE hunks in text1 stay put)
+	 */
+	if (text2 != old_t2 || removed_len != inserted_len) {
+		pos = (text2 != old_t2) ? diff->list.start : end;
+		for (; pos >= 0; pos = node->next) {
+			node = dmp_node_at(pool, pos);
+			node->text = rebase_text(diff, old_t2, node->text,
+				text2, offset, removed_len, inserted_len);
+		}
+	}
+
+	/* moves are dropped as the window may have held one side of them */
+	if (saved.moves > 0) {
+		for (pos = diff->list.start; pos >= 0; pos = node->next) {
+			node = dmp_node_at(pool, pos);
+			node->move = 0;
+		}
+		rest.moves = 0;
+	}
+
+	/* and the new hunks go between the cuts */
+	if (sub.start >= 0) {
+		dmp_node_at(pool, sub.end)->next = end;
+		if (start >= 0)
+			dmp_node_at(pool, start)->next = sub.start;
+		else
+			diff->list.start = sub.start;
+	}
+
+	/* rejoin EQUAL hunks that meet at the cuts; they may point into
+	 * different texts, but EQUAL data is in text1 at the same position
+	 */
+	stop = (end >= 0) ? dmp_node_at(pool, end)->next : -1;
+	from = (start >= 0) ? start : diff->list.start;
+	scan = from;
+	p1   = (start >= 0) ? c1s - k : 0;
+	while (scan != stop && scan >= 0) {
+		node = dmp_node_at(pool, scan);
+
+		while (node->op == DMP_DIFF_EQUAL && node->next >= 0) {
+			dmp_pos next_pos = node->next;
+			dmp_node *next = dmp_node_at(pool, next_pos);
+
+			if (next->op != DMP_DIFF_EQUAL)
+				break;
+
+			node->text = diff->t1 + p1;
+			node->len += next->len;
+			node->next = next->next;
+			dmp_node_release(pool, next_pos);
+		}
+
+		if (node->op != DMP_DIFF_INSERT)
+			p1 += node->len;
+		scan = node->next;
+	}
+
+	/* the new hunks of the window replace its old ones in the index,
+	 * and the index entries after it move with text2
+	 */
+	for (count = 0, pos = from; pos != stop && pos >= 0;
+		pos = dmp_node_at(pool, pos)->next)
+		count++;
+
+	if (count > after - first) {
+		dmp_map_entry *grown = realloc(
+			map, (n - (after - first) + count) * sizeof(*map));
+		if (!grown)
+			free(map);
+		map = grown;
+	}
+
+	if (map && count != after - first)
+		memmove(map + first + count, map + after,
+			(n - after) * sizeof(*map));
+	if (map && removed_len != inserted_len)
+		for (e = first + count; e < n - (after - first) + count; ++e)
+			map[e].end2 = map[e].end2 - removed_len + inserted_len;
+
+	p1 = map ? map_start1(map, first) : 0;
+	p2 = map ? map_start2(map, first) : 0;
+	for (e = first, pos = from; pos != stop && pos >= 0; pos = node->next) {
+		node = dmp_node_at(pool, pos);
+		assert(node->len > 0);
+
+		if (node->op != DMP_DIFF_INSERT)
+			p1 += node->len;
+		if (node->op != DMP_DIFF_DELETE)
+			p2 += node->len;
+		if (map) {
+			map[e].end1 = p1;
+			map[e].end2 = p2;
+			map[e].op   = node->op;
+			map[e].pos  = pos;
+			e++;
+		}
+
+		/* the window may now hold the last hunk */
+		if (node->next < 0)
+			diff->list.end = pos;
+	}
+
+	diff->map = map;
+	diff->t2 = text2;
+	diff->l2 = new_l2;
+
+	if (diff->list.start < 0)
+		diff->list.end = -1;
+
+	part_totals(&rest, pool, from, stop, 1);
+	set_totals(&diff->stats, &rest);
+
+	return 0;
 }
 
 int dmp_options_init(dmp_options *opts)
@@ -607,35 +1817,115 @@ int dmp_options_init(dmp_options *opts)
 	opts->check_lines = 1;
 	opts->trim_common_prefix = 1;
 	opts->trim_common_suffix = 1;
+	opts->algorithm = DMP_ALGORITHM_MYERS;
+	opts->max_edits = 0;
+	opts->text1_hash = 0;
+	opts->text2_hash = 0;
+	opts->expected_hunks = 0;
+	opts->threads = 1;
+	opts->move_min_len = 0;
+	opts->phase_cb = NULL;
+	opts->phase_cb_ref = NULL;
 	return 0;
 }
 
-uint32_t dmp_common_prefix(
-	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+int dmp_diff_distance_bounded(
+	uint32_t *distance,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2,
+	uint32_t    max_edits)
 {
-	const char *start = t1;
-	const char *end   = t1 + dmp_min(l1, l2);
+	const dmp_kernels *kern = dmp_cpu_kernels();
+	uint32_t common, n, m;
+	uint64_t limit;
+	int d, max_d, v_offset, kstart, kend, *v;
 
-	for (; t1 < end && *t1 == *t2; t1++, t2++);
+	assert(distance);
 
-	return (uint32_t)(t1 - start);
-}
+	common = dmp_common_prefix(text1, len1, text2, len2);
+	text1 += common;
+	len1  -= common;
+	text2 += common;
+	len2  -= common;
 
-uint32_t dmp_common_suffix(
-	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
-{
-	const char *start;
+	common = dmp_common_suffix(text1, len1, text2, len2);
+	n = len1 - common;
+	m = len2 - common;
 
-	if (l1 > l2) {
-		const char *tswap = t1; t1 = t2; t2 = tswap;
-		uint32_t lswap = l1; l1 = l2; l2 = lswap;
+	/* the difference in length alone is a lower bound on the distance */
+	if ((n > m ? n - m : m - n) > max_edits)
+		return DMP_TOO_DIFFERENT;
+
+	if (!n || !m) {
+		*distance = n + m;
+		return 0;
 	}
 
-	start = t1;
+	/* forward-only Myers search that never looks past max_d diagonals,
+	 * which have to fit in an int
+	 */
+	limit = dmp_min((uint64_t)max_edits, (uint64_t)n + m);
+	if (limit > INT_MAX / 2)
+		return -1;
+	max_d = (int)limit;
+	v_offset = max_d + 1;
+	kstart = kend = 0;
+
+	v = malloc((2 * (size_t)max_d + 3) * sizeof(int));
+	if (!v)
+		return -1;
+	memset(v, 0xff, (2 * (size_t)max_d + 3) * sizeof(int));
+	v[v_offset + 1] = 0;
+
+	for (d = 0; d <= max_d; d++) {
+		int k;
 
-	for (t1 = t1+l1-1, t2 = t2+l2-1; t1 >= start && *t1 == *t2; t1--, t2--);
+		for (k = -d + kstart; k <= d - kend; k += 2) {
+			int koff = v_offset + k;
+			uint32_t x, y;
+
+			if (k == -d || (k != d && v[koff - 1] < v[koff + 1]))
+				x = v[koff + 1];
+			else
+				x = v[koff - 1] + 1;
+			y = x - k;
+
+			if (x < n && y < m && text1[x] == text2[y]) {
+				uint32_t snake = kern->common_prefix(
+					text1 + x, n - x, text2 + y, m - y);
+				x += snake;
+				y += snake;
+			}
 
-	return (uint32_t)((start + l1 - 1) - t1);
+			v[koff] = x;
+			if (x > n) /* ran off the right of the graph */
+				kend += 2;
+			else if (y > m) /* ran off bottom of the graph */
+				kstart += 2;
+			else if (x == n && y == m) {
+				free(v);
+				*distance = d;
+				return 0;
+			}
+		}
+	}
+
+	free(v);
+	return DMP_TOO_DIFFERENT;
+}
+
+uint32_t dmp_common_prefix(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	return dmp_cpu_kernels()->common_prefix(t1, l1, t2, l2);
+}
+
+uint32_t dmp_common_suffix(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	return dmp_cpu_kernels()->common_suffix(t1, l1, t2, l2);
 }
 
 int dmp_strcmp(
@@ -645,83 +1935,17 @@ int dmp_strcmp(
 	return (cmp != 0) ? cmp : dmp_num_cmp(l1, l2);
 }
 
+/* memcmp is already tuned for the CPU by the C library */
 int dmp_has_prefix(
 	const char *text, uint32_t tlen, const char *pfx, uint32_t plen)
 {
-	if (plen > tlen)
-		return 0;
-
-	for (; plen > 0; --plen, ++text, ++pfx)
-		if (*text != *pfx)
-			return 0;
-
-	return 1;
+	return plen <= tlen && !memcmp(text, pfx, plen);
 }
 
 int dmp_has_suffix(
 	const char *text, uint32_t tlen, const char *sfx, uint32_t slen)
 {
-	if (slen > tlen)
-		return 0;
-
-	for (text = text + tlen - 1, sfx = sfx + slen - 1;
-		 slen > 0; --slen, --text, --sfx)
-		if (*text != *sfx)
-			return 0;
-
-	return 1;
-}
-
-/* Railgun is a fast memmem search */
-
-/* All Railgun variants are written by Georgi 'Kaze', they are free,
- * however I expect the user to mention its homepage, that is:
- * http://www.sanmayce.com/Railgun/index.html
- *
- * Author's email: sanmayce@sanmayce.com
- *
- * Caution: For better speed the case 'if (cbPattern==1)' was removed,
- * so Pattern must be longer than 1 char.
- */
-static const char *Railgun_Doublet(
-	const char * pbTarget, const char * pbPattern,
-	uint32_t cbTarget, uint32_t cbPattern)
-{
-	const char * pbTargetMax = pbTarget + cbTarget;
-	register uint32_t ulHashPattern;
-	uint32_t count, countSTATIC;
-
-	if (cbPattern > cbTarget) return(NULL);
-
-	countSTATIC = cbPattern-2;
-
-	pbTarget = pbTarget+cbPattern;
-	ulHashPattern = (*(uint16_t *)(pbPattern));
-
-	for ( ;; ) {
-		if ( ulHashPattern == (*(uint16_t *)(pbTarget-cbPattern)) ) {
-			count = countSTATIC;
-			while ( count && *(char *)(pbPattern+2+(countSTATIC-count)) == *(char *)(pbTarget-cbPattern+2+(countSTATIC-count)) ) {
-				count--;
-			}
-			if ( count == 0 ) return((pbTarget-cbPattern));
-		}
-		pbTarget++;
-		if (pbTarget > pbTargetMax) return(NULL);
-	}
-}
-
-const char *dmp_strstr(
-	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
-{
-	switch (ln) {
-	case 0:
-		return haystack;
-	case 1:
-		return memchr(haystack, *needle, lh);
-	default:
-		return Railgun_Doublet(haystack, needle, lh, ln);
-	}
+	return slen <= tlen && !memcmp(text + tlen - slen, sfx, slen);
 }
 
 /*
@@ -732,7 +1956,7 @@ const char *dmp_strstr(
 
 #include <windows.h>
 
-static double dmp_time(void)
+double dmp_time(void)
 {
     LARGE_INTEGER counter, freq;
     QueryPerformanceCounter(&counter);
@@ -744,7 +1968,7 @@ static double dmp_time(void)
 
 #include <sys/time.h>
 
-static double dmp_time(void)
+double dmp_time(void)
 {
 	struct timeval tv;
     struct timezone tz;
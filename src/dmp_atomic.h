@@ -0,0 +1,60 @@
+/**
+ * dmp_atomic.h
+ *
+ * The few atomic operations that let a finished diff be shared between
+ * threads (publishing a lazily built index and counting references) and
+ * that record the kernels chosen for the CPU.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#ifndef INCLUDE_H_dmp_atomic
+#define INCLUDE_H_dmp_atomic
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+#define dmp_atomic_load_ptr(P) \
+	_InterlockedCompareExchangePointer((void *volatile *)(P), NULL, NULL)
+/* store VAL into *P if it still holds NULL; nonzero if it was stored */
+#define dmp_atomic_publish_ptr(P, VAL) \
+	(_InterlockedCompareExchangePointer( \
+		(void *volatile *)(P), (VAL), NULL) == NULL)
+#define dmp_atomic_inc(P) \
+	((uint32_t)_InterlockedIncrement((volatile long *)(P)) - 1)
+#define dmp_atomic_dec(P) \
+	((uint32_t)_InterlockedDecrement((volatile long *)(P)) + 1)
+#define dmp_atomic_load(P) \
+	((uint32_t)_InterlockedOr((volatile long *)(P), 0))
+#define dmp_atomic_store(P, VAL) \
+	((void)_InterlockedExchange((volatile long *)(P), (long)(VAL)))
+
+#else
+
+#define dmp_atomic_load_ptr(P) \
+	__atomic_load_n((P), __ATOMIC_ACQUIRE)
+/* store VAL into *P if it still holds NULL; nonzero if it was stored */
+#define dmp_atomic_publish_ptr(P, VAL) \
+	dmp_atomic_publish_ptr_((void **)(P), (VAL))
+static inline int dmp_atomic_publish_ptr_(void **ptr, void *val)
+{
+	void *expect = NULL;
+	return __atomic_compare_exchange_n(
+		ptr, &expect, val, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+/* increment and decrement return the value from before the change */
+#define dmp_atomic_inc(P) \
+	__atomic_fetch_add((P), 1, __ATOMIC_RELAXED)
+#define dmp_atomic_dec(P) \
+	__atomic_fetch_sub((P), 1, __ATOMIC_ACQ_REL)
+#define dmp_atomic_load(P) \
+	__atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define dmp_atomic_store(P, VAL) \
+	__atomic_store_n((P), (VAL), __ATOMIC_RELEASE)
+
+#endif
+
+#endif
@@ -0,0 +1,365 @@
+/**
+ * dmp_bitpar.c
+ *
+ * Bit-parallel diff of short texts (see dmp_edit_distance)
+ *
+ * Each byte of text2 advances a bit vector over text1 with a few word
+ * operations, using a table of where each byte value occurs in text1
+ * (the "Peq" table of Myers and Hyyrö).  This is the LCS form of the
+ * recurrence: with U = V & Peq[c], the next vector is (V + U) | (V - U),
+ * and the zero bits among the first i of the vector after j bytes of
+ * text2 count the longest common subsequence of text1[0, i) and
+ * text2[0, j).  The distance of this library counts inserted plus
+ * deleted bytes, which is len1 + len2 - 2 * LCS, so this finds the same
+ * distance as the Myers diff does.
+ *
+ * A text1 of up to 64 bytes fits in one word.  Longer ones are split into
+ * words that pass the carry of the addition along.  When the hunks are
+ * wanted, the vector after each byte of text2 is kept and the alignment
+ * is traced back from the end.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_pool.h"
+#include "dmp_diff.h"
+#include "dmp_cpu.h"
+
+#define BITPAR_POOL	8
+
+/* most words of vectors kept for a traceback (16MB), past which
+ * dmp_edit_distance builds its diff with Myers instead
+ */
+#define BITPAR_TRACE_WORDS	(1 << 21)
+
+typedef struct {
+	const char *t1, *t2;
+	uint32_t l1, l2;
+	uint32_t words; /* per vector */
+	int trace;      /* keep every vector, or just the last two? */
+	uint64_t *peq;  /* 256 masks of `words` words each */
+	uint64_t *rows;
+	/* storage for a text1 that fits in a word and a short text2 */
+	uint64_t peq_small[256];
+	uint64_t rows_small[DMP_BITPAR_MAX + 1];
+} bp_ctx;
+
+static int bp_init(bp_ctx *bp,
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2, int trace)
+{
+	size_t nrows = trace ? (size_t)l2 + 1 : 2;
+	uint32_t i;
+
+	bp->t1 = t1;
+	bp->l1 = l1;
+	bp->t2 = t2;
+	bp->l2 = l2;
+	bp->words = (l1 + 63) / 64;
+	bp->trace = trace;
+
+	if (bp->words == 1 && nrows <= DMP_BITPAR_MAX + 1) {
+		bp->peq  = bp->peq_small;
+		bp->rows = bp->rows_small;
+	} else {
+		bp->peq  = malloc(256 * (size_t)bp->words * sizeof(uint64_t));
+		bp->rows = malloc(nrows * bp->words * sizeof(uint64_t));
+		if (!bp->peq || !bp->rows) {
+			free(bp->peq);
+			free(bp->rows);
+			return -1;
+		}
+	}
+
+	memset(bp->peq, 0, 256 * (size_t)bp->words * sizeof(uint64_t));
+	for (i = 0; i < l1; ++i)
+		bp->peq[(unsigned char)t1[i] * (size_t)bp->words + i / 64] |=
+			(uint64_t)1 << (i % 64);
+
+	return 0;
+}
+
+static void bp_free(bp_ctx *bp)
+{
+	if (bp->peq != bp->peq_small) {
+		free(bp->peq);
+		free(bp->rows);
+	}
+}
+
+/* vector after `j` bytes of text2 (only the last one without traceback) */
+static const uint64_t *bp_row(const bp_ctx *bp, uint32_t j)
+{
+	return bp->rows + (bp->trace ? j : (j & 1)) * (size_t)bp->words;
+}
+
+/* run all of text2 through the vectors */
+static void bp_run(bp_ctx *bp)
+{
+	uint32_t j, w, words = bp->words;
+
+	if (words == 1) {
+		uint64_t v = ~(uint64_t)0;
+
+		bp->rows[0] = v;
+		for (j = 0; j < bp->l2; ++j) {
+			uint64_t u = v & bp->peq[(unsigned char)bp->t2[j]];
+			v = (v + u) | (v - u);
+			bp->rows[bp->trace ? j + 1 : ((j + 1) & 1)] = v;
+		}
+		return;
+	}
+
+	memset(bp->rows, 0xff, words * sizeof(uint64_t));
+	for (j = 0; j < bp->l2; ++j) {
+		const uint64_t *v = bp_row(bp, j);
+		const uint64_t *p = bp->peq + (unsigned char)bp->t2[j] * (size_t)words;
+		uint64_t *next = (uint64_t *)bp_row(bp, j + 1), carry = 0;
+
+		/* U is a subset of V, so only the addition carries */
+		for (w = 0; w < words; ++w) {
+			uint64_t u = v[w] & p[w], sum = v[w] + u, x = sum + carry;
+			carry = (sum < u) | (x < sum);
+			next[w] = x | (v[w] - u);
+		}
+	}
+}
+
+/* set bits among the first `i` of a vector */
+static uint32_t bp_ones(const uint64_t *row, uint32_t i)
+{
+	uint32_t w, n = 0;
+
+	for (w = 0; w < i / 64; ++w)
+		n += dmp_popcount64(row[w]);
+	if (i % 64)
+		n += dmp_popcount64(row[w] & (((uint64_t)1 << (i % 64)) - 1));
+
+	return n;
+}
+
+static uint32_t bp_lcs(const bp_ctx *bp)
+{
+	return bp->l1 - bp_ones(bp_row(bp, bp->l2), bp->l1);
+}
+
+/* walk back from the end, taking a matching byte whenever there is one and
+ * otherwise an insert before a delete, so that the equalities come as late
+ * as they can, much as the Myers diff places them
+ */
+static void bp_trace(const bp_ctx *bp, signed char *path)
+{
+	uint32_t i = bp->l1, j = bp->l2, k = bp->l1 + bp->l2;
+
+	while (i > 0 || j > 0) {
+		if (i > 0 && j > 0 && bp->t1[i - 1] == bp->t2[j - 1]) {
+			path[--k] = DMP_DIFF_EQUAL;
+			i--, j--;
+		} else if (j > 0 && (i == 0 ||
+			bp_ones(bp_row(bp, j), i) == bp_ones(bp_row(bp, j - 1), i))) {
+			path[--k] = DMP_DIFF_INSERT;
+			j--;
+		} else {
+			path[--k] = DMP_DIFF_DELETE;
+			i--;
+		}
+	}
+
+	/* every equality takes a byte from both texts */
+	assert(k == bp_lcs(bp));
+}
+
+static int bp_emit(
+	dmp_range *out, dmp_diff *diff, const bp_ctx *bp,
+	const signed char *path, uint32_t start)
+{
+	dmp_pool *pool = &diff->pool;
+	uint32_t total = bp->l1 + bp->l2, runs = 0, k, e, i = 0, j = 0;
+
+	for (k = start; k < total; ++k)
+		runs += (k == start || path[k] != path[k - 1]);
+	if (dmp_pool_reserve(pool, runs) < 0)
+		return -1;
+
+	for (k = start; k < total; k = e) {
+		for (e = k + 1; e < total && path[e] == path[k]; ++e);
+
+		if (path[k] == DMP_DIFF_INSERT) {
+			dmp_range_insert(
+				pool, out, -1, DMP_DIFF_INSERT, bp->t2, j, e - k);
+			j += e - k;
+		} else {
+			dmp_range_insert(pool, out, -1, path[k], bp->t1, i, e - k);
+			i += e - k;
+			if (path[k] == DMP_DIFF_EQUAL)
+				j += e - k;
+		}
+	}
+
+	return pool->error;
+}
+
+int dmp_diff_bitpar(
+	dmp_range *out,
+	dmp_diff *diff,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2,
+	uint32_t   *lcs)
+{
+	bp_ctx bp;
+	signed char path_small[2 * DMP_BITPAR_MAX], *path = path_small;
+	int error;
+
+	assert(len1 > 0);
+
+	if (bp_init(&bp, text1, len1, text2, len2, 1) < 0)
+		return (diff->pool.error = -1);
+
+	if ((uint64_t)len1 + len2 > sizeof(path_small) &&
+		(path = malloc((size_t)len1 + len2)) == NULL) {
+		bp_free(&bp);
+		return (diff->pool.error = -1);
+	}
+
+	diff->stats.bitpar_calls++;
+
+	bp_run(&bp);
+	*lcs = bp_lcs(&bp);
+	bp_trace(&bp, path);
+	error = bp_emit(out, diff, &bp, path, *lcs);
+
+	if (path != path_small)
+		free(path);
+	bp_free(&bp);
+	return error;
+}
+
+static int edit_diff(
+	uint32_t *distance,
+	dmp_diff **diff_ptr,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2,
+	uint32_t prefix,
+	uint32_t suffix)
+{
+	dmp_diff *diff;
+	dmp_pool *pool;
+	uint32_t n = len1 - prefix - suffix, m = len2 - prefix - suffix, lcs = 0;
+	int error = 0;
+
+	if ((uint64_t)(m + 1) * ((n + 63) / 64) > BITPAR_TRACE_WORDS) {
+		dmp_stats st;
+
+		if ((error = dmp_diff_new(
+				diff_ptr, NULL, text1, len1, text2, len2)) < 0)
+			return error;
+
+		dmp_diff_stats(*diff_ptr, &st);
+		*distance = st.insert_bytes + st.delete_bytes;
+		return 0;
+	}
+
+	if ((diff = dmp_diff_alloc(NULL)) == NULL)
+		return -1;
+	pool = &diff->pool;
+
+	if (dmp_pool_alloc(pool, BITPAR_POOL) < 0) {
+		free(diff);
+		return -1;
+	}
+
+	diff->t1 = text1;
+	diff->l1 = len1;
+	diff->t2 = text2;
+	diff->l2 = len2;
+
+	/* common prefix (or an empty sentinel), then the common suffix after
+	 * it, with the hunks between them appended before the suffix
+	 */
+	dmp_range_init(pool, &diff->list, DMP_DIFF_EQUAL, text1, 0, prefix);
+	if (suffix > 0)
+		dmp_range_insert(pool, &diff->list, diff->list.end,
+			DMP_DIFF_EQUAL, text1, len1 - suffix, suffix);
+
+	if (n > 0 && m > 0) {
+		error = dmp_diff_bitpar(&diff->list, diff,
+			text1 + prefix, n, text2 + prefix, m, &lcs);
+		if (!error)
+			error = dmp_diff_cleanup_merge(diff, &diff->list);
+	} else if (n > 0)
+		dmp_range_insert(pool, &diff->list, -1,
+			DMP_DIFF_DELETE, text1, prefix, n);
+	else if (m > 0)
+		dmp_range_insert(pool, &diff->list, -1,
+			DMP_DIFF_INSERT, text2, prefix, m);
+
+	if (error || pool->error) {
+		dmp_diff_free(diff);
+		return -1;
+	}
+
+	dmp_diff_tally(diff, &diff->list);
+
+	*distance = n + m - 2 * lcs;
+	*diff_ptr = diff;
+	return 0;
+}
+
+int dmp_edit_distance(
+	uint32_t *distance,
+	dmp_diff **diff_ptr,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	bp_ctx bp;
+	uint32_t prefix, suffix, n, m;
+
+	assert(distance);
+
+	if (!text1)
+		text1 = "", len1 = 0;
+	if (!text2)
+		text2 = "", len2 = 0;
+
+	prefix = dmp_common_prefix(text1, len1, text2, len2);
+	suffix = dmp_common_suffix(
+		text1 + prefix, len1 - prefix, text2 + prefix, len2 - prefix);
+	n = len1 - prefix - suffix;
+	m = len2 - prefix - suffix;
+
+	if (diff_ptr) {
+		*diff_ptr = NULL;
+		return edit_diff(
+			distance, diff_ptr, text1, len1, text2, len2, prefix, suffix);
+	}
+
+	if (!n || !m) {
+		*distance = n + m;
+		return 0;
+	}
+
+	/* the LCS is the same both ways, so the shorter text takes the bits */
+	if (n <= m) {
+		if (bp_init(&bp, text1 + prefix, n, text2 + prefix, m, 0) < 0)
+			return -1;
+	} else if (bp_init(&bp, text2 + prefix, m, text1 + prefix, n, 0) < 0)
+		return -1;
+
+	bp_run(&bp);
+	*distance = n + m - 2 * bp_lcs(&bp);
+
+	bp_free(&bp);
+	return 0;
+}
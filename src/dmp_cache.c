@@ -0,0 +1,329 @@
+/**
+ * dmp_cache.c
+ *
+ * LRU cache of finished diffs keyed by content hashes of the two texts
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_diff.h"
+#include "dmp_atomic.h"
+
+#define MIN_BUCKETS	16
+
+typedef struct cache_entry cache_entry;
+
+struct cache_entry {
+	/* key */
+	uint64_t h1, h2, hopts;
+	uint32_t l1, l2;
+	/* value */
+	dmp_diff *diff;
+	int status;
+	size_t bytes;
+	/* hash chain and LRU list (head is most recently used) */
+	cache_entry *chain, *newer, *older;
+};
+
+struct dmp_cache {
+	cache_entry **buckets;
+	uint32_t n_buckets, count;
+	size_t bytes, max_bytes;
+	uint32_t hunks_hwm; /* most hunks of any diff made here so far */
+	cache_entry *newest, *oldest;
+};
+
+/* hash only the options that change the diff that gets generated */
+static uint64_t options_hash(const dmp_options *opts)
+{
+	dmp_options defaults;
+	uint32_t key[7];
+
+	if (!opts) {
+		dmp_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	memcpy(&key[0], &opts->timeout, sizeof(key[0]));
+	key[1] = (uint32_t)opts->check_lines;
+	key[2] = (uint32_t)opts->trim_common_prefix;
+	key[3] = (uint32_t)opts->trim_common_suffix;
+	key[4] = (uint32_t)opts->algorithm;
+	key[5] = opts->max_edits;
+	key[6] = opts->move_min_len;
+
+	return dmp_hash64(key, sizeof(key), 0);
+}
+
+static uint32_t bucket_of(const dmp_cache *cache, uint64_t h1, uint64_t h2)
+{
+	return (uint32_t)((h1 ^ (h2 * 31)) & (cache->n_buckets - 1));
+}
+
+static void lru_unlink(dmp_cache *cache, cache_entry *e)
+{
+	if (e->newer)
+		e->newer->older = e->older;
+	else
+		cache->newest = e->older;
+	if (e->older)
+		e->older->newer = e->newer;
+	else
+		cache->oldest = e->newer;
+	e->newer = e->older = NULL;
+}
+
+static void lru_push(dmp_cache *cache, cache_entry *e)
+{
+	e->newer = NULL;
+	e->older = cache->newest;
+	if (cache->newest)
+		cache->newest->newer = e;
+	else
+		cache->oldest = e;
+	cache->newest = e;
+}
+
+static void entry_remove(dmp_cache *cache, cache_entry *e)
+{
+	cache_entry **scan = &cache->buckets[bucket_of(cache, e->h1, e->h2)];
+
+	while (*scan != e)
+		scan = &(*scan)->chain;
+	*scan = e->chain;
+
+	lru_unlink(cache, e);
+	cache->count--;
+	cache->bytes -= e->bytes;
+
+	/* drops the cache's reference; callers may still hold the diff */
+	dmp_diff_free(e->diff);
+	free(e);
+}
+
+static void grow_buckets(dmp_cache *cache)
+{
+	uint32_t i, old_n = cache->n_buckets;
+	cache_entry **old = cache->buckets, *e, *next, **b;
+
+	b = calloc(old_n * 2, sizeof(cache_entry *));
+	if (!b)
+		return; /* longer chains are still correct */
+
+	cache->buckets   = b;
+	cache->n_buckets = old_n * 2;
+
+	for (i = 0; i < old_n; ++i) {
+		for (e = old[i]; e != NULL; e = next) {
+			uint32_t idx = bucket_of(cache, e->h1, e->h2);
+			next = e->chain;
+			e->chain = b[idx];
+			b[idx] = e;
+		}
+	}
+
+	free(old);
+}
+
+int dmp_cache_new(dmp_cache **cache_ptr, size_t max_bytes)
+{
+	dmp_cache *cache;
+
+	assert(cache_ptr);
+
+	*cache_ptr = cache = calloc(1, sizeof(dmp_cache));
+	if (!cache)
+		return -1;
+
+	cache->buckets = calloc(MIN_BUCKETS, sizeof(cache_entry *));
+	if (!cache->buckets) {
+		free(cache);
+		*cache_ptr = NULL;
+		return -1;
+	}
+
+	cache->n_buckets = MIN_BUCKETS;
+	cache->max_bytes = max_bytes;
+
+	return 0;
+}
+
+void dmp_cache_clear(dmp_cache *cache)
+{
+	while (cache->oldest)
+		entry_remove(cache, cache->oldest);
+}
+
+void dmp_cache_free(dmp_cache *cache)
+{
+	if (!cache)
+		return;
+
+	dmp_cache_clear(cache);
+
+	free(cache->buckets);
+	free(cache);
+}
+
+/* diff a private copy of the texts so the result outlives caller buffers */
+static int diff_owned(
+	dmp_diff **diff_ptr,
+	const dmp_options *opts,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	dmp_diff *diff;
+	char *copy = malloc((size_t)len1 + len2 + 1);
+	int error;
+
+	if (!copy)
+		return -1;
+
+	memcpy(copy, text1, len1);
+	memcpy(copy + len1, text2, len2);
+
+	error = dmp_diff_new(&diff, opts, copy, len1, copy + len1, len2);
+	if (error < 0) {
+		free(copy);
+		return error;
+	}
+
+	diff->owned = copy;
+
+	/* the engine's scratch and spare records are not needed once the
+	 * diff is finished, and would only count against the cache size
+	 */
+	free(diff->v1);
+	diff->v1 = NULL;
+	diff->v_alloc = 0;
+	free(diff->engine.stack);
+	diff->engine.stack = NULL;
+	diff->engine.alloc = 0;
+	dmp_pool_shrink(&diff->pool);
+
+	*diff_ptr = diff;
+	return error;
+}
+
+/* equal hashes may still be a collision, so check against the copy */
+static int entry_matches(
+	const cache_entry *e,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	const char *owned = e->diff->owned;
+
+	return (!len1 || !memcmp(owned, text1, len1)) &&
+		(!len2 || !memcmp(owned + len1, text2, len2));
+}
+
+int dmp_cache_diff(
+	dmp_diff **diff_ptr,
+	dmp_cache *cache,
+	const dmp_options *options,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	dmp_options opts;
+	uint64_t h1, h2, hopts;
+	cache_entry *e;
+	dmp_diff *diff;
+	int error;
+
+	assert(diff_ptr && cache);
+
+	*diff_ptr = NULL;
+
+	/* too big to ever fit; do not bother hashing or copying */
+	if ((size_t)len1 + len2 > cache->max_bytes)
+		return dmp_diff_new(diff_ptr, options, text1, len1, text2, len2);
+
+	if (options)
+		memcpy(&opts, options, sizeof(opts));
+	else
+		dmp_options_init(&opts);
+
+	h1 = opts.text1_hash ? opts.text1_hash : dmp_hash64(text1, len1, 0);
+	h2 = opts.text2_hash ? opts.text2_hash : dmp_hash64(text2, len2, 0);
+	hopts = options_hash(&opts);
+
+	for (e = cache->buckets[bucket_of(cache, h1, h2)]; e; e = e->chain) {
+		if (e->h1 == h1 && e->h2 == h2 && e->hopts == hopts &&
+			e->l1 == len1 && e->l2 == len2 &&
+			entry_matches(e, text1, len1, text2, len2))
+		{
+			lru_unlink(cache, e);
+			lru_push(cache, e);
+			dmp_atomic_inc(&e->diff->refs);
+			*diff_ptr = e->diff;
+			return e->status;
+		}
+	}
+
+	/* size the records for the biggest diff seen so far (the hashes in
+	 * the options are only ever the caller's own)
+	 */
+	if (!opts.expected_hunks)
+		opts.expected_hunks = cache->hunks_hwm;
+
+	error = diff_owned(&diff, &opts, text1, len1, text2, len2);
+	if (error < 0)
+		return error;
+
+	*diff_ptr = diff;
+
+	if (dmp_diff_hunks(diff) > cache->hunks_hwm)
+		cache->hunks_hwm = dmp_diff_hunks(diff);
+
+	/* a diff cut short by the deadline might do better next time */
+	if (diff->stats.timed_out)
+		return error;
+
+	if ((e = calloc(1, sizeof(cache_entry))) == NULL)
+		return error;
+
+	e->h1 = h1;
+	e->h2 = h2;
+	e->hopts = hopts;
+	e->l1 = len1;
+	e->l2 = len2;
+	e->diff = diff;
+	e->status = error;
+	e->bytes = sizeof(cache_entry) + sizeof(dmp_diff) + len1 + len2 +
+		(diff->pool.borrowed ? 0 : diff->pool.pool_size * sizeof(dmp_node));
+
+	if (e->bytes > cache->max_bytes) {
+		free(e);
+		return error;
+	}
+
+	while (cache->oldest && cache->bytes + e->bytes > cache->max_bytes)
+		entry_remove(cache, cache->oldest);
+
+	if (cache->count >= cache->n_buckets)
+		grow_buckets(cache);
+
+	e->chain = cache->buckets[bucket_of(cache, h1, h2)];
+	cache->buckets[bucket_of(cache, h1, h2)] = e;
+	lru_push(cache, e);
+	cache->count++;
+	cache->bytes += e->bytes;
+
+	/* one reference for the cache and one for the caller */
+	dmp_atomic_inc(&diff->refs);
+
+	return error;
+}
@@ -0,0 +1,350 @@
+/**
+ * dmp_cpu.c
+ *
+ * Runtime selection of the byte comparison kernels
+ *
+ * The common prefix and suffix scans (which also extend the snakes of
+ * the bisect), the substring search and the scan for record separators
+ * are built for each x86 level, one
+ * block of bytes per compare: 16 with SSE2, 32 with AVX2 and 64 with
+ * AVX-512BW.  The first call picks the widest level that the CPU (and OS)
+ * supports.  Set DMP_CPU to "generic", "sse2", "avx2" or "avx512" to use
+ * a lower level instead, such as when comparing them in benchmarks.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_cpu.h"
+#include "dmp_atomic.h"
+
+#define dmp_min(A,B)      (((A) < (B)) ? (A) : (B))
+
+/* compare 8 bytes at a time and finish off the mismatch byte by byte */
+static uint32_t prefix_generic(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+	uint64_t a, b;
+
+	for (; n + 8 <= len; n += 8) {
+		memcpy(&a, t1 + n, sizeof(a));
+		memcpy(&b, t2 + n, sizeof(b));
+		if (a != b)
+			break;
+	}
+
+	for (; n < len && t1[n] == t2[n]; n++);
+
+	return n;
+}
+
+static uint32_t suffix_generic(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+	const char *e1 = t1 + l1, *e2 = t2 + l2;
+	uint64_t a, b;
+
+	for (; n + 8 <= len; n += 8) {
+		memcpy(&a, e1 - n - 8, sizeof(a));
+		memcpy(&b, e2 - n - 8, sizeof(b));
+		if (a != b)
+			break;
+	}
+
+	for (; n < len && *(e1 - n - 1) == *(e2 - n - 1); n++);
+
+	return n;
+}
+
+static uint32_t find_generic(
+	const char *text, uint32_t len, char c, uint32_t base, uint32_t *pos)
+{
+	const char *scan = text, *end = text + len;
+	uint32_t n = 0;
+
+	while (scan < end && (scan = memchr(scan, c, end - scan)) != NULL) {
+		if (pos)
+			pos[n] = base + (uint32_t)(scan - text);
+		n++;
+		scan++;
+	}
+
+	return n;
+}
+
+/* the bits of a block mask in ascending order */
+#define FIND_BITS(MASK, CTZ, AT) \
+	for (; MASK; MASK &= MASK - 1, n++) \
+		if (pos) \
+			pos[n] = base + (AT) + CTZ(MASK)
+
+#ifdef DMP_CPU_X86
+
+DMP_TARGET("sse2")
+static uint32_t prefix_sse2(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+
+	for (; n + 16 <= len; n += 16) {
+		uint32_t same = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *)(t1 + n)),
+			_mm_loadu_si128((const __m128i *)(t2 + n))));
+		if (same != 0xffff)
+			return n + dmp_ctz32(~same);
+	}
+
+	return n + prefix_generic(t1 + n, len - n, t2 + n, len - n);
+}
+
+DMP_TARGET("sse2")
+static uint32_t suffix_sse2(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+	const char *e1 = t1 + l1, *e2 = t2 + l2;
+
+	for (; n + 16 <= len; n += 16) {
+		uint32_t same = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *)(e1 - n - 16)),
+			_mm_loadu_si128((const __m128i *)(e2 - n - 16))));
+		if (same != 0xffff)
+			return n + dmp_clz32(~same & 0xffff) - 16;
+	}
+
+	return n + suffix_generic(e1 - len, len - n, e2 - len, len - n);
+}
+
+DMP_TARGET("avx2")
+static uint32_t prefix_avx2(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+
+	for (; n + 32 <= len; n += 32) {
+		uint32_t same = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *)(t1 + n)),
+			_mm256_loadu_si256((const __m256i *)(t2 + n))));
+		if (same != 0xffffffffu)
+			return n + dmp_ctz32(~same);
+	}
+
+	return n + prefix_sse2(t1 + n, len - n, t2 + n, len - n);
+}
+
+DMP_TARGET("avx2")
+static uint32_t suffix_avx2(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+	const char *e1 = t1 + l1, *e2 = t2 + l2;
+
+	for (; n + 32 <= len; n += 32) {
+		uint32_t same = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *)(e1 - n - 32)),
+			_mm256_loadu_si256((const __m256i *)(e2 - n - 32))));
+		if (same != 0xffffffffu)
+			return n + dmp_clz32(~same);
+	}
+
+	return n + suffix_sse2(e1 - len, len - n, e2 - len, len - n);
+}
+
+DMP_TARGET("sse2")
+static uint32_t find_sse2(
+	const char *text, uint32_t len, char c, uint32_t base, uint32_t *pos)
+{
+	__m128i want = _mm_set1_epi8(c);
+	uint32_t at = 0, n = 0;
+
+	for (; at + 16 <= len; at += 16) {
+		uint32_t hits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *)(text + at)), want));
+		FIND_BITS(hits, dmp_ctz32, at);
+	}
+
+	return n + find_generic(
+		text + at, len - at, c, base + at, pos ? pos + n : NULL);
+}
+
+DMP_TARGET("avx2")
+static uint32_t find_avx2(
+	const char *text, uint32_t len, char c, uint32_t base, uint32_t *pos)
+{
+	__m256i want = _mm256_set1_epi8(c);
+	uint32_t at = 0, n = 0;
+
+	for (; at + 32 <= len; at += 32) {
+		uint32_t hits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *)(text + at)), want));
+		FIND_BITS(hits, dmp_ctz32, at);
+	}
+
+	return n + find_sse2(
+		text + at, len - at, c, base + at, pos ? pos + n : NULL);
+}
+
+/* masked loads cover the tail, so there is no scalar loop at all */
+DMP_TARGET("avx512bw")
+static uint32_t prefix_avx512(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+
+	for (; n < len; n += 64) {
+		__mmask64 live = (len - n >= 64) ?
+			~(__mmask64)0 : (((__mmask64)1 << (len - n)) - 1);
+		__mmask64 diff = _mm512_mask_cmpneq_epi8_mask(live,
+			_mm512_maskz_loadu_epi8(live, t1 + n),
+			_mm512_maskz_loadu_epi8(live, t2 + n));
+		if (diff)
+			return n + dmp_ctz64(diff);
+	}
+
+	return len;
+}
+
+DMP_TARGET("avx512bw")
+static uint32_t suffix_avx512(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0, len = dmp_min(l1, l2);
+	const char *e1 = t1 + l1, *e2 = t2 + l2;
+
+	for (; n + 64 <= len; n += 64) {
+		__mmask64 diff = _mm512_cmpneq_epi8_mask(
+			_mm512_loadu_si512((const void *)(e1 - n - 64)),
+			_mm512_loadu_si512((const void *)(e2 - n - 64)));
+		if (diff)
+			return n + dmp_clz64(diff);
+	}
+
+	if (n < len) {
+		/* the last bytes sit at the top of a block that starts before
+		 * the texts do, so mask off the bytes in front of them
+		 */
+		uint32_t rest = len - n;
+		__mmask64 live = ~(__mmask64)0 << (64 - rest);
+		__mmask64 diff = _mm512_mask_cmpneq_epi8_mask(live,
+			_mm512_maskz_loadu_epi8(live, e1 - n - 64),
+			_mm512_maskz_loadu_epi8(live, e2 - n - 64));
+		return diff ? n + dmp_clz64(diff) : len;
+	}
+
+	return len;
+}
+
+DMP_TARGET("avx512bw")
+static uint32_t find_avx512(
+	const char *text, uint32_t len, char c, uint32_t base, uint32_t *pos)
+{
+	__m512i want = _mm512_set1_epi8(c);
+	uint32_t at, n = 0;
+
+	for (at = 0; at < len; at += 64) {
+		__mmask64 live = (len - at >= 64) ?
+			~(__mmask64)0 : (((__mmask64)1 << (len - at)) - 1);
+		uint64_t hits = _mm512_mask_cmpeq_epi8_mask(live,
+			_mm512_maskz_loadu_epi8(live, text + at), want);
+		FIND_BITS(hits, dmp_ctz64, at);
+	}
+
+	return n;
+}
+
+#endif
+
+static const dmp_kernels g_kernels[DMP_CPU_LEVELS] = {
+	{ "generic", prefix_generic, suffix_generic, dmp_strstr_generic,
+		find_generic },
+#ifdef DMP_CPU_X86
+	{ "sse2",    prefix_sse2,    suffix_sse2,    dmp_strstr_sse2,
+		find_sse2 },
+	{ "avx2",    prefix_avx2,    suffix_avx2,    dmp_strstr_avx2,
+		find_avx2 },
+	{ "avx512",  prefix_avx512,  suffix_avx512,  dmp_strstr_avx512,
+		find_avx512 },
+#endif
+};
+
+/* highest level the CPU and OS support */
+static dmp_cpu_level cpu_detect(void)
+{
+#if defined(DMP_CPU_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw"))
+		return DMP_CPU_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return DMP_CPU_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return DMP_CPU_SSE2;
+#elif defined(DMP_CPU_X86)
+	int info[4];
+	uint64_t xcr0 = 0;
+
+	__cpuid(info, 1);
+	if (info[2] & (1 << 27)) /* OSXSAVE */
+		xcr0 = _xgetbv(0);
+
+	__cpuidex(info, 7, 0);
+	if ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 30)))
+		return DMP_CPU_AVX512;
+	if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)))
+		return DMP_CPU_AVX2;
+	return DMP_CPU_SSE2; /* always there on x64 */
+#endif
+	return DMP_CPU_GENERIC;
+}
+
+static dmp_cpu_level cpu_choose(void)
+{
+	dmp_cpu_level level = cpu_detect();
+	const char *force = getenv("DMP_CPU");
+	int i;
+
+	if (!force)
+		return level;
+
+	/* only ever go down: forcing a level the CPU lacks would crash */
+	for (i = 0; i < (int)level; ++i)
+		if (!strcmp(force, g_kernels[i].name))
+			return (dmp_cpu_level)i;
+
+	return level;
+}
+
+/* DMP_CPU_LEVELS until the first call has chosen */
+static uint32_t g_level = DMP_CPU_LEVELS;
+
+const dmp_kernels *dmp_cpu_kernels(void)
+{
+	uint32_t level = dmp_atomic_load(&g_level);
+
+	/* threads racing here all come up with the same answer */
+	if (level == DMP_CPU_LEVELS) {
+		level = cpu_choose();
+		dmp_atomic_store(&g_level, level);
+	}
+
+	return &g_kernels[level];
+}
+
+const dmp_kernels *dmp_cpu_kernels_at(dmp_cpu_level level)
+{
+	if (level >= DMP_CPU_LEVELS || level > cpu_detect())
+		return NULL;
+
+	return &g_kernels[level];
+}
+
+const char *dmp_cpu_name(void)
+{
+	return dmp_cpu_kernels()->name;
+}
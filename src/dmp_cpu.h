@@ -0,0 +1,134 @@
+/**
+ * dmp_cpu.h
+ *
+ * Byte comparison kernels built for several x86 instruction sets, and the
+ * table that picks the best of them for the running CPU (see dmp_cpu.c)
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#ifndef INCLUDE_H_dmp_cpu
+#define INCLUDE_H_dmp_cpu
+
+#include <stdint.h>
+
+/* Compilers that can build a function for an instruction set that the
+ * rest of the file is not built for.  Elsewhere only the generic kernels
+ * exist.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DMP_CPU_X86 1
+#define DMP_TARGET(ISA) __attribute__((target(ISA)))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define DMP_CPU_X86 1
+#define DMP_TARGET(ISA)
+#endif
+
+#ifdef DMP_CPU_X86
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+typedef enum {
+	DMP_CPU_GENERIC = 0,
+	DMP_CPU_SSE2,
+	DMP_CPU_AVX2,
+	DMP_CPU_AVX512,
+	DMP_CPU_LEVELS
+} dmp_cpu_level;
+
+typedef uint32_t (*dmp_common_fn)(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2);
+
+/* store base + i for each i where text[i] == c into pos (unless it is
+ * NULL) and return how many there are
+ */
+typedef uint32_t (*dmp_find_fn)(
+	const char *text, uint32_t len, char c, uint32_t base, uint32_t *pos);
+
+typedef const char *(*dmp_strstr_fn)(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln);
+
+typedef struct {
+	const char *name;
+	dmp_common_fn common_prefix;
+	dmp_common_fn common_suffix;
+	/* only called with 2 <= ln <= lh */
+	dmp_strstr_fn strstr;
+	dmp_find_fn find_all;
+} dmp_kernels;
+
+/* The kernels for the running CPU, or for the level named by the DMP_CPU
+ * environment variable if the CPU supports it.  Chosen on the first call.
+ */
+extern const dmp_kernels *dmp_cpu_kernels(void);
+
+/* The kernels of one level, or NULL if the CPU cannot run them */
+extern const dmp_kernels *dmp_cpu_kernels_at(dmp_cpu_level level);
+
+extern const char *dmp_strstr_generic(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln);
+
+#ifdef DMP_CPU_X86
+extern const char *dmp_strstr_sse2(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln);
+extern const char *dmp_strstr_avx2(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln);
+extern const char *dmp_strstr_avx512(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln);
+#endif
+
+/* index of the lowest and the highest set bit of a non-zero mask */
+#if defined(__GNUC__)
+#define dmp_ctz32(M)	((uint32_t)__builtin_ctz(M))
+#define dmp_ctz64(M)	((uint32_t)__builtin_ctzll(M))
+#define dmp_clz32(M)	((uint32_t)__builtin_clz(M))
+#define dmp_clz64(M)	((uint32_t)__builtin_clzll(M))
+#elif defined(_MSC_VER)
+static __inline uint32_t dmp_ctz32(uint32_t m)
+{
+	unsigned long n;
+	_BitScanForward(&n, m);
+	return (uint32_t)n;
+}
+static __inline uint32_t dmp_clz32(uint32_t m)
+{
+	unsigned long n;
+	_BitScanReverse(&n, m);
+	return 31 - (uint32_t)n;
+}
+#ifdef _M_X64
+static __inline uint32_t dmp_ctz64(uint64_t m)
+{
+	unsigned long n;
+	_BitScanForward64(&n, m);
+	return (uint32_t)n;
+}
+static __inline uint32_t dmp_clz64(uint64_t m)
+{
+	unsigned long n;
+	_BitScanReverse64(&n, m);
+	return 63 - (uint32_t)n;
+}
+#endif
+#endif
+
+/* number of set bits in a mask */
+#if defined(__GNUC__)
+#define dmp_popcount64(M)	((uint32_t)__builtin_popcountll(M))
+#else
+static __inline uint32_t dmp_popcount64(uint64_t m)
+{
+	m = m - ((m >> 1) & 0x5555555555555555ULL);
+	m = (m & 0x3333333333333333ULL) + ((m >> 2) & 0x3333333333333333ULL);
+	m = (m + (m >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (uint32_t)((m * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+#endif
@@ -0,0 +1,634 @@
+/**
+ * dmp_delta.c
+ *
+ * Serialize diffs as compact deltas and apply them to rebuild text2
+ *
+ * The binary delta is a byte stream of LEB128 varints:
+ *
+ *     version, len1, len2, { (len << 2) | op, [len literal bytes] }*
+ *
+ * where op is COPY (an EQUAL taken from text1), SKIP (a DELETE of text1)
+ * or ADD (an INSERT, followed by its literal bytes).  COPY and SKIP do not
+ * need an offset, since hunks consume text1 in order.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_diff.h"
+
+#define BINARY_VERSION	1
+
+enum {
+	BIN_COPY = 0,
+	BIN_SKIP = 1,
+	BIN_ADD  = 2
+};
+
+static uint32_t varint_size(uint32_t val)
+{
+	uint32_t n = 1;
+	while (val >= 0x80) {
+		val >>= 7;
+		n++;
+	}
+	return n;
+}
+
+static unsigned char *varint_put(unsigned char *out, uint32_t val)
+{
+	while (val >= 0x80) {
+		*out++ = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	*out++ = (unsigned char)val;
+	return out;
+}
+
+/* decode one varint, returning NULL if it is truncated or overlong */
+static const unsigned char *varint_get(
+	const unsigned char *in, const unsigned char *end, uint32_t *val)
+{
+	uint32_t v = 0;
+	int shift;
+
+	for (shift = 0; shift < 35 && in < end; shift += 7) {
+		unsigned char byte = *in++;
+		if (shift == 28 && byte > 0x0f)
+			return NULL;
+		v |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*val = v;
+			return in;
+		}
+	}
+
+	return NULL;
+}
+
+static uint32_t binary_op(int op)
+{
+	return (op == DMP_DIFF_EQUAL) ? BIN_COPY :
+		(op == DMP_DIFF_DELETE) ? BIN_SKIP : BIN_ADD;
+}
+
+int dmp_diff_to_binary(
+	char **delta, uint32_t *delta_len, const dmp_diff *diff)
+{
+	int pos;
+	const dmp_node *node;
+	uint64_t size;
+	unsigned char *out, *scan;
+
+	assert(delta && delta_len);
+
+	*delta = NULL;
+	*delta_len = 0;
+
+	if (diff->seq_size)
+		return -1;
+
+	size = 1 + varint_size(diff->l1) + varint_size(diff->l2);
+
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		/* lengths up to 2^30 fit alongside the op in one varint */
+		if (node->len > (UINT32_MAX >> 2))
+			return -1;
+		size += varint_size(node->len << 2);
+		if (node->op == DMP_DIFF_INSERT)
+			size += node->len;
+	}
+
+	if (size > UINT32_MAX)
+		return -1;
+
+	if ((out = malloc((size_t)size)) == NULL)
+		return -1;
+
+	scan = out;
+	*scan++ = BINARY_VERSION;
+	scan = varint_put(scan, diff->l1);
+	scan = varint_put(scan, diff->l2);
+
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		scan = varint_put(scan, (node->len << 2) | binary_op(node->op));
+		if (node->op == DMP_DIFF_INSERT) {
+			memcpy(scan, node->text, node->len);
+			scan += node->len;
+		}
+	}
+
+	assert((uint64_t)(scan - out) == size);
+
+	*delta = (char *)out;
+	*delta_len = (uint32_t)size;
+	return 0;
+}
+
+int dmp_binary_apply(
+	char **text2_ptr,
+	uint32_t *len2_ptr,
+	const char *text1,
+	uint32_t len1,
+	const char *delta,
+	uint32_t delta_len)
+{
+	const unsigned char *in = (const unsigned char *)delta;
+	const unsigned char *end = in + delta_len;
+	uint32_t l1, l2, at1 = 0, at2 = 0, word, len;
+	char *text2;
+
+	assert(text2_ptr && len2_ptr);
+
+	*text2_ptr = NULL;
+	*len2_ptr = 0;
+
+	if (!delta_len || *in++ != BINARY_VERSION ||
+		(in = varint_get(in, end, &l1)) == NULL ||
+		(in = varint_get(in, end, &l2)) == NULL ||
+		l1 != len1)
+		return -1;
+
+	/* one byte extra so the result can be used as a C string */
+	if ((text2 = malloc((size_t)l2 + 1)) == NULL)
+		return -1;
+
+	while (in < end) {
+		if ((in = varint_get(in, end, &word)) == NULL)
+			goto fail;
+		len = word >> 2;
+
+		switch (word & 3) {
+		case BIN_COPY:
+			if (len > l1 - at1 || len > l2 - at2)
+				goto fail;
+			memcpy(text2 + at2, text1 + at1, len);
+			at1 += len;
+			at2 += len;
+			break;
+		case BIN_SKIP:
+			if (len > l1 - at1)
+				goto fail;
+			at1 += len;
+			break;
+		case BIN_ADD:
+			if (len > l2 - at2 || len > (uint32_t)(end - in))
+				goto fail;
+			memcpy(text2 + at2, in, len);
+			in  += len;
+			at2 += len;
+			break;
+		default:
+			goto fail;
+		}
+	}
+
+	if (at1 != l1 || at2 != l2)
+		goto fail;
+
+	text2[l2] = '\0';
+	*text2_ptr = text2;
+	*len2_ptr = l2;
+	return 0;
+
+fail:
+	free(text2);
+	return -1;
+}
+
+/*
+ * Text delta, as in diff_toDelta / diff_fromDelta of the other ports:
+ *
+ *     =3<TAB>-2<TAB>+ing
+ *
+ * Lengths count UTF-16 code units like the JavaScript version, and the
+ * INSERT data is encoded like encodeURI() except that spaces are kept.
+ */
+
+/* bytes that encodeURI() leaves alone, plus space */
+static const unsigned char uri_safe[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+#define is_utf8_cont(C)	(((unsigned char)(C) & 0xC0) == 0x80)
+
+/* a piece of the diff that is whole UTF-8 characters on both sides */
+#define PIECE_BOTH	2
+
+typedef struct {
+	const char *text;
+	uint32_t len;
+	int op; /* dmp_operation_t or PIECE_BOTH for text deleted and inserted */
+} delta_piece;
+
+static uint32_t utf16_units(const char *text, uint32_t len)
+{
+	uint32_t i, units = 0;
+
+	for (i = 0; i < len; ++i) {
+		unsigned char ch = (unsigned char)text[i];
+		if (!is_utf8_cont(ch))
+			units += (ch >= 0xF0) ? 2 : 1;
+	}
+
+	return units;
+}
+
+/* does the text following an EQUAL continue a UTF-8 character? */
+static int splits_char(const dmp_pool *pool, const dmp_node *node)
+{
+	int seen_del = 0, seen_ins = 0;
+
+	for (; node->next >= 0; ) {
+		node = dmp_node_at(pool, node->next);
+		if (node->op == DMP_DIFF_EQUAL)
+			return is_utf8_cont(node->text[0]);
+		if (node->op == DMP_DIFF_DELETE && !seen_del++ &&
+			is_utf8_cont(node->text[0]))
+			return 1;
+		if (node->op == DMP_DIFF_INSERT && !seen_ins++ &&
+			is_utf8_cont(node->text[0]))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Byte-level diffs can put a hunk boundary inside a multibyte character,
+ * which the UTF-16 lengths cannot express.  Such EQUAL bytes are moved
+ * into the neighbouring edits as text that is both deleted and inserted.
+ */
+static delta_piece *split_pieces(const dmp_diff *diff, uint32_t *count)
+{
+	int pos;
+	const dmp_node *node;
+	uint32_t n = 0;
+	delta_piece *pieces =
+		malloc((3 * dmp_diff_hunks(diff) + 1) * sizeof(*pieces));
+
+	if (!pieces)
+		return NULL;
+
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		uint32_t lo = 0, hi = node->len;
+
+		if (node->op != DMP_DIFF_EQUAL) {
+			pieces[n].text = node->text;
+			pieces[n].len  = node->len;
+			pieces[n].op   = node->op;
+			n++;
+			continue;
+		}
+
+		while (lo < node->len && is_utf8_cont(node->text[lo]))
+			lo++;
+		if (lo < node->len && splits_char(&diff->pool, node)) {
+			hi = node->len - 1;
+			while (hi > lo && is_utf8_cont(node->text[hi]))
+				hi--;
+		}
+
+		if (lo > 0) {
+			pieces[n].text = node->text;
+			pieces[n].len  = lo;
+			pieces[n].op   = PIECE_BOTH;
+			n++;
+		}
+		if (hi > lo) {
+			pieces[n].text = node->text + lo;
+			pieces[n].len  = hi - lo;
+			pieces[n].op   = DMP_DIFF_EQUAL;
+			n++;
+		}
+		if (node->len > hi) {
+			pieces[n].text = node->text + hi;
+			pieces[n].len  = node->len - hi;
+			pieces[n].op   = PIECE_BOTH;
+			n++;
+		}
+	}
+
+	*count = n;
+	return pieces;
+}
+
+static uint32_t put_uint(char *out, uint32_t val)
+{
+	char digits[10];
+	uint32_t n = 0, i;
+
+	do {
+		digits[n++] = (char)('0' + val % 10);
+		val /= 10;
+	} while (val > 0);
+
+	if (out)
+		for (i = 0; i < n; ++i)
+			out[i] = digits[n - 1 - i];
+
+	return n;
+}
+
+static uint32_t put_uri(char *out, const char *text, uint32_t len)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < len; ++i) {
+		unsigned char ch = (unsigned char)text[i];
+
+		if (uri_safe[ch]) {
+			if (out)
+				out[n] = (char)ch;
+			n++;
+		} else {
+			if (out) {
+				out[n]     = '%';
+				out[n + 1] = hex_digits[ch >> 4];
+				out[n + 2] = hex_digits[ch & 0x0F];
+			}
+			n += 3;
+		}
+	}
+
+	return n;
+}
+
+/* append one token, or just measure it if `out` is NULL */
+static size_t put_token(
+	char *out, size_t size, char op, const char *text, uint32_t len,
+	uint32_t units)
+{
+	if (size > 0) {
+		if (out)
+			out[size] = '\t';
+		size++;
+	}
+
+	if (out)
+		out[size] = op;
+	size++;
+
+	if (op == '+')
+		return size + put_uri(out ? out + size : NULL, text, len);
+	return size + put_uint(out ? out + size : NULL, units);
+}
+
+/* write tokens for pieces, or just measure them if `out` is NULL */
+static size_t write_delta(char *out, const delta_piece *pieces, uint32_t n)
+{
+	uint32_t i, k, start = 0, del;
+	size_t size = 0;
+	int ins;
+
+	for (i = 0; i <= n; ++i) {
+		if (i < n && pieces[i].op != DMP_DIFF_EQUAL)
+			continue;
+
+		/* the edits since the last EQUAL become one "-" and one "+" */
+		del = 0;
+		ins = 0;
+		for (k = start; k < i; ++k) {
+			if (pieces[k].op != DMP_DIFF_INSERT)
+				del += utf16_units(pieces[k].text, pieces[k].len);
+			if (pieces[k].op != DMP_DIFF_DELETE)
+				ins = 1;
+		}
+
+		if (del > 0)
+			size = put_token(out, size, '-', NULL, 0, del);
+
+		for (k = start; k < i; ++k) {
+			if (pieces[k].op == DMP_DIFF_DELETE)
+				continue;
+			if (ins) {
+				size = put_token(
+					out, size, '+', pieces[k].text, pieces[k].len, 0);
+				ins = 0;
+			} else
+				size += put_uri(out ? out + size : NULL,
+					pieces[k].text, pieces[k].len);
+		}
+
+		if (i < n)
+			size = put_token(out, size, '=', NULL, 0,
+				utf16_units(pieces[i].text, pieces[i].len));
+
+		start = i + 1;
+	}
+
+	return size;
+}
+
+int dmp_diff_to_delta(
+	char **delta, uint32_t *delta_len, const dmp_diff *diff)
+{
+	delta_piece *pieces;
+	uint32_t count;
+	size_t size;
+
+	assert(delta && delta_len);
+
+	*delta = NULL;
+	*delta_len = 0;
+
+	if (diff->seq_size || (pieces = split_pieces(diff, &count)) == NULL)
+		return -1;
+
+	size = write_delta(NULL, pieces, count);
+
+	if (size >= UINT32_MAX || (*delta = malloc(size + 1)) == NULL) {
+		free(pieces);
+		return -1;
+	}
+
+	write_delta(*delta, pieces, count);
+	(*delta)[size] = '\0';
+	*delta_len = (uint32_t)size;
+
+	free(pieces);
+	return 0;
+}
+
+static int hex_value(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	return -1;
+}
+
+/* parse a decimal count, returning -1 if the token is not a number */
+static int64_t parse_count(const char *text, uint32_t len)
+{
+	int64_t val = 0;
+	uint32_t i;
+
+	if (!len || len > 10)
+		return -1;
+
+	for (i = 0; i < len; ++i) {
+		if (text[i] < '0' || text[i] > '9')
+			return -1;
+		val = val * 10 + (text[i] - '0');
+	}
+
+	return val;
+}
+
+/* convert a run of UTF-16 units of text1 into bytes */
+static int units_to_bytes(
+	uint32_t *bytes, const char *text, uint32_t len, uint32_t at,
+	int64_t units)
+{
+	uint32_t start = at;
+
+	while (units > 0 && at < len) {
+		unsigned char ch = (unsigned char)text[at++];
+		if (!is_utf8_cont(ch))
+			units -= (ch >= 0xF0) ? 2 : 1;
+		while (at < len && is_utf8_cont(text[at]))
+			at++;
+	}
+
+	/* out of text or the run ends between halves of a surrogate pair */
+	if (units != 0)
+		return -1;
+
+	*bytes = at - start;
+	return 0;
+}
+
+int dmp_diff_from_delta(
+	dmp_diff **diff_ptr,
+	const char *text1,
+	uint32_t    len1,
+	const char *delta,
+	uint32_t    delta_len)
+{
+	dmp_diff *diff;
+	const char *scan = delta, *end = delta + delta_len, *tab;
+	uint32_t tokens = 1, at1 = 0, at2 = 0, bytes;
+	char *ins;
+	int64_t units;
+
+	assert(diff_ptr);
+
+	*diff_ptr = NULL;
+
+	for (tab = delta; (tab = memchr(tab, '\t', end - tab)) != NULL; ++tab)
+		tokens++;
+
+	if ((diff = dmp_diff_alloc(NULL)) == NULL)
+		return -1;
+
+	/* a node per token plus the sentinel and the pool's reserved first
+	 * slot; insert data decodes to no more than its encoded size
+	 */
+	if (dmp_pool_alloc(&diff->pool, tokens + 2) < 0 ||
+		(diff->owned = ins = malloc((size_t)delta_len + 1)) == NULL)
+		goto fail;
+
+	/* the empty sentinel never reads its text; point it at `delta` rather
+	 * than the not yet written copy, which LTO builds warn about
+	 */
+	dmp_range_init(&diff->pool, &diff->list, DMP_DIFF_EQUAL, delta, 0, 0);
+
+	for (; scan < end; scan = tab + 1) {
+		const char *param;
+		uint32_t plen;
+
+		if ((tab = memchr(scan, '\t', end - scan)) == NULL)
+			tab = end;
+		if (tab == scan)
+			continue; /* blank tokens are ok */
+
+		param = scan + 1;
+		plen  = (uint32_t)(tab - param);
+
+		switch (*scan) {
+		case '+': {
+			char *start = ins;
+			uint32_t i;
+
+			for (i = 0; i < plen; ++i) {
+				if (param[i] == '%') {
+					int hi, lo;
+					if (i + 2 >= plen)
+						goto fail;
+					hi = hex_value(param[i + 1]);
+					lo = hex_value(param[i + 2]);
+					if (hi < 0 || lo < 0)
+						goto fail;
+					*ins++ = (char)((hi << 4) | lo);
+					i += 2;
+				} else
+					*ins++ = param[i];
+			}
+
+			dmp_range_insert(&diff->pool, &diff->list, -1,
+				DMP_DIFF_INSERT, start, 0, (uint32_t)(ins - start));
+			at2 += (uint32_t)(ins - start);
+			break;
+		}
+		case '-':
+		case '=':
+			if ((units = parse_count(param, plen)) < 0 ||
+				units_to_bytes(&bytes, text1, len1, at1, units) < 0)
+				goto fail;
+
+			dmp_range_insert(&diff->pool, &diff->list, -1,
+				(*scan == '-') ? DMP_DIFF_DELETE : DMP_DIFF_EQUAL,
+				text1, at1, bytes);
+			at1 += bytes;
+			if (*scan == '=')
+				at2 += bytes;
+			break;
+		default:
+			goto fail;
+		}
+	}
+
+	/* the delta must account for all of text1 */
+	if (at1 != len1)
+		goto fail;
+
+	diff->t1 = text1;
+	diff->l1 = len1;
+	diff->l2 = at2;
+
+	dmp_diff_tally(diff, &diff->list);
+
+	*diff_ptr = diff;
+	return 0;
+
+fail:
+	dmp_diff_free(diff);
+	return -1;
+}
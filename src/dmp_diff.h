@@ -0,0 +1,139 @@
+/**
+ * dmp_diff.h
+ *
+ * Internal definition of the diff object and the diff engine entry points
+ * shared between the source files of libdmp.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#ifndef INCLUDE_H_dmp_diff
+#define INCLUDE_H_dmp_diff
+
+#include "dmp.h"
+#include "dmp_pool.h"
+
+/* offsets just past one hunk, for mapping locations between texts, and
+ * the record holding the hunk, for starting an iteration part way in
+ */
+typedef struct {
+	uint32_t end1, end2;
+	int op;
+	dmp_pos pos;
+} dmp_map_entry;
+
+/* a part of the texts waiting on the engine's stack (see dmp.c): two
+ * texts to diff, or with `equal` set, text1 to emit as an EQUAL once the
+ * parts before it are done
+ */
+typedef struct {
+	const char *t1, *t2;
+	uint32_t l1, l2;
+	int equal;
+} dmp_work;
+
+/* state of the diff engine, kept in the diff so that it can stop between
+ * steps and take up the work again
+ */
+typedef struct {
+	dmp_range *out;
+	dmp_work *stack;
+	uint32_t depth, alloc;
+	/* the bisect in progress, whose contours are in diff->v1 */
+	int bisecting;
+	dmp_work cur;
+	int d, max_d, v_offset, v_length, delta, front;
+	int k1start, k1end, k2start, k2end;
+} dmp_engine;
+
+struct dmp_diff {
+	dmp_pool pool;
+	dmp_range list;
+	double deadline;
+	/* edit budget from options and edits emitted so far */
+	uint32_t max_edits, edits;
+	int too_different;
+	/* totals and engine counters reported by dmp_diff_stats */
+	dmp_stats stats;
+	/* nesting of dmp_diff_main inside the line, record and move diffs */
+	uint32_t depth;
+	/* original parameters */
+	const char *t1, *t2;
+	uint32_t l1, l2;
+	/* bytes per element of a dmp_diff_seq diff (whose lengths are all in
+	 * elements and whose texts are unset), 0 for a diff of texts
+	 */
+	uint32_t seq_size;
+	/* used by bisect; holds both contours of `v_alloc` entries each */
+	int *v1;
+	uint32_t v_alloc;
+	dmp_engine engine;
+	/* pool storage for diffs of identical texts */
+	dmp_node same[2];
+	/* extra holders of a shared (cached) diff and its private text copy;
+	 * `refs` is only changed atomically (see dmp_atomic.h)
+	 */
+	uint32_t refs;
+	char *owned;
+	/* built on first use by const readers, published with a CAS */
+	dmp_map_entry *map;
+#ifdef DMP_PROFILE
+	/* see dmp_profile.h */
+	dmp_profile profile;
+	uint64_t phase_start[DMP_PHASE_COUNT];
+	dmp_phase_callback phase_cb;
+	void *phase_cb_ref;
+#endif
+};
+
+/* Seconds on a monotonic-enough clock, for the `timeout` deadline */
+extern double dmp_time(void);
+
+/* Allocate an empty diff with deadline and budget set from the options */
+extern dmp_diff *dmp_diff_alloc(const dmp_options *opts);
+
+/* Byte-level Myers diff of two texts, appending hunks to a new range */
+extern int dmp_diff_main(
+	dmp_range *out, dmp_diff *diff, const dmp_options *opts,
+	const char *text1, uint32_t len1, const char *text2, uint32_t len2);
+
+/* Longest texts that dmp_diff_main hands to dmp_diff_bitpar */
+#define DMP_BITPAR_MAX	64
+
+/* Bit-parallel LCS diff of two texts, appending hunks to a range that
+ * already holds a sentinel; `lcs` gets the number of equal bytes (see
+ * dmp_bitpar.c)
+ */
+extern int dmp_diff_bitpar(
+	dmp_range *out, dmp_diff *diff,
+	const char *text1, uint32_t len1, const char *text2, uint32_t len2,
+	uint32_t *lcs);
+
+/* Merge adjacent hunks and shift single edits to eliminate equalities */
+extern int dmp_diff_cleanup_merge(dmp_diff *diff, dmp_range *list);
+
+/* Remove empty hunks from the finished list and total up its stats */
+extern void dmp_diff_tally(dmp_diff *diff, dmp_range *list);
+
+/* Line-oriented patience or histogram diff (see dmp_lines.c) */
+extern int dmp_diff_lines(
+	dmp_range *out, dmp_diff *diff, const dmp_options *opts,
+	const char *text1, uint32_t len1, const char *text2, uint32_t len2);
+
+/* Diff of the record hashes, refined inside changed records (see
+ * dmp_records.c)
+ */
+extern int dmp_diff_records(
+	dmp_range *out, dmp_diff *diff, const dmp_options *opts,
+	const char *text1, uint32_t len1, const char *text2, uint32_t len2);
+
+/* Diff anchored on long common blocks, with the blocks that moved tagged
+ * (see dmp_moves.c)
+ */
+extern int dmp_diff_moves(
+	dmp_range *out, dmp_diff *diff, const dmp_options *opts,
+	const char *text1, uint32_t len1, const char *text2, uint32_t len2);
+
+#endif
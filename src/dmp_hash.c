@@ -0,0 +1,105 @@
+/**
+ * dmp_hash.c
+ *
+ * Fast non-cryptographic 64-bit hash of text data
+ *
+ * This is the XXH64 algorithm by Yann Collet (BSD licensed reference at
+ * https://github.com/Cyan4973/xxHash), so values match other XXH64
+ * implementations and can be computed by clients in other languages.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include "dmp.h"
+
+#define PRIME64_1	0x9E3779B185EBCA87ULL
+#define PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3	0x165667B19E3779F9ULL
+#define PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define PRIME64_5	0x27D4EB2F165667C5ULL
+
+#define rotl64(X,R)	(((X) << (R)) | ((X) >> (64 - (R))))
+
+/* little-endian reads; compilers turn these into plain loads */
+static uint64_t read64(const unsigned char *p)
+{
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+		(uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+		(uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+		(uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc  = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static uint64_t hash_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= hash_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t dmp_hash64(const void *data, uint32_t len, uint64_t seed)
+{
+	const unsigned char *p = data, *end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		const unsigned char *limit = end - 32;
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+
+		do {
+			v1 = hash_round(v1, read64(p));
+			v2 = hash_round(v2, read64(p + 8));
+			v3 = hash_round(v3, read64(p + 16));
+			v4 = hash_round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = hash_merge(h, v1);
+		h = hash_merge(h, v2);
+		h = hash_merge(h, v3);
+		h = hash_merge(h, v4);
+	} else
+		h = seed + PRIME64_5;
+
+	h += len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= hash_round(0, read64(p));
+		h  = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME64_1;
+		h  = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= (*p) * PRIME64_5;
+		h  = rotl64(h, 11) * PRIME64_1;
+	}
+
+	/* final avalanche */
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,509 @@
+/**
+ * dmp_lines.c
+ *
+ * Line-oriented patience and histogram diff engines
+ *
+ * Both engines look for lines that are rare in both texts, use them as
+ * anchors to split the texts into smaller regions, and only fall back to
+ * the byte-level Myers diff for regions where no anchor can be found.
+ * As in the Myers engine, regions still to be diffed wait on a stack
+ * (leftmost on top) rather than in recursive calls, so nesting anchors
+ * as deep as the texts have lines cannot overflow the C stack.
+ * See Bram Cohen's description of patience diff and the histogram diff
+ * from jgit / git for the original algorithms.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include "dmp.h"
+#include "dmp_pool.h"
+#include "dmp_diff.h"
+#include <stdlib.h>
+
+/* lines occurring more often than this are never used as histogram anchors */
+#define MAX_CHAIN_LEN	64
+#define LINES_STACK	16
+
+typedef struct {
+	const char *text;
+	uint32_t len;
+	uint32_t hash;
+} dmp_line;
+
+/* occurrence table entry - one per distinct line in the current region */
+typedef struct {
+	const dmp_line *line;
+	int first_a, last_b;
+	uint32_t count_a, count_b;
+} line_slot;
+
+typedef struct {
+	line_slot *slots;
+	uint32_t mask;
+	int *next_a; /* chain to next equal line in a, indexed by (idx - a0) */
+} line_table;
+
+/* a region waiting to be diffed, a[a0,a1) against b[b0,b1), or with
+ * `equal` set, lines a[a0,a1) to emit as unchanged
+ */
+typedef struct {
+	int a0, a1, b0, b1;
+	int equal;
+} line_work;
+
+typedef struct {
+	dmp_diff *diff;
+	const dmp_options *opts;
+	dmp_range *out;
+	dmp_line *a, *b;
+	int algorithm;
+	line_work *stack;
+	uint32_t depth, alloc;
+} line_ctx;
+
+static int lines_push(
+	line_ctx *ctx, int a0, int a1, int b0, int b1, int equal)
+{
+	line_work *w;
+
+	/* nothing to do, so nothing to push */
+	if (a0 == a1 && (equal || b0 == b1))
+		return 0;
+
+	if (ctx->depth == ctx->alloc) {
+		uint32_t alloc = ctx->alloc ? 2 * ctx->alloc : LINES_STACK;
+		line_work *grown = realloc(ctx->stack, alloc * sizeof(*grown));
+		if (!grown)
+			return (ctx->diff->pool.error = -1);
+		ctx->stack = grown;
+		ctx->alloc = alloc;
+	}
+
+	w = &ctx->stack[ctx->depth++];
+	w->a0 = a0;
+	w->a1 = a1;
+	w->b0 = b0;
+	w->b1 = b1;
+	w->equal = equal;
+	return 0;
+}
+
+static uint32_t line_hash(const char *text, uint32_t len)
+{
+	uint32_t hash = 2166136261u; /* FNV-1a */
+
+	while (len-- > 0)
+		hash = (hash ^ (unsigned char)*text++) * 16777619u;
+
+	return hash;
+}
+
+static int split_lines(
+	dmp_line **lines_ptr, int *count, const char *text, uint32_t len)
+{
+	const char *scan = text, *end = text + len, *eol;
+	dmp_line *lines;
+	int n = 0;
+
+	for (eol = text; eol < end && (eol = memchr(eol, '\n', end - eol)); eol++)
+		n++;
+	if (len > 0 && text[len - 1] != '\n')
+		n++;
+
+	*lines_ptr = lines = malloc((n + 1) * sizeof(dmp_line));
+	if (!lines)
+		return -1;
+
+	for (n = 0; scan < end; scan = eol, n++) {
+		eol = memchr(scan, '\n', end - scan);
+		eol = eol ? eol + 1 : end;
+
+		lines[n].text = scan;
+		lines[n].len  = (uint32_t)(eol - scan);
+		lines[n].hash = line_hash(scan, lines[n].len);
+	}
+
+	*count = n;
+	return 0;
+}
+
+static int line_eq(const dmp_line *a, const dmp_line *b)
+{
+	return a->hash == b->hash && a->len == b->len &&
+		!memcmp(a->text, b->text, a->len);
+}
+
+static line_slot *table_slot(line_table *table, const dmp_line *line)
+{
+	uint32_t pos = line->hash & table->mask;
+
+	for (;; pos = (pos + 1) & table->mask) {
+		line_slot *slot = &table->slots[pos];
+		if (!slot->line || line_eq(slot->line, line))
+			return slot;
+	}
+}
+
+/* build occurrence table of lines in a[a0..a1) and b[b0..b1) */
+static int table_build(
+	line_table *table, line_ctx *ctx, int a0, int a1, int b0, int b1)
+{
+	uint32_t size = 16;
+	int i;
+
+	while (size < 2 * (uint32_t)(a1 - a0 + b1 - b0))
+		size <<= 1;
+
+	table->mask   = size - 1;
+	table->slots  = calloc(size, sizeof(line_slot));
+	table->next_a = malloc((a1 - a0 + 1) * sizeof(int));
+
+	if (!table->slots || !table->next_a) {
+		free(table->slots);
+		free(table->next_a);
+		return -1;
+	}
+
+	/* walk backwards so that chains are in ascending order */
+	for (i = a1 - 1; i >= a0; --i) {
+		line_slot *slot = table_slot(table, &ctx->a[i]);
+		if (!slot->line) {
+			slot->line = &ctx->a[i];
+			slot->first_a = -1;
+		}
+		table->next_a[i - a0] = slot->first_a;
+		slot->first_a = i;
+		slot->count_a++;
+	}
+
+	for (i = b0; i < b1; ++i) {
+		line_slot *slot = table_slot(table, &ctx->b[i]);
+		if (slot->line) {
+			slot->last_b = i;
+			slot->count_b++;
+		}
+	}
+
+	return 0;
+}
+
+static void table_free(line_table *table)
+{
+	free(table->slots);
+	free(table->next_a);
+}
+
+static uint32_t min_count(
+	line_table *table, const dmp_line *line, uint32_t count)
+{
+	uint32_t other = (count > 1) ? table_slot(table, line)->count_a : count;
+	return (other < count) ? other : count;
+}
+
+static void emit_equal(line_ctx *ctx, int a0, int a1)
+{
+	dmp_pool *pool = &ctx->diff->pool;
+	const char *text;
+	uint32_t len = 0;
+	dmp_node *last;
+
+	if (a0 >= a1)
+		return;
+
+	for (text = ctx->a[a0].text; a0 < a1; ++a0)
+		len += ctx->a[a0].len;
+
+	/* a failure stays in pool->error for the caller to report */
+	if (dmp_pool_reserve(pool, 1) < 0)
+		return;
+
+	last = dmp_node_at(pool, ctx->out->end);
+
+	if (last->op == DMP_DIFF_EQUAL && last->text + last->len == text)
+		last->len += len;
+	else
+		dmp_range_insert(
+			pool, ctx->out, -1, DMP_DIFF_EQUAL, text, 0, len);
+}
+
+/* fall back to byte-level Myers diff for a region without anchors */
+static int emit_bytes(line_ctx *ctx, int a0, int a1, int b0, int b1)
+{
+	const char *t1 = NULL, *t2 = NULL;
+	uint32_t l1 = 0, l2 = 0;
+	dmp_range sub;
+	int i;
+
+	if (a0 < a1)
+		t1 = ctx->a[a0].text;
+	for (i = a0; i < a1; ++i)
+		l1 += ctx->a[i].len;
+
+	if (b0 < b1)
+		t2 = ctx->b[b0].text;
+	for (i = b0; i < b1; ++i)
+		l2 += ctx->b[i].len;
+
+	if (dmp_diff_main(&sub, ctx->diff, ctx->opts, t1, l1, t2, l2) < 0)
+		return -1;
+
+	if (sub.start >= 0)
+		dmp_range_splice(&ctx->diff->pool, ctx->out, -1, &sub);
+
+	return ctx->diff->pool.error;
+}
+
+/* longest increasing subsequence of b positions of lines unique to both;
+ * anchors are returned as (a, b) index pairs in ascending order
+ */
+static int patience_anchors(
+	line_ctx *ctx, int a0, int a1, int b0, int b1, int **anchors, int *count)
+{
+	line_table table;
+	int *pairs, *ua, *ub, *tails, *prev, n = 0, len = 0, i, k;
+
+	if (table_build(&table, ctx, a0, a1, b0, b1) < 0)
+		return -1;
+
+	pairs = malloc(6 * (a1 - a0) * sizeof(int));
+	if (!pairs) {
+		table_free(&table);
+		return -1;
+	}
+	ua    = pairs + 2 * (a1 - a0);
+	ub    = ua + (a1 - a0);
+	tails = ub + (a1 - a0);
+	prev  = tails + (a1 - a0);
+
+	for (i = a0; i < a1; ++i) {
+		line_slot *slot = table_slot(&table, &ctx->a[i]);
+		if (slot->count_a == 1 && slot->count_b == 1) {
+			ua[n] = i;
+			ub[n] = slot->last_b;
+			n++;
+		}
+	}
+
+	table_free(&table);
+
+	/* patience sort - tails[k] is the index of the smallest b value that
+	 * ends an increasing run of length k + 1
+	 */
+	for (i = 0; i < n; ++i) {
+		int lo = 0, hi = len;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (ub[tails[mid]] < ub[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[i] = lo > 0 ? tails[lo - 1] : -1;
+		tails[lo] = i;
+		if (lo == len)
+			len++;
+	}
+
+	for (i = len - 1, k = len > 0 ? tails[len - 1] : -1; i >= 0; --i) {
+		pairs[2 * i]     = ua[k];
+		pairs[2 * i + 1] = ub[k];
+		k = prev[k];
+	}
+
+	*anchors = pairs;
+	*count = len;
+	return 0;
+}
+
+/* push the regions between the anchors, and the anchors themselves, from
+ * the last one back so that the first region ends up on top
+ */
+static int patience_diff(line_ctx *ctx, int a0, int a1, int b0, int b1)
+{
+	int *anchors, count, i, error;
+
+	if (patience_anchors(ctx, a0, a1, b0, b1, &anchors, &count) < 0)
+		return -1;
+
+	if (!count) {
+		free(anchors);
+		return emit_bytes(ctx, a0, a1, b0, b1);
+	}
+
+	for (i = count - 1, error = 0; i >= 0 && !error; --i) {
+		int ai = anchors[2 * i], bi = anchors[2 * i + 1];
+
+		error = lines_push(ctx, ai + 1, a1, bi + 1, b1, 0);
+		if (!error)
+			error = lines_push(ctx, ai, ai + 1, bi, bi + 1, 1);
+		a1 = ai;
+		b1 = bi;
+	}
+
+	free(anchors);
+
+	return error ? error : lines_push(ctx, a0, a1, b0, b1, 0);
+}
+
+static int histogram_diff(line_ctx *ctx, int a0, int a1, int b0, int b1)
+{
+	line_table table;
+	uint32_t best_count = MAX_CHAIN_LEN + 1;
+	int best_as = 0, best_ae = 0, best_bs = 0, best_be = 0, bi, error;
+
+	if (table_build(&table, ctx, a0, a1, b0, b1) < 0)
+		return -1;
+
+	for (bi = b0; bi < b1; ) {
+		line_slot *slot = table_slot(&table, &ctx->b[bi]);
+		int ai, next_bi = bi + 1;
+
+		if (!slot->line || slot->count_a > best_count) {
+			bi = next_bi;
+			continue;
+		}
+
+		for (ai = slot->first_a; ai >= 0; ai = table.next_a[ai - a0]) {
+			int as = ai, ae = ai + 1, bs = bi, be = bi + 1;
+			uint32_t count = slot->count_a;
+
+			/* extend the match, tracking the rarest line it contains */
+			while (as > a0 && bs > b0 &&
+				   line_eq(&ctx->a[as - 1], &ctx->b[bs - 1])) {
+				as--, bs--;
+				count = min_count(&table, &ctx->a[as], count);
+			}
+			while (ae < a1 && be < b1 && line_eq(&ctx->a[ae], &ctx->b[be])) {
+				count = min_count(&table, &ctx->a[ae], count);
+				ae++, be++;
+			}
+
+			if (be > next_bi)
+				next_bi = be;
+
+			if (count < best_count ||
+				(count == best_count && be - bs > best_be - best_bs)) {
+				best_count = count;
+				best_as = as, best_ae = ae;
+				best_bs = bs, best_be = be;
+			}
+		}
+
+		bi = next_bi;
+	}
+
+	table_free(&table);
+
+	if (best_count > MAX_CHAIN_LEN)
+		return emit_bytes(ctx, a0, a1, b0, b1);
+
+	/* the regions on either side of the match, the left one on top */
+	error = lines_push(ctx, best_ae, a1, best_be, b1, 0);
+	if (!error)
+		error = lines_push(ctx, best_as, best_ae, best_bs, best_be, 1);
+	if (!error)
+		error = lines_push(ctx, a0, best_as, b0, best_bs, 0);
+
+	return error;
+}
+
+/* trim one region, leaving its common trailing lines on the stack under
+ * whatever the rest of it turns into
+ */
+static int lines_part(line_ctx *ctx, int a0, int a1, int b0, int b1)
+{
+	int tail = 0, error;
+
+	/* trim common leading and trailing lines */
+	while (a0 < a1 && b0 < b1 && line_eq(&ctx->a[a0], &ctx->b[b0])) {
+		emit_equal(ctx, a0, a0 + 1);
+		a0++, b0++;
+	}
+	while (a0 < a1 - tail && b0 < b1 - tail &&
+		   line_eq(&ctx->a[a1 - tail - 1], &ctx->b[b1 - tail - 1]))
+		tail++;
+	a1 -= tail;
+	b1 -= tail;
+
+	if (lines_push(ctx, a1, a1 + tail, b1, b1 + tail, 1) < 0)
+		return -1;
+
+	if (a0 == a1 && b0 == b1)
+		error = 0;
+	else if (a0 == a1 || b0 == b1)
+		error = emit_bytes(ctx, a0, a1, b0, b1);
+	else if (ctx->algorithm == DMP_ALGORITHM_PATIENCE)
+		error = patience_diff(ctx, a0, a1, b0, b1);
+	else
+		error = histogram_diff(ctx, a0, a1, b0, b1);
+
+	return error ? error : ctx->diff->pool.error;
+}
+
+static int lines_diff(line_ctx *ctx, int na, int nb)
+{
+	int error = lines_push(ctx, 0, na, 0, nb, 0);
+
+	while (!error && ctx->depth > 0) {
+		line_work w = ctx->stack[--ctx->depth];
+
+		if (w.equal) {
+			emit_equal(ctx, w.a0, w.a1);
+			error = ctx->diff->pool.error;
+		} else
+			error = lines_part(ctx, w.a0, w.a1, w.b0, w.b1);
+	}
+
+	free(ctx->stack);
+	return error;
+}
+
+int dmp_diff_lines(
+	dmp_range *out,
+	dmp_diff *diff,
+	const dmp_options *opts,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	line_ctx ctx;
+	int na, nb, error;
+
+	if (!text1 || !len1 || !text2 || !len2)
+		return dmp_diff_main(out, diff, opts, text1, len1, text2, len2);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.diff = diff;
+	ctx.opts = opts;
+	ctx.out  = out;
+	ctx.algorithm = opts->algorithm;
+
+	if (split_lines(&ctx.a, &na, text1, len1) < 0)
+		return -1;
+	if (split_lines(&ctx.b, &nb, text2, len2) < 0) {
+		free(ctx.a);
+		return -1;
+	}
+
+	/* nested Myers diffs must not finish the list themselves */
+	diff->depth++;
+
+	/* allocate sentinel */
+	if (dmp_range_init(&diff->pool, out, DMP_DIFF_EQUAL, text1, 0, 0) < 0)
+		error = -1;
+	else
+		error = lines_diff(&ctx, na, nb);
+
+	free(ctx.a);
+	free(ctx.b);
+
+	if (!error)
+		error = dmp_diff_cleanup_merge(diff, out);
+	if (--diff->depth == 0 && !error)
+		dmp_diff_tally(diff, out);
+
+	return error;
+}
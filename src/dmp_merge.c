@@ -0,0 +1,357 @@
+/**
+ * dmp_merge.c
+ *
+ * Three-way merge of two texts derived from a common base
+ *
+ * Both texts are diffed against the base, the edits of each diff are
+ * collected as changes to ranges of the base, and the two change lists
+ * are walked together in base order.  Changes that overlap are grouped
+ * into a single region which is a conflict unless both sides produced
+ * the same text for it.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_diff.h"
+
+/* a run of edits that replaces base[start,end) with side[x_start,x_end) */
+typedef struct {
+	uint32_t start, end;
+	uint32_t x_start, x_end;
+} merge_change;
+
+typedef struct {
+	int kind;
+	uint32_t base_off, base_len;
+	uint32_t a_off, a_len;
+	uint32_t b_off, b_len;
+} merge_region;
+
+struct dmp_merge {
+	const char *base, *a, *b;
+	uint32_t base_len, a_len, b_len;
+	merge_region *regions;
+	uint32_t n_regions, conflicts;
+};
+
+/* collect the changes of a diff of the middle of base and one side */
+static int collect_changes(
+	merge_change **out, uint32_t *count, const dmp_diff *diff,
+	uint32_t offset)
+{
+	int pos;
+	const dmp_node *node;
+	uint32_t n = 0, at = offset, x_at = offset;
+	merge_change *changes = malloc(
+		(dmp_diff_hunks(diff) + 1) * sizeof(merge_change));
+	int open = 0;
+
+	if (!changes)
+		return -1;
+
+	dmp_range_foreach(&diff->pool, &diff->list, pos, node) {
+		if (node->op == DMP_DIFF_EQUAL) {
+			if (open)
+				n++;
+			open = 0;
+			at   += node->len;
+			x_at += node->len;
+			continue;
+		}
+
+		if (!open) {
+			changes[n].start = changes[n].end = at;
+			changes[n].x_start = changes[n].x_end = x_at;
+			open = 1;
+		}
+
+		if (node->op == DMP_DIFF_DELETE)
+			changes[n].end = (at += node->len);
+		else
+			changes[n].x_end = (x_at += node->len);
+	}
+	if (open)
+		n++;
+
+	*out = changes;
+	*count = n;
+	return 0;
+}
+
+/* where base offset `at` (outside of any change of the side) lands in it */
+static uint32_t side_offset(
+	const merge_change *changes, uint32_t n, uint32_t *scan, uint32_t at)
+{
+	while (*scan < n && changes[*scan].end <= at &&
+		!(changes[*scan].start == at && changes[*scan].end == at))
+		(*scan)++;
+
+	if (*scan < n && changes[*scan].start >= at) {
+		const merge_change *c = &changes[*scan];
+		return c->x_start - (c->start - at);
+	}
+
+	return *scan > 0 ?
+		changes[*scan - 1].x_end + (at - changes[*scan - 1].end) : at;
+}
+
+/* changes overlap, or start at the same spot (such as two insertions) */
+static int overlaps(
+	uint32_t s1, uint32_t e1, uint32_t s2, uint32_t e2)
+{
+	return (s1 < e2 && s2 < e1) || s1 == s2;
+}
+
+static int add_region(
+	dmp_merge *merge, uint32_t *alloc, int kind,
+	uint32_t base_start, uint32_t base_end,
+	uint32_t a_start, uint32_t a_end, uint32_t b_start, uint32_t b_end)
+{
+	merge_region *r;
+
+	if (base_start == base_end && a_start == a_end && b_start == b_end)
+		return 0;
+
+	if (merge->n_regions >= *alloc) {
+		uint32_t new_alloc = *alloc ? *alloc * 2 : 8;
+		r = realloc(merge->regions, new_alloc * sizeof(merge_region));
+		if (!r)
+			return -1;
+		merge->regions = r;
+		*alloc = new_alloc;
+	}
+
+	r = &merge->regions[merge->n_regions++];
+	r->kind     = kind;
+	r->base_off = base_start;
+	r->base_len = base_end - base_start;
+	r->a_off    = a_start;
+	r->a_len    = a_end - a_start;
+	r->b_off    = b_start;
+	r->b_len    = b_end - b_start;
+
+	if (kind == DMP_MERGE_CONFLICT)
+		merge->conflicts++;
+
+	return 0;
+}
+
+static int merge_changes(
+	dmp_merge *merge,
+	const merge_change *ca, uint32_t na,
+	const merge_change *cb, uint32_t nb)
+{
+	uint32_t ia = 0, ib = 0, scan_a = 0, scan_b = 0, alloc = 0;
+	uint32_t done = 0, a_done = 0, b_done = 0;
+
+	while (ia < na || ib < nb) {
+		uint32_t start, end, a_start, a_end, b_start, b_end;
+		uint32_t first_a = ia, first_b = ib;
+		int kind;
+
+		/* start a region with whichever change comes first */
+		if (ib >= nb || (ia < na && ca[ia].start <= cb[ib].start)) {
+			start = ca[ia].start;
+			end   = ca[ia].end;
+			ia++;
+		} else {
+			start = cb[ib].start;
+			end   = cb[ib].end;
+			ib++;
+		}
+
+		/* and grow it to take in every change that it overlaps */
+		for (;;) {
+			if (ia < na && overlaps(ca[ia].start, ca[ia].end, start, end)) {
+				if (ca[ia].end > end)
+					end = ca[ia].end;
+				ia++;
+			} else if (ib < nb &&
+				overlaps(cb[ib].start, cb[ib].end, start, end)) {
+				if (cb[ib].end > end)
+					end = cb[ib].end;
+				ib++;
+			} else
+				break;
+		}
+
+		a_start = side_offset(ca, na, &scan_a, start);
+		b_start = side_offset(cb, nb, &scan_b, start);
+
+		/* unchanged text up to the region */
+		if (add_region(merge, &alloc, DMP_MERGE_UNCHANGED, done, start,
+				a_done, a_start, b_done, b_start) < 0)
+			return -1;
+
+		a_end = (ia > first_a) ? ca[ia - 1].x_end +
+			(end - ca[ia - 1].end) : a_start + (end - start);
+		b_end = (ib > first_b) ? cb[ib - 1].x_end +
+			(end - cb[ib - 1].end) : b_start + (end - start);
+
+		if (ib == first_b)
+			kind = DMP_MERGE_A;
+		else if (ia == first_a)
+			kind = DMP_MERGE_B;
+		else if (a_end - a_start == b_end - b_start &&
+			!memcmp(merge->a + a_start, merge->b + b_start, a_end - a_start))
+			kind = DMP_MERGE_BOTH;
+		else
+			kind = DMP_MERGE_CONFLICT;
+
+		if (add_region(merge, &alloc, kind, start, end,
+				a_start, a_end, b_start, b_end) < 0)
+			return -1;
+
+		done   = end;
+		a_done = a_end;
+		b_done = b_end;
+	}
+
+	return add_region(merge, &alloc, DMP_MERGE_UNCHANGED,
+		done, merge->base_len, a_done, merge->a_len, b_done, merge->b_len);
+}
+
+int dmp_merge3(
+	dmp_merge **merge_ptr,
+	const dmp_options *options,
+	const char *base,
+	uint32_t    base_len,
+	const char *a,
+	uint32_t    a_len,
+	const char *b,
+	uint32_t    b_len)
+{
+	dmp_merge *merge;
+	dmp_diff *da = NULL, *db = NULL;
+	merge_change *ca = NULL, *cb = NULL;
+	uint32_t na = 0, nb = 0, pfx, sfx, sa, sb;
+	int error = -1;
+
+	assert(merge_ptr);
+
+	*merge_ptr = merge = calloc(1, sizeof(dmp_merge));
+	if (!merge)
+		return -1;
+
+	merge->base = base;
+	merge->base_len = base_len;
+	merge->a = a;
+	merge->a_len = a_len;
+	merge->b = b;
+	merge->b_len = b_len;
+
+	/* text common to all three is trimmed once for both diffs */
+	pfx = dmp_common_prefix(base, base_len, a, a_len);
+	pfx = dmp_common_prefix(base, pfx, b, b_len);
+
+	sa  = dmp_common_suffix(
+		base + pfx, base_len - pfx, a + pfx, a_len - pfx);
+	sb  = dmp_common_suffix(
+		base + pfx, base_len - pfx, b + pfx, b_len - pfx);
+	sfx = (sa < sb) ? sa : sb;
+
+	if (dmp_diff_new(&da, options, base + pfx, base_len - pfx - sfx,
+			a + pfx, a_len - pfx - sfx) < 0 ||
+		dmp_diff_new(&db, options, base + pfx, base_len - pfx - sfx,
+			b + pfx, b_len - pfx - sfx) < 0 ||
+		collect_changes(&ca, &na, da, pfx) < 0 ||
+		collect_changes(&cb, &nb, db, pfx) < 0)
+		goto done;
+
+	error = merge_changes(merge, ca, na, cb, nb);
+
+done:
+	free(ca);
+	free(cb);
+	if (da)
+		dmp_diff_free(da);
+	if (db)
+		dmp_diff_free(db);
+
+	if (error < 0) {
+		dmp_merge_free(merge);
+		*merge_ptr = NULL;
+	}
+
+	return error;
+}
+
+void dmp_merge_free(dmp_merge *merge)
+{
+	if (!merge)
+		return;
+
+	free(merge->regions);
+	free(merge);
+}
+
+uint32_t dmp_merge_conflicts(const dmp_merge *merge)
+{
+	return merge->conflicts;
+}
+
+int dmp_merge_foreach(
+	const dmp_merge *merge,
+	dmp_merge_callback cb,
+	void *cb_ref)
+{
+	uint32_t i;
+	int rval = 0;
+
+	for (i = 0; i < merge->n_regions; ++i) {
+		const merge_region *r = &merge->regions[i];
+
+		rval = cb(cb_ref, (dmp_merge_t)r->kind,
+			merge->base + r->base_off, r->base_len,
+			merge->a + r->a_off, r->a_len,
+			merge->b + r->b_off, r->b_len);
+		if (rval != 0)
+			break;
+	}
+
+	return rval;
+}
+
+int dmp_merge_text(char **text, uint32_t *len, const dmp_merge *merge)
+{
+	uint32_t i;
+	size_t size = 0;
+	char *out;
+
+	assert(text && len);
+
+	/* unchanged and conflicting regions come from `a` as well */
+	for (i = 0; i < merge->n_regions; ++i)
+		size += (merge->regions[i].kind == DMP_MERGE_B) ?
+			merge->regions[i].b_len : merge->regions[i].a_len;
+
+	*text = NULL;
+	*len = 0;
+
+	if (size >= UINT32_MAX || (out = malloc(size + 1)) == NULL)
+		return -1;
+
+	for (size = 0, i = 0; i < merge->n_regions; ++i) {
+		const merge_region *r = &merge->regions[i];
+
+		if (r->kind == DMP_MERGE_B) {
+			memcpy(out + size, merge->b + r->b_off, r->b_len);
+			size += r->b_len;
+		} else {
+			memcpy(out + size, merge->a + r->a_off, r->a_len);
+			size += r->a_len;
+		}
+	}
+
+	out[size] = '\0';
+	*text = out;
+	*len = (uint32_t)size;
+	return 0;
+}
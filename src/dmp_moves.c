@@ -0,0 +1,582 @@
+/**
+ * dmp_moves.c
+ *
+ * Move-aware diff, anchored on long blocks that both texts share
+ *
+ * When blocks of text are reordered, the Myers diff sees one huge change
+ * and spends O(N * D) time to report it as a DELETE and an INSERT.  This
+ * instead looks for long common blocks first, much like bsdiff and xdelta
+ * do: the k-mers of text1 at every `step` bytes go into a hash index, and
+ * text2 is scanned with a rolling hash, taking the longest match at each
+ * position where there is one of at least `move_min_len` bytes.
+ *
+ * The heaviest chain of blocks that appear in the same order in both
+ * texts is kept as EQUAL hunks.  Every other block is a move unless its
+ * old place overlaps the chain or another move.  A move becomes a DELETE
+ * at its old place and an INSERT at its new place, tagged with the same
+ * move number, and the rest of any gap between chain blocks that holds
+ * either end of a move is left as plain DELETE and INSERT hunks around
+ * them.  Only gaps without moves are diffed with Myers.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_pool.h"
+#include "dmp_diff.h"
+#include "dmp_cpu.h"
+
+/* longest and shortest k-mers indexed */
+#define MOVE_K_MAX	32
+#define MOVE_K_MIN	8
+/* positions of a k-mer tried before settling for the best so far */
+#define MOVE_CANDIDATES	16
+/* most buckets in the k-mer index; texts with more samples share them */
+#define MOVE_BUCKETS_MAX	(1u << 30)
+
+#define MOVE_BASE	0x100000001b3ULL
+
+typedef struct {
+	uint32_t a, b, len; /* text1[a, a + len) equals text2[b, b + len) */
+	uint32_t move;      /* move number, or 0 */
+	int chain;          /* part of the in-order chain of EQUAL anchors? */
+} move_block;
+
+typedef struct {
+	dmp_diff *diff;
+	const dmp_options *opts;
+	dmp_range *out;
+	const dmp_kernels *kern;
+	const char *t1, *t2;
+	uint32_t l1, l2;
+	uint32_t k, step, min_len;
+	uint64_t top; /* MOVE_BASE ^ (k - 1), to roll bytes out of the hash */
+	/* chains of the text1 k-mers starting at multiples of `step`, as
+	 * sample number + 1 (0 ends a chain)
+	 */
+	uint32_t *heads, *next, mask;
+	move_block *blocks;
+	uint32_t n_blocks, blocks_alloc;
+} move_ctx;
+
+static uint64_t kmer_hash(const move_ctx *ctx, const char *text)
+{
+	uint64_t h = 0;
+	uint32_t i;
+
+	for (i = 0; i < ctx->k; ++i)
+		h = h * MOVE_BASE + (unsigned char)text[i];
+
+	return h;
+}
+
+static uint64_t kmer_roll(
+	const move_ctx *ctx, uint64_t h, unsigned char out, unsigned char in)
+{
+	return (h - out * ctx->top) * MOVE_BASE + in;
+}
+
+static uint32_t kmer_bucket(const move_ctx *ctx, uint64_t h)
+{
+	return (uint32_t)(h >> 32 ^ h) & ctx->mask;
+}
+
+static int index_build(move_ctx *ctx)
+{
+	uint32_t samples = (ctx->l1 - ctx->k) / ctx->step + 1, size = 16, p;
+	uint64_t h;
+
+	while (size < MOVE_BUCKETS_MAX && size < 2 * (uint64_t)samples)
+		size <<= 1;
+
+	ctx->mask  = size - 1;
+	ctx->heads = calloc(size, sizeof(uint32_t));
+	ctx->next  = malloc(samples * sizeof(uint32_t));
+	if (!ctx->heads || !ctx->next)
+		return -1;
+
+	/* walk backwards so that chains list earlier positions first */
+	for (p = samples; p-- > 0; ) {
+		uint32_t *head;
+
+		h = kmer_hash(ctx, ctx->t1 + p * ctx->step);
+		head = &ctx->heads[kmer_bucket(ctx, h)];
+		ctx->next[p] = *head;
+		*head = p + 1;
+	}
+
+	return 0;
+}
+
+static int block_add(move_ctx *ctx, uint32_t a, uint32_t b, uint32_t len)
+{
+	move_block *blk;
+
+	if (ctx->n_blocks == ctx->blocks_alloc) {
+		uint32_t alloc = ctx->blocks_alloc ? 2 * ctx->blocks_alloc : 64;
+		move_block *grown = realloc(ctx->blocks, alloc * sizeof(*grown));
+		if (!grown)
+			return -1;
+		ctx->blocks = grown;
+		ctx->blocks_alloc = alloc;
+	}
+
+	blk = &ctx->blocks[ctx->n_blocks++];
+	blk->a = a;
+	blk->b = b;
+	blk->len = len;
+	blk->move = 0;
+	blk->chain = 0;
+	return 0;
+}
+
+/* greedy pass over text2 for the longest block at each position, never
+ * reaching back before the end of the previous block
+ */
+static int blocks_find(move_ctx *ctx)
+{
+	const char *t1 = ctx->t1, *t2 = ctx->t2;
+	uint32_t j = 0, covered = 0, k = ctx->k;
+	uint64_t h = kmer_hash(ctx, t2);
+
+	while (j + k <= ctx->l2) {
+		uint32_t s, tries = 0, best_a = 0, best_b = 0, best_len = 0;
+
+		for (s = ctx->heads[kmer_bucket(ctx, h)];
+			 s && tries < MOVE_CANDIDATES; s = ctx->next[s - 1], tries++) {
+			uint32_t p = (s - 1) * ctx->step, fwd, back;
+
+			if (memcmp(t1 + p, t2 + j, k) != 0)
+				continue;
+
+			fwd = k + ctx->kern->common_prefix(
+				t1 + p + k, ctx->l1 - p - k, t2 + j + k, ctx->l2 - j - k);
+			back = ctx->kern->common_suffix(
+				t1, p, t2 + covered, j - covered);
+
+			if (back + fwd > best_len) {
+				best_a = p - back;
+				best_b = j - back;
+				best_len = back + fwd;
+			}
+		}
+
+		if (best_len >= ctx->min_len) {
+			if (block_add(ctx, best_a, best_b, best_len) < 0)
+				return -1;
+			j = covered = best_b + best_len;
+			if (j + k <= ctx->l2)
+				h = kmer_hash(ctx, t2 + j);
+			continue;
+		}
+
+		if (j + k < ctx->l2)
+			h = kmer_roll(ctx, h, t2[j], t2[j + k]);
+		j++;
+	}
+
+	return 0;
+}
+
+static int cmp_uint32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* mark the chain of blocks in the same order in both texts (and not
+ * overlapping in text1) that covers the most bytes; this is a weighted
+ * longest increasing subsequence, with a Fenwick tree of the best chain
+ * ending at or before each text1 offset
+ */
+static int chain_mark(move_ctx *ctx)
+{
+	uint32_t n = ctx->n_blocks, i, best = 0;
+	uint32_t *ends, *tree, *prev;
+	uint64_t *score;
+
+	if (!n)
+		return 0;
+
+	ends  = malloc(n * sizeof(uint32_t));
+	tree  = calloc(n + 1, sizeof(uint32_t));
+	prev  = malloc(n * sizeof(uint32_t));
+	score = malloc(n * sizeof(uint64_t));
+	if (!ends || !tree || !prev || !score) {
+		free(ends);
+		free(tree);
+		free(prev);
+		free(score);
+		return -1;
+	}
+
+	for (i = 0; i < n; ++i)
+		ends[i] = ctx->blocks[i].a + ctx->blocks[i].len;
+	qsort(ends, n, sizeof(uint32_t), cmp_uint32);
+
+	/* tree entries are block number + 1 of the best chain so far */
+	for (i = 0; i < n; ++i) {
+		const move_block *blk = &ctx->blocks[i];
+		uint32_t lo = 0, hi = n, r, from = 0;
+
+		/* blocks ending at or before this one starts */
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			if (ends[mid] <= blk->a)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (r = lo; r > 0; r &= r - 1)
+			if (tree[r] && (!from || score[tree[r] - 1] > score[from - 1]))
+				from = tree[r];
+
+		prev[i]  = from;
+		score[i] = blk->len + (from ? score[from - 1] : 0);
+		if (score[i] > score[best])
+			best = i;
+
+		/* the first slot holding this end */
+		lo = 0, hi = n;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			if (ends[mid] < blk->a + blk->len)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (r = lo + 1; r <= n; r += r & (0 - r))
+			if (!tree[r] || score[i] > score[tree[r] - 1])
+				tree[r] = i + 1;
+	}
+
+	for (i = best + 1; i; i = prev[i - 1])
+		ctx->blocks[i - 1].chain = 1;
+
+	free(ends);
+	free(tree);
+	free(prev);
+	free(score);
+	return 0;
+}
+
+static int cmp_uint64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* decide which blocks off the chain are moves: the old place must not
+ * overlap the chain (or it was copied, not moved) nor an earlier move,
+ * though a block that only shares a few bytes at either end, as greedy
+ * extension leaves them, is cut down to the rest if that is still long
+ * enough; returns the moves in text1 order, and numbers them in text2
+ * order
+ */
+static int moves_pick(move_ctx *ctx, uint32_t **by_a, uint32_t *count)
+{
+	uint32_t n = 0, i, c = 0, end = 0, kept = 0;
+	uint64_t *keys;
+	uint32_t *order;
+
+	*by_a = NULL;
+	*count = 0;
+
+	for (i = 0; i < ctx->n_blocks; ++i)
+		n += !ctx->blocks[i].chain;
+	if (!n)
+		return 0;
+
+	keys  = malloc(n * sizeof(uint64_t));
+	order = malloc(n * sizeof(uint32_t));
+	if (!keys || !order) {
+		free(keys);
+		free(order);
+		return -1;
+	}
+
+	for (i = 0, n = 0; i < ctx->n_blocks; ++i)
+		if (!ctx->blocks[i].chain)
+			keys[n++] = (uint64_t)ctx->blocks[i].a << 32 | i;
+	qsort(keys, n, sizeof(uint64_t), cmp_uint64);
+
+	/* chain blocks are in text1 order too, so one pass checks overlaps */
+	for (i = 0; i < n; ++i) {
+		move_block *blk = &ctx->blocks[(uint32_t)keys[i]];
+		uint32_t start = blk->a, stop = blk->a + blk->len, next;
+
+		while (c < ctx->n_blocks && (!ctx->blocks[c].chain ||
+			ctx->blocks[c].a + ctx->blocks[c].len <= blk->a))
+			c++;
+
+		if (start < end)
+			start = end;
+		for (next = c; next < ctx->n_blocks; ++next) {
+			const move_block *link = &ctx->blocks[next];
+			if (!link->chain)
+				continue;
+			if (link->a > start)
+				break;
+			if (link->a + link->len > start)
+				start = link->a + link->len;
+		}
+		if (next < ctx->n_blocks && ctx->blocks[next].a < stop)
+			stop = ctx->blocks[next].a;
+
+		if (start >= stop || stop - start < ctx->min_len)
+			continue;
+
+		blk->b  += start - blk->a;
+		blk->a   = start;
+		blk->len = stop - start;
+		blk->move = 1;
+		end = stop;
+		order[kept++] = (uint32_t)keys[i];
+	}
+
+	free(keys);
+
+	for (i = 0, n = 0; i < ctx->n_blocks; ++i)
+		if (ctx->blocks[i].move)
+			ctx->blocks[i].move = ++n;
+
+	*by_a = order;
+	*count = kept;
+	return 0;
+}
+
+static int piece_add(
+	move_ctx *ctx, int op, uint32_t at, uint32_t len, uint32_t move)
+{
+	dmp_pool *pool = &ctx->diff->pool;
+	dmp_pos pos;
+
+	if (!len)
+		return 0;
+	if (dmp_pool_reserve(pool, 1) < 0)
+		return -1;
+
+	pos = dmp_range_insert(pool, ctx->out, -1, op,
+		(op == DMP_DIFF_INSERT) ? ctx->t2 : ctx->t1, at, len);
+	dmp_node_at(pool, pos)->move = move;
+	return 0;
+}
+
+/* Myers diff of text1[a0, a1) and text2[b0, b1) */
+static int gap_diff(
+	move_ctx *ctx, uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1)
+{
+	dmp_range sub;
+
+	if (a0 == a1 && b0 == b1)
+		return 0;
+
+	if (dmp_diff_main(&sub, ctx->diff, ctx->opts,
+			ctx->t1 + a0, a1 - a0, ctx->t2 + b0, b1 - b0) < 0)
+		return -1;
+
+	if (sub.start >= 0)
+		dmp_range_splice(&ctx->diff->pool, ctx->out, -1, &sub);
+
+	return ctx->diff->pool.error;
+}
+
+typedef struct {
+	const uint32_t *by_a;
+	uint32_t n_moves, next_a; /* moves not yet emitted, in text1 order */
+	uint32_t next_b;          /* blocks not yet emitted, in text2 order */
+} move_walk;
+
+/* the text between two chain blocks: Myers if no move starts or ends in
+ * it, or else the moves and the text around them as they are
+ */
+static int gap_emit(move_ctx *ctx, move_walk *w,
+	uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1)
+{
+	uint32_t i, j, at;
+	int error = 0;
+
+	for (i = w->next_a; i < w->n_moves &&
+		ctx->blocks[w->by_a[i]].a < a1; ++i);
+	for (j = w->next_b; j < ctx->n_blocks &&
+		ctx->blocks[j].b < b1; ++j);
+
+	if (i == w->next_a) {
+		uint32_t k;
+		for (k = w->next_b; k < j && !ctx->blocks[k].move; ++k);
+		if (k == j) {
+			w->next_b = j;
+			return gap_diff(ctx, a0, a1, b0, b1);
+		}
+	}
+
+	for (at = a0; w->next_a < i && !error; w->next_a++) {
+		const move_block *blk = &ctx->blocks[w->by_a[w->next_a]];
+		error = piece_add(ctx, DMP_DIFF_DELETE, at, blk->a - at, 0);
+		if (!error)
+			error = piece_add(
+				ctx, DMP_DIFF_DELETE, blk->a, blk->len, blk->move);
+		at = blk->a + blk->len;
+	}
+	if (!error)
+		error = piece_add(ctx, DMP_DIFF_DELETE, at, a1 - at, 0);
+
+	/* blocks that are not moves are left in the surrounding inserts */
+	for (at = b0; w->next_b < j && !error; w->next_b++) {
+		const move_block *blk = &ctx->blocks[w->next_b];
+		if (!blk->move)
+			continue;
+		error = piece_add(ctx, DMP_DIFF_INSERT, at, blk->b - at, 0);
+		if (!error)
+			error = piece_add(
+				ctx, DMP_DIFF_INSERT, blk->b, blk->len, blk->move);
+		at = blk->b + blk->len;
+	}
+	if (!error)
+		error = piece_add(ctx, DMP_DIFF_INSERT, at, b1 - at, 0);
+
+	return error ? error : ctx->diff->pool.error;
+}
+
+static int chain_emit(move_ctx *ctx)
+{
+	dmp_pool *pool = &ctx->diff->pool;
+	move_walk w;
+	uint32_t *by_a, i, a = 0, b = 0;
+	int error;
+
+	if (moves_pick(ctx, &by_a, &w.n_moves) < 0)
+		return -1;
+	w.by_a = by_a;
+	w.next_a = w.next_b = 0;
+
+	for (i = 0, error = 0; i < ctx->n_blocks && !error; ++i) {
+		const move_block *blk = &ctx->blocks[i];
+
+		if (!blk->chain)
+			continue;
+
+		error = gap_emit(ctx, &w, a, blk->a, b, blk->b);
+		if (!error && dmp_pool_reserve(pool, 1) == 0)
+			dmp_range_insert(pool, ctx->out, -1, DMP_DIFF_EQUAL,
+				ctx->t1, blk->a, blk->len);
+
+		a = blk->a + blk->len;
+		b = blk->b + blk->len;
+		w.next_b = i + 1;
+	}
+
+	if (!error)
+		error = gap_emit(ctx, &w, a, ctx->l1, b, ctx->l2);
+
+	free(by_a);
+	return error ? error : pool->error;
+}
+
+/* join neighbours that the gaps left apart, such as an EQUAL from the
+ * Myers diff of a gap and the chain block after it; the hunks of a move
+ * are kept whole
+ */
+static void pieces_join(move_ctx *ctx)
+{
+	dmp_pool *pool = &ctx->diff->pool;
+	dmp_pos pos, next_pos;
+
+	dmp_range_normalize(pool, ctx->out);
+
+	for (pos = ctx->out->start; pos >= 0; ) {
+		dmp_node *node = dmp_node_at(pool, pos), *next;
+
+		if ((next_pos = node->next) < 0)
+			break;
+		next = dmp_node_at(pool, next_pos);
+
+		if (node->op != next->op || node->move || next->move ||
+			node->text + node->len != next->text) {
+			pos = next_pos;
+			continue;
+		}
+
+		node->len += next->len;
+		node->next = next->next;
+		if (ctx->out->end == next_pos)
+			ctx->out->end = pos;
+		dmp_node_release(pool, next_pos);
+	}
+}
+
+int dmp_diff_moves(
+	dmp_range *out,
+	dmp_diff *diff,
+	const dmp_options *opts,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	move_ctx ctx;
+	uint32_t i;
+	int error;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.diff = diff;
+	ctx.opts = opts;
+	ctx.out  = out;
+	ctx.kern = dmp_cpu_kernels();
+	ctx.t1 = text1;
+	ctx.l1 = len1;
+	ctx.t2 = text2;
+	ctx.l2 = len2;
+
+	/* a block of min_len bytes holds min_len - k + 1 k-mer starts, so
+	 * one of them is sampled if they are at most that far apart
+	 */
+	ctx.min_len = (opts->move_min_len < MOVE_K_MIN) ?
+		MOVE_K_MIN : opts->move_min_len;
+	ctx.k = (ctx.min_len < 2 * MOVE_K_MAX) ? ctx.min_len / 2 : MOVE_K_MAX;
+	if (ctx.k < MOVE_K_MIN)
+		ctx.k = MOVE_K_MIN;
+	ctx.step = ctx.min_len - ctx.k + 1;
+	for (ctx.top = 1, i = 1; i < ctx.k; ++i)
+		ctx.top *= MOVE_BASE;
+
+	if (len1 < ctx.min_len || len2 < ctx.min_len)
+		return dmp_diff_main(out, diff, opts, text1, len1, text2, len2);
+
+	if (index_build(&ctx) < 0 || blocks_find(&ctx) < 0 ||
+		chain_mark(&ctx) < 0) {
+		free(ctx.heads);
+		free(ctx.next);
+		free(ctx.blocks);
+		return -1;
+	}
+
+	free(ctx.heads);
+	free(ctx.next);
+
+	/* nested Myers diffs must not finish the list themselves */
+	diff->depth++;
+
+	/* allocate sentinel */
+	if (dmp_range_init(&diff->pool, out, DMP_DIFF_EQUAL, text1, 0, 0) < 0)
+		error = -1;
+	else
+		error = chain_emit(&ctx);
+
+	free(ctx.blocks);
+
+	/* dmp_diff_cleanup_merge would merge moves into the hunks beside
+	 * them, so only the plain joins are done here
+	 */
+	if (!error)
+		pieces_join(&ctx);
+	if (--diff->depth == 0 && !error)
+		dmp_diff_tally(diff, out);
+
+	return error;
+}
@@ -14,7 +14,6 @@
 #include <assert.h>
 
 #define MIN_POOL	2
-#define MAX_POOL_INCREMENT	128
 
 int dmp_pool_alloc(dmp_pool *pool, uint32_t start_pool)
 {
@@ -34,9 +33,38 @@ int dmp_pool_alloc(dmp_pool *pool, uint32_t start_pool)
 	return 0;
 }
 
+void dmp_pool_init_borrowed(dmp_pool *pool, dmp_node *nodes, uint32_t count)
+{
+	assert(count >= MIN_POOL);
+
+	memset(pool, 0, sizeof(*pool));
+
+	pool->pool = nodes;
+	pool->pool_size = count;
+	pool->pool_used = 1; /* set aside first item */
+	pool->free_list = -1;
+	pool->borrowed  = 1;
+}
+
+void dmp_pool_shrink(dmp_pool *pool)
+{
+	dmp_node *nodes;
+
+	if (pool->borrowed || pool->pool_used >= pool->pool_size)
+		return;
+
+	/* keeping the larger block is fine if this fails */
+	nodes = realloc(pool->pool, pool->pool_used * sizeof(dmp_node));
+	if (nodes) {
+		pool->pool = nodes;
+		pool->pool_size = pool->pool_used;
+	}
+}
+
 void dmp_pool_free(dmp_pool *pool)
 {
-	free(pool->pool);
+	if (!pool->borrowed)
+		free(pool->pool);
 }
 
 void dmp_node_release(dmp_pool *pool, dmp_pos idx)
@@ -44,19 +72,36 @@ void dmp_node_release(dmp_pool *pool, dmp_pos idx)
 	dmp_node *node = dmp_node_at(pool, idx);
 	node->next = pool->free_list;
 	pool->free_list = idx;
+	pool->released++;
 }
 
-static dmp_pos grow_pool(dmp_pool *pool)
+/* grow to hold at least `min_size` nodes; the pool is untouched on failure */
+static int grow_pool(dmp_pool *pool, uint32_t min_size)
 {
 	uint32_t new_size;
+	size_t bytes;
 	dmp_node *new_pool;
 
-	if (pool->pool_size > MAX_POOL_INCREMENT)
-		new_size = pool->pool_size + MAX_POOL_INCREMENT;
-	else
-		new_size = pool->pool_size * 2;
+	/* grow geometrically so a pool that fills up is copied O(1) times
+	 * per node on the whole
+	 */
+	new_size = pool->pool_size + pool->pool_size / 2;
+	if (new_size < min_size)
+		new_size = min_size;
+	if (new_size < pool->pool_size)
+		new_size = UINT32_MAX; /* wrapped; fails below */
+
+	/* positions are ints, and the byte size must not wrap */
+	bytes = (size_t)new_size * sizeof(dmp_node);
+	if (new_size > (uint32_t)INT32_MAX || bytes / sizeof(dmp_node) != new_size)
+		new_pool = NULL;
+	else if (pool->borrowed) {
+		new_pool = malloc(bytes);
+		if (new_pool)
+			memcpy(new_pool, pool->pool, pool->pool_size * sizeof(dmp_node));
+	} else
+		new_pool = realloc(pool->pool, bytes);
 
-	new_pool = realloc(pool->pool, new_size * sizeof(dmp_node));
 	if (!new_pool) {
 		pool->error = -1;
 		return -1;
@@ -64,8 +109,22 @@ static dmp_pos grow_pool(dmp_pool *pool)
 
 	pool->pool = new_pool;
 	pool->pool_size = new_size;
+	pool->borrowed  = 0;
+	pool->grows++;
+
+	return 0;
+}
 
-	return pool->pool_used;
+int dmp_pool_reserve(dmp_pool *pool, uint32_t count)
+{
+	if (pool->error < 0)
+		return -1;
+	if (count <= pool->pool_size - pool->pool_used)
+		return 0;
+	if (count > UINT32_MAX - pool->pool_used)
+		return (pool->error = -1);
+
+	return grow_pool(pool, pool->pool_used + count);
 }
 
 static dmp_pos alloc_node(
@@ -86,8 +145,10 @@ static dmp_pos alloc_node(
 		pool->free_list = node->next;
 	}
 	else {
-		if (pool->pool_used >= pool->pool_size)
-			(void)grow_pool(pool);
+		/* callers reserve ahead, so this is just a backstop */
+		if (pool->pool_used >= pool->pool_size &&
+			grow_pool(pool, pool->pool_used + 1) < 0)
+			return -1;
 
 		pos = pool->pool_used;
 		pool->pool_used += 1;
@@ -98,6 +159,7 @@ static dmp_pos alloc_node(
 	node->len  = len;
 	node->op   = op;
 	node->next = -1;
+	node->move = 0;
 
 #ifdef BUGALICIOUS
 	if (len > 0)
@@ -128,7 +190,9 @@ dmp_pos dmp_range_insert(
 
 	node = dmp_node_at(pool, added_at);
 
-	if (pos == -1) {
+	if (pos == -1 && run->end < 0)
+		run->start = run->end = added_at;
+	else if (pos == -1) {
 		dmp_node *end = dmp_node_at(pool, run->end);
 		node->next = end->next;
 		end->next  = added_at;
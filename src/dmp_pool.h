@@ -20,6 +20,7 @@ typedef struct {
 	uint32_t len;
 	int op;
 	dmp_pos next;
+	uint32_t move; /* shared by the DELETE and INSERT of a moved block */
 } dmp_node;
 
 typedef struct {
@@ -30,11 +31,26 @@ typedef struct {
 	dmp_node *pool;
 	uint32_t pool_size, pool_used;
 	dmp_pos free_list;
+	uint32_t released;
+	uint32_t grows; /* reallocations of the node storage */
+	int borrowed; /* node storage is not owned by the pool */
 	int error;
 } dmp_pool;
 
 extern int dmp_pool_alloc(dmp_pool *pool, uint32_t start_pool);
 
+/* set up pool in caller-owned storage; it is copied to the heap on growth */
+extern void dmp_pool_init_borrowed(
+	dmp_pool *pool, dmp_node *nodes, uint32_t count);
+
+/* make room for `count` more nodes so that allocating them cannot fail;
+ * on failure the pool is left as it was with `error` set
+ */
+extern int dmp_pool_reserve(dmp_pool *pool, uint32_t count);
+
+/* give back unused node storage once no more nodes will be needed */
+extern void dmp_pool_shrink(dmp_pool *pool);
+
 extern void dmp_pool_free(dmp_pool *list);
 
 extern dmp_pos dmp_range_init(
@@ -0,0 +1,97 @@
+/**
+ * dmp_profile.c
+ *
+ * Phase counters and timers for the diff engine (see dmp_profile.h)
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_profile.h"
+
+#ifdef DMP_PROFILE
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <x86intrin.h>
+
+static uint64_t profile_ticks(void)
+{
+	return __rdtsc();
+}
+
+#elif defined(_WIN32)
+
+#include <windows.h>
+
+static uint64_t profile_ticks(void)
+{
+	LARGE_INTEGER counter, freq;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)(counter.QuadPart * (1E9 / (double)freq.QuadPart));
+}
+
+#else
+
+#include <time.h>
+
+static uint64_t profile_ticks(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#endif
+
+void dmp_profile_init(dmp_diff *diff, const dmp_options *opts)
+{
+	if (opts) {
+		diff->phase_cb = opts->phase_cb;
+		diff->phase_cb_ref = opts->phase_cb_ref;
+	}
+}
+
+void dmp_profile_begin(
+	dmp_diff *diff, dmp_phase_t phase, uint32_t len1, uint32_t len2)
+{
+	diff->profile.calls[phase]++;
+	diff->profile.bytes[phase] += (uint64_t)len1 + len2;
+
+	if (diff->phase_cb)
+		diff->phase_cb(diff->phase_cb_ref, phase, 0, len1, len2);
+
+	/* read the clock last so the callback is not billed to the phase */
+	diff->phase_start[phase] = profile_ticks();
+}
+
+void dmp_profile_end(
+	dmp_diff *diff, dmp_phase_t phase, uint32_t len1, uint32_t len2)
+{
+	diff->profile.ticks[phase] += profile_ticks() - diff->phase_start[phase];
+
+	if (diff->phase_cb)
+		diff->phase_cb(diff->phase_cb_ref, phase, 1, len1, len2);
+}
+
+int dmp_diff_profile(const dmp_diff *diff, dmp_profile *profile)
+{
+	*profile = diff->profile;
+	return 0;
+}
+
+#else
+
+int dmp_diff_profile(const dmp_diff *diff, dmp_profile *profile)
+{
+	(void)diff;
+	memset(profile, 0, sizeof(*profile));
+	return -1;
+}
+
+#endif
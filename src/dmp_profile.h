@@ -0,0 +1,49 @@
+/**
+ * dmp_profile.h
+ *
+ * Phase counters and timers for the diff engine, compiled in only when
+ * DMP_PROFILE is defined.  Without it every macro here expands to nothing
+ * (arguments are not evaluated) so the engine is unchanged.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#ifndef INCLUDE_H_dmp_profile
+#define INCLUDE_H_dmp_profile
+
+#include "dmp_diff.h"
+
+#ifdef DMP_PROFILE
+
+extern void dmp_profile_init(dmp_diff *diff, const dmp_options *opts);
+
+extern void dmp_profile_begin(
+	dmp_diff *diff, dmp_phase_t phase, uint32_t len1, uint32_t len2);
+
+extern void dmp_profile_end(
+	dmp_diff *diff, dmp_phase_t phase, uint32_t len1, uint32_t len2);
+
+#define DMP_PROFILE_INIT(DIFF, OPTS) \
+	dmp_profile_init((DIFF), (OPTS))
+#define DMP_PROFILE_BEGIN(DIFF, PHASE, LEN1, LEN2) \
+	dmp_profile_begin((DIFF), (PHASE), (LEN1), (LEN2))
+#define DMP_PROFILE_END(DIFF, PHASE, LEN1, LEN2) \
+	dmp_profile_end((DIFF), (PHASE), (LEN1), (LEN2))
+#define DMP_PROFILE_BISECT_STEPS(DIFF, D) do { \
+	(DIFF)->profile.bisect_steps += (D); \
+	if ((uint32_t)(D) > (DIFF)->profile.bisect_max_d) \
+		(DIFF)->profile.bisect_max_d = (uint32_t)(D); \
+	} while (0)
+
+#else
+
+#define DMP_PROFILE_INIT(DIFF, OPTS) ((void)0)
+#define DMP_PROFILE_BEGIN(DIFF, PHASE, LEN1, LEN2) ((void)0)
+#define DMP_PROFILE_END(DIFF, PHASE, LEN1, LEN2) ((void)0)
+#define DMP_PROFILE_BISECT_STEPS(DIFF, D) ((void)0)
+
+#endif
+
+#endif
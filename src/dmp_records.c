@@ -0,0 +1,335 @@
+/**
+ * dmp_records.c
+ *
+ * Record-level diff for very large files of newline-terminated records
+ *
+ * The texts are cut into records at each '\n' with the vectorized
+ * find_all kernel, each record is hashed with dmp_hash64, and the two
+ * arrays of hashes are diffed as sequences (see dmp_seq.c).  Runs of
+ * equal records become EQUAL hunks as they are, once their bytes are
+ * checked against a hash collision, and only the records in between go
+ * through the byte-level Myers diff.
+ *
+ * The scan and the hashing are split into parts that run on up to
+ * `threads` threads, for texts that are large enough to repay starting
+ * them.  Each part writes to its own slice of the output arrays.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "dmp.h"
+#include "dmp_pool.h"
+#include "dmp_diff.h"
+#include "dmp_cpu.h"
+
+/* bytes of text below which another thread is not worth starting */
+#define RECORDS_PART_MIN	(256 * 1024)
+#define RECORDS_MAX_PARTS	64
+
+/* the records of one text; record i is text[ends[i - 1], ends[i]), where
+ * the first one starts at 0
+ */
+typedef struct {
+	const char *text;
+	uint32_t len;
+	uint32_t count;
+	uint32_t *ends;
+	uint64_t *hashes;
+	/* record separators found in each part of the text and the index of
+	 * the first of them
+	 */
+	uint32_t parts;
+	uint32_t part_seps[RECORDS_MAX_PARTS];
+	uint32_t part_first[RECORDS_MAX_PARTS];
+} rec_text;
+
+typedef void (*rec_work)(rec_text *rt, uint32_t part);
+
+typedef struct {
+	rec_work fn;
+	rec_text *rt;
+	uint32_t part;
+} rec_task;
+
+static uint32_t part_start(const rec_text *rt, uint32_t total, uint32_t part)
+{
+	return (uint32_t)((uint64_t)total * part / rt->parts);
+}
+
+static uint32_t rec_start(const rec_text *rt, uint32_t i)
+{
+	return i ? rt->ends[i - 1] : 0;
+}
+
+static void count_part(rec_text *rt, uint32_t part)
+{
+	uint32_t s = part_start(rt, rt->len, part);
+	uint32_t e = part_start(rt, rt->len, part + 1);
+
+	rt->part_seps[part] = dmp_cpu_kernels()->find_all(
+		rt->text + s, e - s, '\n', 0, NULL);
+}
+
+static void fill_part(rec_text *rt, uint32_t part)
+{
+	uint32_t s = part_start(rt, rt->len, part);
+	uint32_t e = part_start(rt, rt->len, part + 1);
+
+	/* a record ends just past its separator */
+	dmp_cpu_kernels()->find_all(rt->text + s, e - s, '\n',
+		s + 1, rt->ends + rt->part_first[part]);
+}
+
+static void hash_part(rec_text *rt, uint32_t part)
+{
+	uint32_t i = part_start(rt, rt->count, part);
+	uint32_t e = part_start(rt, rt->count, part + 1);
+
+	for (; i < e; ++i) {
+		uint32_t start = rec_start(rt, i);
+		rt->hashes[i] =
+			dmp_hash64(rt->text + start, rt->ends[i] - start, 0);
+	}
+}
+
+#ifdef _WIN32
+static unsigned __stdcall rec_thread(void *ref)
+#else
+static void *rec_thread(void *ref)
+#endif
+{
+	rec_task *task = ref;
+	task->fn(task->rt, task->part);
+	return 0;
+}
+
+/* run `fn` on every part, the first one on this thread; a part whose
+ * thread cannot be started is run here as well
+ */
+static void rec_run(rec_text *rt, rec_work fn)
+{
+	rec_task tasks[RECORDS_MAX_PARTS];
+#ifdef _WIN32
+	HANDLE threads[RECORDS_MAX_PARTS];
+#else
+	pthread_t threads[RECORDS_MAX_PARTS];
+#endif
+	int started[RECORDS_MAX_PARTS];
+	uint32_t p;
+
+	for (p = 1; p < rt->parts; ++p) {
+		tasks[p].fn = fn;
+		tasks[p].rt = rt;
+		tasks[p].part = p;
+#ifdef _WIN32
+		threads[p] = (HANDLE)_beginthreadex(
+			NULL, 0, rec_thread, &tasks[p], 0, NULL);
+		started[p] = (threads[p] != 0);
+#else
+		started[p] = !pthread_create(
+			&threads[p], NULL, rec_thread, &tasks[p]);
+#endif
+	}
+
+	fn(rt, 0);
+
+	for (p = 1; p < rt->parts; ++p) {
+		if (!started[p])
+			fn(rt, p);
+#ifdef _WIN32
+		else {
+			WaitForSingleObject(threads[p], INFINITE);
+			CloseHandle(threads[p]);
+		}
+#else
+		else
+			pthread_join(threads[p], NULL);
+#endif
+	}
+}
+
+static int rec_split(
+	rec_text *rt, const char *text, uint32_t len, uint32_t threads)
+{
+	uint32_t p, seps = 0;
+
+	memset(rt, 0, sizeof(*rt));
+	rt->text = text;
+	rt->len  = len;
+
+	rt->parts = len / RECORDS_PART_MIN;
+	if (rt->parts > threads)
+		rt->parts = threads;
+	if (rt->parts > RECORDS_MAX_PARTS)
+		rt->parts = RECORDS_MAX_PARTS;
+	if (rt->parts < 1)
+		rt->parts = 1;
+
+	rec_run(rt, count_part);
+
+	for (p = 0; p < rt->parts; ++p) {
+		rt->part_first[p] = seps;
+		seps += rt->part_seps[p];
+	}
+
+	rt->count = seps + (len > 0 && text[len - 1] != '\n');
+	if ((uint64_t)rt->count * sizeof(uint64_t) > UINT32_MAX)
+		return -1;
+
+	rt->ends   = malloc((rt->count + 1) * sizeof(uint32_t));
+	rt->hashes = malloc((rt->count + 1) * sizeof(uint64_t));
+	if (!rt->ends || !rt->hashes)
+		return -1;
+
+	rec_run(rt, fill_part);
+	if (rt->count > seps)
+		rt->ends[seps] = len;
+
+	rec_run(rt, hash_part);
+	return 0;
+}
+
+static void rec_free(rec_text *rt)
+{
+	free(rt->ends);
+	free(rt->hashes);
+}
+
+typedef struct {
+	dmp_diff *diff;
+	const dmp_options *opts;
+	dmp_range *out;
+	rec_text a, b;
+} rec_ctx;
+
+/* byte-level diff of records a[a0,a1) and b[b0,b1) */
+static int rec_changed(
+	rec_ctx *ctx, uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1)
+{
+	uint32_t s1 = rec_start(&ctx->a, a0), s2 = rec_start(&ctx->b, b0);
+	dmp_range sub;
+
+	if (a0 == a1 && b0 == b1)
+		return 0;
+
+	if (dmp_diff_main(&sub, ctx->diff, ctx->opts,
+			ctx->a.text + s1, rec_start(&ctx->a, a1) - s1,
+			ctx->b.text + s2, rec_start(&ctx->b, b1) - s2) < 0)
+		return -1;
+
+	if (sub.start >= 0)
+		dmp_range_splice(&ctx->diff->pool, ctx->out, -1, &sub);
+
+	return ctx->diff->pool.error;
+}
+
+/* records a[a0,a0+n) have the same hashes as b[b0,b0+n) */
+static int rec_equal(rec_ctx *ctx, uint32_t a0, uint32_t b0, uint32_t n)
+{
+	dmp_pool *pool = &ctx->diff->pool;
+	uint32_t s1 = rec_start(&ctx->a, a0), s2 = rec_start(&ctx->b, b0);
+	uint32_t len = rec_start(&ctx->a, a0 + n) - s1;
+
+	if (len != rec_start(&ctx->b, b0 + n) - s2 ||
+		memcmp(ctx->a.text + s1, ctx->b.text + s2, len) != 0)
+		return rec_changed(ctx, a0, a0 + n, b0, b0 + n);
+
+	if (dmp_pool_reserve(pool, 1) == 0)
+		dmp_range_insert(
+			pool, ctx->out, -1, DMP_DIFF_EQUAL, ctx->a.text, s1, len);
+
+	return pool->error;
+}
+
+int dmp_diff_records(
+	dmp_range *out,
+	dmp_diff *diff,
+	const dmp_options *opts,
+	const char *text1,
+	uint32_t    len1,
+	const char *text2,
+	uint32_t    len2)
+{
+	rec_ctx ctx;
+	dmp_options seq_opts;
+	dmp_diff *recs = NULL;
+	dmp_hunk *hunks = NULL;
+	uint32_t count = 0, h, i1 = 0, i2 = 0, c1 = 0, c2 = 0;
+	int error;
+
+	if (!text1 || !len1 || !text2 || !len2)
+		return dmp_diff_main(out, diff, opts, text1, len1, text2, len2);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.diff = diff;
+	ctx.opts = opts;
+	ctx.out  = out;
+
+	/* the edit budget is for bytes, so only the byte diffs count it */
+	seq_opts = *opts;
+	seq_opts.max_edits = 0;
+	seq_opts.expected_hunks = 0;
+
+	if (rec_split(&ctx.a, text1, len1, opts->threads) < 0 ||
+		rec_split(&ctx.b, text2, len2, opts->threads) < 0 ||
+		dmp_diff_seq(&recs, &seq_opts, sizeof(uint64_t),
+			ctx.a.hashes, ctx.a.count, ctx.b.hashes, ctx.b.count,
+			NULL, NULL) < 0 ||
+		dmp_diff_to_array(&hunks, &count, recs) < 0) {
+		dmp_diff_free(recs);
+		rec_free(&ctx.a);
+		rec_free(&ctx.b);
+		return -1;
+	}
+
+	dmp_diff_free(recs);
+
+	/* nested Myers diffs must not finish the list themselves */
+	diff->depth++;
+
+	/* allocate sentinel */
+	if (dmp_range_init(&diff->pool, out, DMP_DIFF_EQUAL, text1, 0, 0) < 0)
+		error = -1;
+	else
+		error = 0;
+
+	/* deletes and inserts since the last equal run start at c1 and c2 */
+	for (h = 0; h < count && !error; ++h) {
+		if (hunks[h].op == DMP_DIFF_DELETE)
+			i1 += hunks[h].len;
+		else if (hunks[h].op == DMP_DIFF_INSERT)
+			i2 += hunks[h].len;
+		else {
+			error = rec_changed(&ctx, c1, i1, c2, i2);
+			if (!error)
+				error = rec_equal(&ctx, i1, i2, hunks[h].len);
+			c1 = i1 += hunks[h].len;
+			c2 = i2 += hunks[h].len;
+		}
+	}
+	if (!error)
+		error = rec_changed(&ctx, c1, i1, c2, i2);
+
+	free(hunks);
+	rec_free(&ctx.a);
+	rec_free(&ctx.b);
+
+	if (!error)
+		error = dmp_diff_cleanup_merge(diff, out);
+	if (--diff->depth == 0 && !error)
+		dmp_diff_tally(diff, out);
+
+	return error;
+}
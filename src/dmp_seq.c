@@ -0,0 +1,284 @@
+/**
+ * dmp_seq.c
+ *
+ * Diff of two arrays of fixed-size elements (see dmp_diff_seq)
+ *
+ * The engine in dmp_seq_engine.h is built four times: for 4 and 8 byte
+ * elements compared as words, for other sizes compared with memcmp, and
+ * for elements compared by a callback.  Hunks are emitted in order as
+ * the engine finds them, with the deletes and inserts between two
+ * equalities gathered into one DELETE and one INSERT hunk, which is the
+ * shape that dmp_diff_cleanup_merge gives text diffs.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_diff.h"
+#include "dmp_cpu.h"
+
+#define seq_min(A,B)	(((A) < (B)) ? (A) : (B))
+
+#define SEQ_POOL	8
+#define SEQ_STACK	16
+
+/* a part of the arrays waiting to be diffed, a[a0,a1) against b[b0,b1),
+ * or with `equal` set, a[a0,a1) to emit as unchanged
+ */
+typedef struct {
+	uint32_t a0, a1, b0, b1;
+	int equal;
+} seq_work;
+
+typedef struct {
+	dmp_diff *diff;
+	const char *a, *b;
+	uint32_t size;
+	const dmp_kernels *kern;
+	dmp_seq_callback eq;
+	void *eq_ref;
+	/* edits since the last equality, as a run of `a` and a run of `b` */
+	uint32_t del_at, del_len, ins_at, ins_len;
+	/* parts still to be diffed, the leftmost on top */
+	seq_work *stack;
+	uint32_t depth, alloc;
+} seq_ctx;
+
+static int seq_push(seq_ctx *c,
+	uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1, int equal)
+{
+	dmp_diff *diff = c->diff;
+	seq_work *w;
+
+	if (c->depth == c->alloc) {
+		uint32_t alloc = c->alloc ? 2 * c->alloc : SEQ_STACK;
+		seq_work *grown = realloc(c->stack, alloc * sizeof(*grown));
+		if (!grown)
+			return (diff->pool.error = -1);
+		c->stack = grown;
+		c->alloc = alloc;
+	}
+
+	w = &c->stack[c->depth++];
+	w->a0 = a0;
+	w->a1 = a1;
+	w->b0 = b0;
+	w->b1 = b1;
+	w->equal = equal;
+
+	if (c->depth > diff->stats.max_depth)
+		diff->stats.max_depth = c->depth;
+
+	return 0;
+}
+
+static void seq_flush(seq_ctx *c)
+{
+	dmp_pool *pool = &c->diff->pool;
+
+	if (dmp_pool_reserve(pool, 2) < 0)
+		return;
+
+	if (c->del_len)
+		dmp_range_insert(pool, &c->diff->list, -1, DMP_DIFF_DELETE,
+			c->a, c->del_at * c->size, c->del_len);
+	if (c->ins_len)
+		dmp_range_insert(pool, &c->diff->list, -1, DMP_DIFF_INSERT,
+			c->b, c->ins_at * c->size, c->ins_len);
+
+	c->del_len = c->ins_len = 0;
+}
+
+/* a[at,at+len) is unchanged */
+static void seq_equal(seq_ctx *c, uint32_t at, uint32_t len)
+{
+	dmp_diff *diff = c->diff;
+	const char *text = c->a + (size_t)at * c->size;
+
+	if (!len)
+		return;
+
+	if (c->del_len || c->ins_len)
+		seq_flush(c);
+
+	/* the engine hands out an equality in pieces when a split lands in it */
+	if (diff->list.end >= 0) {
+		dmp_node *last = dmp_node_at(&diff->pool, diff->list.end);
+		if (last->op == DMP_DIFF_EQUAL &&
+			last->text + (size_t)last->len * c->size == text) {
+			last->len += len;
+			return;
+		}
+	}
+
+	if (dmp_pool_reserve(&diff->pool, 1) == 0)
+		dmp_range_insert(&diff->pool, &diff->list, -1, DMP_DIFF_EQUAL,
+			c->a, at * c->size, len);
+}
+
+/* a[a0,a0+n1) was replaced by b[b0,b0+n2); the runs always continue the
+ * pending ones since everything in between was an equality
+ */
+static void seq_edit(
+	seq_ctx *c, uint32_t a0, uint32_t n1, uint32_t b0, uint32_t n2)
+{
+	dmp_diff *diff = c->diff;
+
+	if (n1) {
+		if (!c->del_len)
+			c->del_at = a0;
+		assert(c->del_at + c->del_len == a0);
+		c->del_len += n1;
+	}
+
+	if (n2) {
+		if (!c->ins_len)
+			c->ins_at = b0;
+		assert(c->ins_at + c->ins_len == b0);
+		c->ins_len += n2;
+	}
+
+	diff->edits += n1 + n2;
+	if (diff->max_edits > 0 && diff->edits > diff->max_edits)
+		diff->too_different = 1;
+}
+
+static uint32_t load32(const char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t load64(const char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+#define SEQ_NAME	u32
+#define SEQ_SIZE(C)	4
+#define SEQ_EQ(C, I, J) \
+	(load32((C)->a + (size_t)(I) * 4) == load32((C)->b + (size_t)(J) * 4))
+#define SEQ_BYTEWISE	1
+#include "dmp_seq_engine.h"
+#undef SEQ_NAME
+#undef SEQ_SIZE
+#undef SEQ_EQ
+#undef SEQ_BYTEWISE
+
+#define SEQ_NAME	u64
+#define SEQ_SIZE(C)	8
+#define SEQ_EQ(C, I, J) \
+	(load64((C)->a + (size_t)(I) * 8) == load64((C)->b + (size_t)(J) * 8))
+#define SEQ_BYTEWISE	1
+#include "dmp_seq_engine.h"
+#undef SEQ_NAME
+#undef SEQ_SIZE
+#undef SEQ_EQ
+#undef SEQ_BYTEWISE
+
+#define SEQ_NAME	mem
+#define SEQ_SIZE(C)	((C)->size)
+#define SEQ_EQ(C, I, J) \
+	(!memcmp((C)->a + (size_t)(I) * (C)->size, \
+		(C)->b + (size_t)(J) * (C)->size, (C)->size))
+#define SEQ_BYTEWISE	1
+#include "dmp_seq_engine.h"
+#undef SEQ_NAME
+#undef SEQ_SIZE
+#undef SEQ_EQ
+#undef SEQ_BYTEWISE
+
+#define SEQ_NAME	cb
+#define SEQ_SIZE(C)	((C)->size)
+#define SEQ_EQ(C, I, J) \
+	((C)->eq((C)->eq_ref, (C)->a + (size_t)(I) * (C)->size, \
+		(C)->b + (size_t)(J) * (C)->size) != 0)
+#define SEQ_BYTEWISE	0
+#include "dmp_seq_engine.h"
+#undef SEQ_NAME
+#undef SEQ_SIZE
+#undef SEQ_EQ
+#undef SEQ_BYTEWISE
+
+int dmp_diff_seq(
+	dmp_diff **diff_ptr,
+	const dmp_options *options,
+	uint32_t elem_size,
+	const void *a,
+	uint32_t    na,
+	const void *b,
+	uint32_t    nb,
+	dmp_seq_callback eq,
+	void *eq_ref)
+{
+	dmp_diff *diff;
+	seq_ctx c;
+	uint32_t pool_size = SEQ_POOL;
+	int error;
+
+	assert(diff_ptr);
+
+	*diff_ptr = NULL;
+
+	if (!elem_size ||
+		(uint64_t)na * elem_size > UINT32_MAX ||
+		(uint64_t)nb * elem_size > UINT32_MAX)
+		return -1;
+
+	if (options && options->expected_hunks &&
+		options->expected_hunks < UINT32_MAX - SEQ_POOL)
+		pool_size += options->expected_hunks;
+
+	if ((diff = dmp_diff_alloc(options)) == NULL)
+		return -1;
+
+	if (dmp_pool_alloc(&diff->pool, pool_size) < 0) {
+		free(diff);
+		return -1;
+	}
+
+	diff->list.start = diff->list.end = -1;
+	diff->l1 = na;
+	diff->l2 = nb;
+	diff->seq_size = elem_size;
+
+	memset(&c, 0, sizeof(c));
+	c.diff = diff;
+	c.a = a;
+	c.b = b;
+	c.size = elem_size;
+	c.kern = dmp_cpu_kernels();
+	c.eq = eq;
+	c.eq_ref = eq_ref;
+
+	if (eq)
+		seq_main_cb(&c, 0, na, 0, nb);
+	else if (elem_size == 4)
+		seq_main_u32(&c, 0, na, 0, nb);
+	else if (elem_size == 8)
+		seq_main_u64(&c, 0, na, 0, nb);
+	else
+		seq_main_mem(&c, 0, na, 0, nb);
+
+	seq_flush(&c);
+	free(c.stack);
+
+	if ((error = diff->pool.error) < 0) {
+		dmp_diff_free(diff);
+		return error;
+	}
+
+	dmp_diff_tally(diff, &diff->list);
+
+	*diff_ptr = diff;
+	return diff->too_different ? DMP_TOO_DIFFERENT : 0;
+}
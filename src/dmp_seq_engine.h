@@ -0,0 +1,245 @@
+/**
+ * dmp_seq_engine.h
+ *
+ * Myers diff over array elements, included by dmp_seq.c once for each
+ * way of comparing elements.  Before including it, define:
+ *
+ *   SEQ_NAME          - suffix that makes the function names unique
+ *   SEQ_SIZE(C)       - bytes per element
+ *   SEQ_EQ(C, I, J)   - whether element I of `a` equals element J of `b`
+ *   SEQ_BYTEWISE      - 1 if elements are equal exactly when their bytes
+ *                       are, so runs of them can be found with the byte
+ *                       comparison kernels, or 0 to call SEQ_EQ for each
+ *
+ * This follows the diff engine in dmp.c, with indexes into the arrays in
+ * place of text pointers, and its own stack of parts in the seq_ctx.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+
+#define SEQ_PASTE(A, B)	A##_##B
+#define SEQ_XPASTE(A, B)	SEQ_PASTE(A, B)
+#define SEQ_FN(NAME)	SEQ_XPASTE(NAME, SEQ_NAME)
+
+/* equal elements from a[i] and b[j] onwards, at most n of them */
+static uint32_t SEQ_FN(seq_prefix)(
+	const seq_ctx *c, uint32_t i, uint32_t j, uint32_t n)
+{
+#if SEQ_BYTEWISE
+	return c->kern->common_prefix(
+		c->a + (size_t)i * SEQ_SIZE(c), n * SEQ_SIZE(c),
+		c->b + (size_t)j * SEQ_SIZE(c), n * SEQ_SIZE(c)) / SEQ_SIZE(c);
+#else
+	uint32_t k = 0;
+	while (k < n && SEQ_EQ(c, i + k, j + k))
+		k++;
+	return k;
+#endif
+}
+
+/* equal elements ending just before a[i] and b[j], at most n of them */
+static uint32_t SEQ_FN(seq_suffix)(
+	const seq_ctx *c, uint32_t i, uint32_t j, uint32_t n)
+{
+#if SEQ_BYTEWISE
+	return c->kern->common_suffix(
+		c->a + (size_t)(i - n) * SEQ_SIZE(c), n * SEQ_SIZE(c),
+		c->b + (size_t)(j - n) * SEQ_SIZE(c), n * SEQ_SIZE(c)) / SEQ_SIZE(c);
+#else
+	uint32_t k = 0;
+	while (k < n && SEQ_EQ(c, i - k - 1, j - k - 1))
+		k++;
+	return k;
+#endif
+}
+
+/* find the middle snake of a[a0,a0+n1) and b[b0,b0+n2) and split there,
+ * pushing the right part and then the left
+ */
+static int SEQ_FN(seq_bisect)(
+	seq_ctx *c, uint32_t a0, uint32_t n1, uint32_t b0, uint32_t n2)
+{
+	dmp_diff *diff = c->diff;
+	int max_d, v_offset, v_length, d;
+	int delta, front, k1start, k1end, k2start, k2end, *v1, *v2;
+
+	/* unlike texts, one element against one can get here, so leave room
+	 * for the v[v_offset + 1] slot even when max_d is 1
+	 */
+	v_offset = max_d = (n1 + n2 + 1) / 2;
+	v_length = 2 * max_d + 2;
+	delta = (int)n1 - (int)n2;
+	front = (delta % 2 != 0);
+	k1start = k1end = k2start = k2end = 0;
+
+	diff->stats.bisect_calls++;
+
+	if ((int)diff->v_alloc < v_length) {
+		int *v = malloc(2 * (size_t)v_length * sizeof(int));
+		if (!v)
+			return (diff->pool.error = -1);
+
+		free(diff->v1);
+		diff->v1 = v;
+		diff->v_alloc = v_length;
+	}
+	v1 = diff->v1;
+	v2 = diff->v1 + v_length;
+	memset(v1, 0xff, v_length * sizeof(int));
+	memset(v2, 0xff, v_length * sizeof(int));
+	v1[v_offset + 1] = 0;
+	v2[v_offset + 1] = 0;
+
+	for (d = 0; d < max_d; d++) {
+		int k1, k2;
+
+		if (diff->deadline > 0 && dmp_time() > diff->deadline) {
+			diff->stats.timed_out = 1;
+			break;
+		}
+
+		if (diff->max_edits > 0 && d > 0 &&
+			diff->edits + 2 * d - 1 > diff->max_edits)
+			break;
+
+		/* advance the front contour */
+		for (k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+			int k1off = v_offset + k1;
+			uint32_t x1, y1;
+
+			if (k1 == -d || (k1 != d && v1[k1off - 1] < v1[k1off + 1]))
+				x1 = v1[k1off + 1];
+			else
+				x1 = v1[k1off - 1] + 1;
+			y1 = x1 - k1;
+
+			if (x1 < n1 && y1 < n2 && SEQ_EQ(c, a0 + x1, b0 + y1)) {
+				uint32_t snake = 1 + SEQ_FN(seq_prefix)(c,
+					a0 + x1 + 1, b0 + y1 + 1,
+					seq_min(n1 - x1, n2 - y1) - 1);
+				x1 += snake;
+				y1 += snake;
+			}
+
+			v1[k1off] = x1;
+			if (x1 > n1)
+				k1end += 2;
+			else if (y1 > n2)
+				k1start += 2;
+			else if (front) {
+				int k2off = v_offset + delta - k1;
+				if (k2off >= 0 && k2off < v_length && v2[k2off] != -1) {
+					uint32_t x2 = (int)n1 - v2[k2off];
+					if (x1 >= x2) {
+						if (seq_push(c, a0 + x1, a0 + n1,
+								b0 + y1, b0 + n2, 0) < 0)
+							return -1;
+						return seq_push(
+							c, a0, a0 + x1, b0, b0 + y1, 0);
+					}
+				}
+			}
+		}
+
+		/* advance the reverse contour */
+		for (k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+			int k2off = v_offset + k2;
+			uint32_t x2, y2;
+
+			if (k2 == -d || (k2 != d && v2[k2off - 1] < v2[k2off + 1]))
+				x2 = v2[k2off + 1];
+			else
+				x2 = v2[k2off - 1] + 1;
+			y2 = x2 - k2;
+
+			if (x2 < n1 && y2 < n2 &&
+				SEQ_EQ(c, a0 + n1 - x2 - 1, b0 + n2 - y2 - 1)) {
+				uint32_t snake = 1 + SEQ_FN(seq_suffix)(c,
+					a0 + n1 - x2 - 1, b0 + n2 - y2 - 1,
+					seq_min(n1 - x2, n2 - y2) - 1);
+				x2 += snake;
+				y2 += snake;
+			}
+
+			v2[k2off] = x2;
+			if (x2 > n1)
+				k2end += 2;
+			else if (y2 > n2)
+				k2start += 2;
+			else if (!front) {
+				int k1off = v_offset + delta - k2;
+				if (k1off >= 0 && k1off < v_length && v1[k1off] != -1) {
+					uint32_t x1 = v1[k1off], y1 = v_offset + x1 - k1off;
+					x2 = n1 - x2;
+					if (x1 >= x2) {
+						if (seq_push(c, a0 + x1, a0 + n1,
+								b0 + y1, b0 + n2, 0) < 0)
+							return -1;
+						return seq_push(
+							c, a0, a0 + x1, b0, b0 + y1, 0);
+					}
+				}
+			}
+		}
+	}
+
+	/* out of time or edit budget, or nothing in common */
+	seq_edit(c, a0, n1, b0, n2);
+	return diff->pool.error;
+}
+
+/* trim one part, leaving its suffix on the stack under what the middle
+ * turns into
+ */
+static int SEQ_FN(seq_part)(
+	seq_ctx *c, uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1)
+{
+	dmp_diff *diff = c->diff;
+	uint32_t common, suffix;
+
+	common = SEQ_FN(seq_prefix)(c, a0, b0, seq_min(a1 - a0, b1 - b0));
+	seq_equal(c, a0, common);
+	a0 += common;
+	b0 += common;
+
+	suffix = SEQ_FN(seq_suffix)(c, a1, b1, seq_min(a1 - a0, b1 - b0));
+	a1 -= suffix;
+	b1 -= suffix;
+
+	if (suffix && seq_push(c, a1, a1 + suffix, 0, 0, 1) < 0)
+		return -1;
+
+	if (a0 == a1 || b0 == b1 || diff->too_different)
+		seq_edit(c, a0, a1 - a0, b0, b1 - b0);
+	else
+		SEQ_FN(seq_bisect)(c, a0, a1 - a0, b0, b1 - b0);
+
+	return diff->pool.error;
+}
+
+static int SEQ_FN(seq_main)(
+	seq_ctx *c, uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1)
+{
+	dmp_diff *diff = c->diff;
+
+	if (seq_push(c, a0, a1, b0, b1, 0) < 0)
+		return -1;
+
+	while (c->depth > 0 && !diff->pool.error) {
+		seq_work w = c->stack[--c->depth];
+
+		if (w.equal)
+			seq_equal(c, w.a0, w.a1 - w.a0);
+		else
+			SEQ_FN(seq_part)(c, w.a0, w.a1, w.b0, w.b1);
+	}
+
+	return diff->pool.error;
+}
+
+#undef SEQ_FN
+#undef SEQ_XPASTE
+#undef SEQ_PASTE
@@ -0,0 +1,259 @@
+/**
+ * dmp_strstr.c
+ *
+ * Substring search used for the diff "common middle" checks
+ *
+ * Candidate positions are found by comparing the first and the last byte
+ * of the needle against a block of haystack positions at a time (16 with
+ * SSE2, 32 with AVX2, 64 with AVX-512BW) and only the candidates are
+ * verified with memcmp.  A needle that keeps producing false candidates
+ * switches the rest of the search over to the Two-Way algorithm, which is
+ * linear in the worst case.  Each instruction set gets its own version,
+ * and dmp_cpu.c picks the one to use.
+ *
+ * Copyright (c) Russell Belfer <rb@github.com>
+ * https://github.com/arrbee/google-diff-match-patch-c/
+ *
+ * See included LICENSE file for license details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dmp.h"
+#include "dmp_cpu.h"
+
+/* verification work allowed per haystack byte before using Two-Way */
+#define VERIFY_RATIO	4
+#define VERIFY_SLACK	256
+
+/* split needle for Two-Way; returns the start of the right half */
+static size_t critical_factorization(
+	const unsigned char *n, size_t ln, size_t *period)
+{
+	size_t ms, ms_rev, j, k, p;
+
+	/* maximal suffix for the byte order */
+	ms = (size_t)-1;
+	j = 0;
+	k = p = 1;
+	while (j + k < ln) {
+		unsigned char a = n[j + k], b = n[ms + k];
+		if (a < b) {
+			j += k;
+			k = 1;
+			p = j - ms;
+		} else if (a == b) {
+			if (k != p)
+				++k;
+			else {
+				j += p;
+				k = 1;
+			}
+		} else {
+			ms = j++;
+			k = p = 1;
+		}
+	}
+	*period = p;
+
+	/* and for the reversed byte order */
+	ms_rev = (size_t)-1;
+	j = 0;
+	k = p = 1;
+	while (j + k < ln) {
+		unsigned char a = n[j + k], b = n[ms_rev + k];
+		if (b < a) {
+			j += k;
+			k = 1;
+			p = j - ms_rev;
+		} else if (a == b) {
+			if (k != p)
+				++k;
+			else {
+				j += p;
+				k = 1;
+			}
+		} else {
+			ms_rev = j++;
+			k = p = 1;
+		}
+	}
+
+	/* the longer of the two maximal suffixes gives a critical split */
+	if (ms_rev + 1 < ms + 1)
+		return ms + 1;
+
+	*period = p;
+	return ms_rev + 1;
+}
+
+/* Crochemore-Perrin Two-Way search, O(lh + ln) time and O(1) space */
+static const char *two_way(
+	const char *haystack, size_t lh, const char *needle, size_t ln)
+{
+	const unsigned char *h = (const unsigned char *)haystack;
+	const unsigned char *n = (const unsigned char *)needle;
+	size_t split, period, i, j = 0, memory = 0;
+
+	if (ln > lh)
+		return NULL;
+
+	split = critical_factorization(n, ln, &period);
+
+	if (!memcmp(n, n + period, split)) {
+		/* periodic needle: remember how much of it is known to match */
+		while (j <= lh - ln) {
+			i = (split > memory) ? split : memory;
+			while (i < ln && n[i] == h[i + j])
+				++i;
+			if (i >= ln) {
+				i = split - 1;
+				while (memory < i + 1 && n[i] == h[i + j])
+					--i;
+				if (i + 1 < memory + 1)
+					return haystack + j;
+				j += period;
+				memory = ln - period;
+			} else {
+				j += i - split + 1;
+				memory = 0;
+			}
+		}
+	} else {
+		period = ((split > ln - split) ? split : ln - split) + 1;
+		while (j <= lh - ln) {
+			i = split;
+			while (i < ln && n[i] == h[i + j])
+				++i;
+			if (i >= ln) {
+				i = split - 1;
+				while (i != (size_t)-1 && n[i] == h[i + j])
+					--i;
+				if (i == (size_t)-1)
+					return haystack + j;
+				j += period;
+			} else
+				j += i - split + 1;
+		}
+	}
+
+	return NULL;
+}
+
+/* verify a candidate, tracking how much verification work has been done */
+#define CHECK_CANDIDATE(POS) do { \
+	if (!memcmp(haystack + (POS) + 1, needle + 1, ln - 2)) \
+		return haystack + (POS); \
+	work += ln; \
+	if (work > VERIFY_RATIO * (size_t)(POS) + VERIFY_SLACK) \
+		return two_way(haystack + (POS) + 1, lh - (POS) - 1, needle, ln); \
+	} while (0)
+
+/* positions from `i` on (or all of them without SIMD) */
+static const char *search_rest(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln,
+	size_t i, size_t work)
+{
+	unsigned char first = (unsigned char)needle[0];
+	unsigned char last  = (unsigned char)needle[ln - 1];
+
+	while (i <= (size_t)(lh - ln)) {
+		const char *scan = memchr(haystack + i, first, lh - ln - i + 1);
+		if (!scan)
+			return NULL;
+		i = (size_t)(scan - haystack);
+		if ((unsigned char)haystack[i + ln - 1] == last)
+			CHECK_CANDIDATE(i);
+		i++;
+	}
+
+	return NULL;
+}
+
+const char *dmp_strstr_generic(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	return search_rest(haystack, lh, needle, ln, 0, 0);
+}
+
+#ifdef DMP_CPU_X86
+
+DMP_TARGET("sse2")
+const char *dmp_strstr_sse2(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	const __m128i vf = _mm_set1_epi8(needle[0]);
+	const __m128i vl = _mm_set1_epi8(needle[ln - 1]);
+	size_t i = 0, work = 0;
+
+	for (; i + ln - 1 + 16 <= lh; i += 16) {
+		__m128i bf = _mm_loadu_si128((const __m128i *)(haystack + i));
+		__m128i bl = _mm_loadu_si128(
+			(const __m128i *)(haystack + i + ln - 1));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(vf, bf), _mm_cmpeq_epi8(vl, bl)));
+
+		for (; mask != 0; mask &= mask - 1)
+			CHECK_CANDIDATE(i + dmp_ctz32(mask));
+	}
+
+	return search_rest(haystack, lh, needle, ln, i, work);
+}
+
+DMP_TARGET("avx2")
+const char *dmp_strstr_avx2(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	const __m256i vf = _mm256_set1_epi8(needle[0]);
+	const __m256i vl = _mm256_set1_epi8(needle[ln - 1]);
+	size_t i = 0, work = 0;
+
+	for (; i + ln - 1 + 32 <= lh; i += 32) {
+		__m256i bf = _mm256_loadu_si256((const __m256i *)(haystack + i));
+		__m256i bl = _mm256_loadu_si256(
+			(const __m256i *)(haystack + i + ln - 1));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(vf, bf), _mm256_cmpeq_epi8(vl, bl)));
+
+		for (; mask != 0; mask &= mask - 1)
+			CHECK_CANDIDATE(i + dmp_ctz32(mask));
+	}
+
+	return search_rest(haystack, lh, needle, ln, i, work);
+}
+
+DMP_TARGET("avx512bw")
+const char *dmp_strstr_avx512(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	const __m512i vf = _mm512_set1_epi8(needle[0]);
+	const __m512i vl = _mm512_set1_epi8(needle[ln - 1]);
+	size_t i = 0, work = 0;
+
+	for (; i + ln - 1 + 64 <= lh; i += 64) {
+		__mmask64 mask = _mm512_cmpeq_epi8_mask(vf,
+			_mm512_loadu_si512((const void *)(haystack + i))) &
+			_mm512_cmpeq_epi8_mask(vl,
+			_mm512_loadu_si512((const void *)(haystack + i + ln - 1)));
+
+		for (; mask != 0; mask &= mask - 1)
+			CHECK_CANDIDATE(i + dmp_ctz64(mask));
+	}
+
+	return search_rest(haystack, lh, needle, ln, i, work);
+}
+
+#endif
+
+const char *dmp_strstr(
+	const char *haystack, uint32_t lh, const char *needle, uint32_t ln)
+{
+	if (ln == 0)
+		return haystack;
+	if (ln > lh)
+		return NULL;
+	if (ln == 1)
+		return memchr(haystack, (unsigned char)needle[0], lh);
+
+	return dmp_cpu_kernels()->strstr(haystack, lh, needle, ln);
+}
@@ -4,6 +4,8 @@
  * Tests for public APIs of libdmp (plus a quick and dirty test driver)
  */
 
+#include <pthread.h>
+
 #include "dmp_test.h"
 
 void test_util_0(void)
@@ -30,6 +32,50 @@ void test_util_0(void)
 	progress();
 }
 
+void test_strstr_0(void)
+{
+	char hay[4096], needle[80];
+	const char *text = "the quick brown fox jumps over the lazy dog";
+	uint32_t i;
+
+	assert(dmp_strstr(text, 43, "", 0) == text);
+	assert(dmp_strstr(text, 43, "t", 1) == text);
+	assert(dmp_strstr(text, 43, "dog", 3) == text + 40);
+	assert(dmp_strstr(text, 43, "the lazy", 8) == text + 31);
+	assert(dmp_strstr(text, 43, "cat", 3) == NULL);
+	assert(dmp_strstr(text, 3, "the quick", 9) == NULL);
+	assert(dmp_strstr(text, 42, "dog", 3) == NULL);
+	assert(dmp_strstr("ab\000cd\000ef", 7, "\000ef", 3) == NULL);
+	assert(dmp_strstr("ab\000cd\000ef", 8, "\000cd", 3) != NULL);
+	progress();
+
+	/* matches past the vector blocks and right at the end of the text */
+	memset(hay, 'x', sizeof(hay));
+	memcpy(hay + sizeof(hay) - 5, "abcde", 5);
+	assert(dmp_strstr(hay, sizeof(hay), "abcde", 5) == hay + sizeof(hay) - 5);
+	assert(dmp_strstr(hay, sizeof(hay) - 1, "abcde", 5) == NULL);
+	for (i = 0; i < 64; ++i) {
+		memset(hay, 'x', 100);
+		memcpy(hay + i, "xyx", 3);
+		assert(dmp_strstr(hay, 100, "xyx", 3) == hay + i);
+	}
+	progress();
+
+	/* every position is a candidate, which hands over to Two-Way */
+	memset(hay, 'a', sizeof(hay));
+	memset(needle, 'a', sizeof(needle));
+	needle[40] = 'b';
+	assert(dmp_strstr(hay, sizeof(hay), needle, sizeof(needle)) == NULL);
+	hay[3000] = 'b';
+	assert(dmp_strstr(hay, sizeof(hay), needle, sizeof(needle)) == hay + 2960);
+	needle[40] = 'a';
+	needle[79] = 'b';
+	hay[3000] = 'a';
+	hay[4095] = 'b';
+	assert(dmp_strstr(hay, sizeof(hay), needle, sizeof(needle)) == hay + 4016);
+	progress();
+}
+
 struct diff_stat_data {
 	uint32_t deletes;
 	uint32_t delete_bytes;
@@ -211,11 +257,1564 @@ void test_diff_0(void)
 	dmp_diff_free(diff);
 }
 
+/* rebuilds both texts of a diff into buffers the caller provides */
+struct diff_text_data {
+	char *t1, *t2;
+	uint32_t l1, l2;
+};
+
+static int diff_texts(
+	void *ref, dmp_operation_t op, const void *data, uint32_t len)
+{
+	struct diff_text_data *d = ref;
+
+	if (op != DMP_DIFF_INSERT) {
+		memcpy(d->t1 + d->l1, data, len);
+		d->l1 += len;
+	}
+	if (op != DMP_DIFF_DELETE) {
+		memcpy(d->t2 + d->l2, data, len);
+		d->l2 += len;
+	}
+
+	return 0;
+}
+
+static void expect_diff_texts(dmp_diff *diff, const char *t1, const char *t2)
+{
+	struct diff_text_data d;
+	char b1[256], b2[256];
+
+	d.t1 = b1;
+	d.t2 = b2;
+	d.l1 = d.l2 = 0;
+
+	assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+
+	assert(d.l1 == strlen(t1) && !memcmp(d.t1, t1, d.l1));
+	assert(d.l2 == strlen(t2) && !memcmp(d.t2, t2, d.l2));
+}
+
+void test_diff_lines_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	const char *t1, *t2;
+	struct diff_text_data d;
+	struct diff_stat_data st;
+	char *b1 = malloc(80000), *b2 = malloc(80000);
+	uint32_t l1, l2;
+	int algorithm, i;
+
+	d.t1 = malloc(80000);
+	d.t2 = malloc(80000);
+	dmp_options_init(&opts);
+
+	for (algorithm = DMP_ALGORITHM_PATIENCE;
+		 algorithm <= DMP_ALGORITHM_HISTOGRAM; ++algorithm) {
+		opts.algorithm = algorithm;
+
+		t1 = "one\ntwo\nthree\nfour\n";
+		t2 = "one\nTWO\nthree\nfour\nfive\n";
+		assert(dmp_diff_from_strs(&diff, &opts, t1, t2) == 0);
+		expect_diff_texts(diff, t1, t2);
+		/* expect: eq='one\n' del='two' ins='TWO' eq='\nthree\nfour\n'
+		 * ins='five\n'
+		 */
+		expect_diff_stat(diff, 1, 2, 2, 0x0d); /* 01101 */
+		dmp_diff_free(diff);
+
+		/* moved block of lines around a unique anchor */
+		t1 = "{\n}\nfoo();\n{\n}\nbar();\n";
+		t2 = "{\n}\nbar();\n{\n}\nfoo();\n";
+		assert(dmp_diff_from_strs(&diff, &opts, t1, t2) == 0);
+		expect_diff_texts(diff, t1, t2);
+		dmp_diff_free(diff);
+
+		t1 = "no newline";
+		t2 = "no newline at all";
+		assert(dmp_diff_from_strs(&diff, &opts, t1, t2) == 0);
+		expect_diff_texts(diff, t1, t2);
+		expect_diff_stat(diff, 0, 1, 1, 0x01);
+		dmp_diff_free(diff);
+
+		assert(dmp_diff_from_strs(&diff, &opts, "", "x\ny\n") == 0);
+		expect_diff_stat(diff, 0, 0, 1, 0x01);
+		dmp_diff_free(diff);
+
+		assert(dmp_diff_from_strs(&diff, &opts, "same\n", "same\n") == 0);
+		expect_diff_stat(diff, 0, 1, 0, 0x00);
+		dmp_diff_free(diff);
+
+		/* every other line changed: each anchor nests the next region */
+		for (i = l1 = l2 = 0; i < 5000; ++i) {
+			l1 += sprintf(b1 + l1, "line %d\n%s\n", i, "old");
+			l2 += sprintf(b2 + l2, "line %d\n%s\n", i, "new");
+		}
+		assert(dmp_diff_new(&diff, &opts, b1, l1, b2, l2) == 0);
+		d.l1 = d.l2 = 0;
+		assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+		assert(d.l1 == l1 && !memcmp(d.t1, b1, l1));
+		assert(d.l2 == l2 && !memcmp(d.t2, b2, l2));
+		memset(&st, 0, sizeof(st));
+		assert(dmp_diff_foreach(diff, diff_stats, &st) == 0);
+		assert(st.deletes == 5000 && st.inserts == 5000);
+		assert(st.equals == 5001);
+		dmp_diff_free(diff);
+	}
+
+	free(b1);
+	free(b2);
+	free(d.t1);
+	free(d.t2);
+}
+
+void test_diff_bounded_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	uint32_t dist;
+
+	assert(dmp_diff_distance_bounded(&dist, "abc", 3, "abc", 3, 0) == 0);
+	assert(dist == 0);
+	assert(dmp_diff_distance_bounded(&dist, "abc", 3, "abd", 3, 2) == 0);
+	assert(dist == 2);
+	assert(dmp_diff_distance_bounded(&dist, "abc", 3, "abd", 3, 1) ==
+		DMP_TOO_DIFFERENT);
+	assert(dmp_diff_distance_bounded(&dist, "", 0, "abc", 3, 3) == 0);
+	assert(dist == 3);
+	assert(dmp_diff_distance_bounded(&dist, "", 0, "abc", 3, 2) ==
+		DMP_TOO_DIFFERENT);
+	/* lcs is "ittn" so 2 deletes plus 3 inserts */
+	assert(dmp_diff_distance_bounded(
+		&dist, "kitten", 6, "sitting", 7, 5) == 0);
+	assert(dist == 5);
+	assert(dmp_diff_distance_bounded(
+		&dist, "kitten", 6, "sitting", 7, 4) == DMP_TOO_DIFFERENT);
+	progress();
+
+	dmp_options_init(&opts);
+	opts.max_edits = 5;
+
+	assert(dmp_diff_from_strs(&diff, &opts, "kitten", "sitting") == 0);
+	expect_diff_texts(diff, "kitten", "sitting");
+	dmp_diff_free(diff);
+
+	opts.max_edits = 4;
+
+	assert(dmp_diff_from_strs(&diff, &opts, "kitten", "sitting") ==
+		DMP_TOO_DIFFERENT);
+	expect_diff_texts(diff, "kitten", "sitting");
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_from_strs(&diff, &opts, "abcdefgh", "zyxwvuts") ==
+		DMP_TOO_DIFFERENT);
+	expect_diff_stat(diff, 1, 0, 1, 0x03);
+	dmp_diff_free(diff);
+}
+
+void test_diff_stats_0(void)
+{
+	dmp_diff *diff;
+	dmp_stats st;
+
+	dmp_diff_from_strs(
+		&diff, NULL, "Apples are a fruit.", "Bananas are also fruit.");
+	/* expect: del='Apple' ins='Banana' eq='s are a' ins='lso' eq ' fruit.' */
+	dmp_diff_stats(diff, &st);
+	assert(st.deletes == 1 && st.delete_bytes == 5);
+	assert(st.inserts == 2 && st.insert_bytes == 9);
+	assert(st.equals == 2 && st.equal_bytes == 14);
+	assert(st.levenshtein == 6 + 3);
+	/* short enough after trimming for the bit vectors, not the bisect */
+	assert(st.bitpar_calls == 1 && st.bisect_calls == 0);
+	assert(st.max_depth == 1);
+	assert(st.nodes_used >= 5);
+	assert(!st.timed_out && !st.too_different);
+	dmp_diff_free(diff);
+	progress();
+
+	dmp_diff_from_strs(&diff, NULL, "abcxyz", "1234xyz");
+	dmp_diff_stats(diff, &st);
+	assert(st.deletes == 1 && st.inserts == 1 && st.equals == 1);
+	assert(st.levenshtein == 4);
+	dmp_diff_free(diff);
+
+	dmp_diff_from_strs(&diff, NULL, "", "");
+	dmp_diff_stats(diff, &st);
+	assert(st.equals + st.inserts + st.deletes == 0);
+	assert(st.levenshtein == 0);
+	dmp_diff_free(diff);
+	progress();
+
+	/* text inside the other is found by the "common middle" check */
+	dmp_diff_from_strs(&diff, NULL, "xabcdefghy", "abcdefgh");
+	dmp_diff_stats(diff, &st);
+	assert(st.contain_checks == 1 && st.contain_hits == 1);
+	assert(st.contain_skips == 0 && st.contain_bytes == 8);
+	assert(st.bisect_calls == 0);
+	expect_diff_stat(diff, 2, 1, 0, 0x5);
+	dmp_diff_free(diff);
+
+	/* lengths too close after trimming for one to contain the other */
+	dmp_diff_from_strs(&diff, NULL, "abcXdef", "abcYZdef");
+	dmp_diff_stats(diff, &st);
+	assert(st.contain_skips >= 1 && st.contain_checks == 0);
+	dmp_diff_free(diff);
+
+	/* sampled bytes of the shorter text rule out every offset */
+	dmp_diff_from_strs(&diff, NULL,
+		"0123456789abcdefghij", "ZYXWVUTSRQPONMLKJIHGFEDCBA!?");
+	dmp_diff_stats(diff, &st);
+	assert(st.contain_skips == 1 && st.contain_checks == 0);
+	expect_diff_texts(diff,
+		"0123456789abcdefghij", "ZYXWVUTSRQPONMLKJIHGFEDCBA!?");
+	dmp_diff_free(diff);
+	progress();
+}
+
+void test_diff_same_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_stats st;
+	char copy[16];
+	const char *text = "unchanged text";
+
+	strcpy(copy, text);
+
+	assert(dmp_diff_from_strs(&diff, NULL, text, text) == 0);
+	expect_diff_stat(diff, 0, 1, 0, 0x0);
+	dmp_diff_stats(diff, &st);
+	assert(st.nodes_used == 1 && st.max_depth == 0);
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_from_strs(&diff, NULL, text, copy) == 0);
+	expect_diff_stat(diff, 0, 1, 0, 0x0);
+	expect_diff_texts(diff, text, copy);
+	dmp_diff_stats(diff, &st);
+	assert(st.nodes_used == 1 && st.max_depth == 0);
+	assert(st.equal_bytes == strlen(text));
+	dmp_diff_free(diff);
+
+	/* caller-supplied hashes rule out a match, but equal ones are only
+	 * taken as a hint, so a collision still gets a real diff
+	 */
+	dmp_options_init(&opts);
+	opts.text1_hash = opts.text2_hash = 0x1234;
+	assert(dmp_diff_from_strs(&diff, &opts, text, copy) == 0);
+	expect_diff_stat(diff, 0, 1, 0, 0x0);
+	dmp_diff_free(diff);
+
+	copy[0] = 'U';
+	assert(dmp_diff_from_strs(&diff, &opts, text, copy) == 0);
+	expect_diff_stat(diff, 1, 1, 1, 0x6);
+	expect_diff_texts(diff, text, copy);
+	dmp_diff_free(diff);
+
+	opts.text2_hash = 0x5678;
+	assert(dmp_diff_from_strs(&diff, &opts, text, copy) == 0);
+	expect_diff_stat(diff, 1, 1, 1, 0x6);
+	expect_diff_texts(diff, text, copy);
+	dmp_diff_free(diff);
+}
+
+void test_diff_cache_0(void)
+{
+	dmp_cache *cache;
+	dmp_diff *d1, *d2, *d3;
+	char buf[64];
+	uint8_t bytes[100];
+	int i;
+
+	/* reference XXH64 values */
+	assert(dmp_hash64("", 0, 0) == 0xef46db3751d8e999ULL);
+	assert(dmp_hash64("", 0, 1) == 0xd5afba1336a3be4bULL);
+	assert(dmp_hash64("a", 1, 0) == 0xd24ec4f1a98c6e5bULL);
+	assert(dmp_hash64("abc", 3, 1) == 0xbea9ca8199328908ULL);
+	assert(dmp_hash64("Nobody inspects the spammish repetition", 39, 0) ==
+		0xfbcea83c8a378bf1ULL);
+	for (i = 0; i < 100; ++i)
+		bytes[i] = (uint8_t)i;
+	assert(dmp_hash64(bytes, 100, 0) == 0x6ac1e58032166597ULL);
+	assert(dmp_hash64(bytes, 100, 1) == 0x3d19a3a2098a7023ULL);
+	progress();
+
+	assert(dmp_cache_new(&cache, 4096) == 0);
+
+	strcpy(buf, "The cat sat on the mat.");
+	assert(dmp_cache_diff(&d1, cache, NULL, buf, 23, "The dog sat on a mat.", 21) == 0);
+	expect_diff_texts(d1, "The cat sat on the mat.", "The dog sat on a mat.");
+
+	/* same content from a different buffer is a hit on the same object */
+	strcpy(buf, "The cat sat on the mat.");
+	assert(dmp_cache_diff(&d2, cache, NULL, buf, 23, "The dog sat on a mat.", 21) == 0);
+	assert(d1 == d2);
+
+	/* the cached diff does not depend on the caller's buffer */
+	memset(buf, 'x', sizeof(buf));
+	expect_diff_texts(d2, "The cat sat on the mat.", "The dog sat on a mat.");
+	dmp_diff_free(d1);
+	dmp_diff_free(d2);
+	progress();
+
+	/* different options are a different entry */
+	{
+		dmp_options opts;
+		dmp_options_init(&opts);
+		opts.max_edits = 2;
+		assert(dmp_cache_diff(&d3, cache, &opts,
+			"The cat sat on the mat.", 23, "The dog sat on a mat.", 21) ==
+			DMP_TOO_DIFFERENT);
+		assert(d3 != d1);
+		assert(dmp_cache_diff(&d2, cache, &opts,
+			"The cat sat on the mat.", 23, "The dog sat on a mat.", 21) ==
+			DMP_TOO_DIFFERENT);
+		assert(d3 == d2);
+		dmp_diff_free(d2);
+	}
+
+	/* pairs whose hashes collide are still told apart */
+	{
+		dmp_options opts;
+		dmp_options_init(&opts);
+		opts.text1_hash = 1;
+		opts.text2_hash = 2;
+		assert(dmp_cache_diff(&d1, cache, &opts, "abc", 3, "abd", 3) == 0);
+		assert(dmp_cache_diff(&d2, cache, &opts, "xyz", 3, "xyw", 3) == 0);
+		assert(d1 != d2);
+		expect_diff_texts(d2, "xyz", "xyw");
+		dmp_diff_free(d1);
+		dmp_diff_free(d2);
+	}
+
+	/* evicted diffs stay valid while callers still hold them */
+	dmp_cache_clear(cache);
+	expect_diff_texts(d3, "The cat sat on the mat.", "The dog sat on a mat.");
+	dmp_diff_free(d3);
+	progress();
+
+	/* too large for the cache, so diffed directly */
+	dmp_cache_free(cache);
+	assert(dmp_cache_new(&cache, 16) == 0);
+	assert(dmp_cache_diff(&d1, cache, NULL, "abcdefghij", 10, "abcXefghij", 10) == 0);
+	assert(dmp_cache_diff(&d2, cache, NULL, "abcdefghij", 10, "abcXefghij", 10) == 0);
+	assert(d1 != d2);
+	expect_diff_texts(d2, "abcdefghij", "abcXefghij");
+	dmp_diff_free(d1);
+	dmp_diff_free(d2);
+	dmp_cache_free(cache);
+}
+
+struct array_check {
+	const dmp_hunk *hunks;
+	const char *t1, *t2;
+	uint32_t at;
+};
+
+static int check_hunk(
+	void *ref, dmp_operation_t op, const void *data, uint32_t len)
+{
+	struct array_check *ac = ref;
+	const dmp_hunk *h = &ac->hunks[ac->at++];
+	const char *base = h->side ? ac->t2 : ac->t1;
+
+	assert(h->op == (int)op && h->len == len);
+	assert(h->side == (op == DMP_DIFF_INSERT));
+	assert(!memcmp(base + h->offset, data, len));
+	return 0;
+}
+
+void test_diff_array_0(void)
+{
+	dmp_diff *diff;
+	dmp_hunk *hunks, buf[2];
+	uint32_t count;
+	struct array_check ac;
+	const char *t1 = "The cat sat on the mat.", *t2 = "A dog sat on a mat!";
+
+	assert(dmp_diff_from_strs(&diff, NULL, t1, t2) == 0);
+	assert(dmp_diff_to_array(&hunks, &count, diff) == 0);
+	assert(count == dmp_diff_hunks(diff) && count > 2);
+
+	ac.hunks = hunks;
+	ac.t1 = t1;
+	ac.t2 = t2;
+	ac.at = 0;
+	assert(dmp_diff_foreach(diff, check_hunk, &ac) == 0);
+	assert(ac.at == count);
+	progress();
+
+	/* caller-supplied memory is filled up to its size */
+	assert(dmp_diff_to_array_buf(buf, 2, diff) == count);
+	assert(!memcmp(buf, hunks, sizeof(buf)));
+	free(hunks);
+	dmp_diff_free(diff);
+	progress();
+
+	assert(dmp_diff_from_strs(&diff, NULL, "", "") == 0);
+	assert(dmp_diff_to_array(&hunks, &count, diff) == 0);
+	assert(hunks == NULL && count == 0);
+	dmp_diff_free(diff);
+	progress();
+}
+
+void test_diff_map_0(void)
+{
+	dmp_diff *diff;
+	uint32_t i, offsets[8], out[8];
+
+	/* upstream diff_xIndex examples */
+	assert(dmp_diff_from_strs(&diff, NULL, "axyz", "1234xyz") == 0);
+	expect_diff_stat(diff, 1, 1, 1, 0x6);
+	assert(dmp_diff_map_offset(diff, 2) == 5);
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_from_strs(&diff, NULL, "a1234xyz", "axyz") == 0);
+	expect_diff_stat(diff, 1, 2, 0, 0x2);
+	assert(dmp_diff_map_offset(diff, 3) == 1);
+	dmp_diff_free(diff);
+
+	/* "The cat sat." -> "A black cat sat here." */
+	assert(dmp_diff_from_strs(
+		&diff, NULL, "The cat sat.", "A black cat sat here.") == 0);
+	for (i = 0; i < 8; ++i)
+		offsets[i] = i * 2;
+	dmp_diff_map_offsets(diff, out, offsets, 8);
+	for (i = 0; i < 8; ++i)
+		assert(out[i] == dmp_diff_map_offset(diff, offsets[i]));
+	assert(dmp_diff_map_offset(diff, 0) == 0);
+	assert(dmp_diff_map_offset(diff, 4) == 8);   /* "cat" */
+	assert(dmp_diff_map_offset(diff, 11) == 20); /* "." */
+	assert(dmp_diff_map_offset(diff, 14) == 23); /* past the end */
+	progress();
+
+	/* unsorted offsets still map correctly */
+	offsets[0] = 11; offsets[1] = 4; offsets[2] = 0;
+	dmp_diff_map_offsets(diff, out, offsets, 3);
+	assert(out[0] == 20 && out[1] == 8 && out[2] == 0);
+	dmp_diff_free(diff);
+	progress();
+}
+
+void test_diff_binary_0(void)
+{
+	dmp_diff *diff;
+	char *delta, *text2;
+	uint32_t dlen, len2;
+	const char *t1 =
+		"The quick brown fox jumps over the lazy dog.  The quick brown fox.";
+	const char *t2 =
+		"The quick red fox jumps over the lazy dog!  The quick brown fox.";
+
+	assert(dmp_diff_from_strs(&diff, NULL, t1, t2) == 0);
+	assert(dmp_diff_to_binary(&delta, &dlen, diff) == 0);
+	assert(dlen < 20);
+	dmp_diff_free(diff);
+
+	assert(dmp_binary_apply(&text2, &len2, t1, strlen(t1), delta, dlen) == 0);
+	assert(len2 == strlen(t2) && !strcmp(text2, t2));
+	free(text2);
+	progress();
+
+	/* wrong base length, truncated or corrupt deltas are rejected */
+	assert(dmp_binary_apply(&text2, &len2, t1, 10, delta, dlen) == -1);
+	assert(text2 == NULL);
+	assert(dmp_binary_apply(&text2, &len2, t1, strlen(t1), delta, dlen - 1) == -1);
+	delta[0] = 9;
+	assert(dmp_binary_apply(&text2, &len2, t1, strlen(t1), delta, dlen) == -1);
+	free(delta);
+	progress();
+
+	assert(dmp_diff_from_strs(&diff, NULL, "", "new") == 0);
+	assert(dmp_diff_to_binary(&delta, &dlen, diff) == 0);
+	dmp_diff_free(diff);
+	assert(dmp_binary_apply(&text2, &len2, "", 0, delta, dlen) == 0);
+	assert(len2 == 3 && !strcmp(text2, "new"));
+	free(text2);
+	free(delta);
+	progress();
+}
+
+static int from_delta(dmp_diff **diff, const char *t1, const char *delta)
+{
+	return dmp_diff_from_delta(diff, t1, strlen(t1), delta, strlen(delta));
+}
+
+void test_diff_delta_0(void)
+{
+	dmp_diff *diff, *copy;
+	char *delta, *delta2;
+	uint32_t dlen, dlen2;
+	const char *t1 = "jumps over the lazy", *t2 = "jumped over a lazyold dog";
+
+	/* same text as the upstream diff_toDelta test */
+	assert(dmp_diff_from_strs(&diff, NULL, t1, t2) == 0);
+	assert(dmp_diff_to_delta(&delta, &dlen, diff) == 0);
+	assert(dlen == strlen(delta));
+	assert(!strcmp(delta, "=4\t-1\t+ed\t=6\t-3\t+a\t=5\t+old dog"));
+	dmp_diff_free(diff);
+
+	assert(from_delta(&copy, t1, delta) == 0);
+	expect_diff_texts(copy, t1, t2);
+	assert(dmp_diff_hunks(copy) == 8);
+	assert(dmp_diff_to_delta(&delta2, &dlen2, copy) == 0);
+	assert(dlen2 == dlen && !strcmp(delta, delta2));
+	free(delta2);
+	dmp_diff_free(copy);
+	free(delta);
+	progress();
+
+	/* lengths count UTF-16 code units and inserts are URI-encoded */
+	t1 = "\xda\x80 \t %\xda\x81 \n ^";
+	t2 = "\xda\x80 \t %\xda\x82 \\ |";
+	assert(from_delta(&copy, t1, "=5\t-5\t+%DA%82 %5C %7C") == 0);
+	expect_diff_texts(copy, t1, t2);
+	dmp_diff_free(copy);
+
+	assert(from_delta(&copy, "", "+%3B%2c%25 abc\t") == 0);
+	expect_diff_texts(copy, "", ";,% abc");
+	dmp_diff_free(copy);
+	progress();
+
+	/* a byte-level split of a character is widened to whole characters */
+	t1 = "\xf0\x9f\x98\x80x";
+	t2 = "\xf0\x9f\x98\x81x";
+	assert(dmp_diff_from_strs(&diff, NULL, t1, t2) == 0);
+	assert(dmp_diff_to_delta(&delta, &dlen, diff) == 0);
+	assert(!strcmp(delta, "-2\t+%F0%9F%98%81\t=1"));
+	assert(from_delta(&copy, t1, delta) == 0);
+	expect_diff_texts(copy, t1, t2);
+	dmp_diff_free(copy);
+	dmp_diff_free(diff);
+	free(delta);
+	progress();
+
+	/* bad deltas are rejected */
+	assert(from_delta(&copy, "abc", "=4") == -1 && copy == NULL);
+	assert(from_delta(&copy, "abc", "=2") == -1);
+	assert(from_delta(&copy, "abc", "=x") == -1);
+	assert(from_delta(&copy, "abc", "=-1\t=4") == -1);
+	assert(from_delta(&copy, "abc", "*3") == -1);
+	assert(from_delta(&copy, "abc", "=3\t+%4") == -1);
+	assert(from_delta(&copy, t1, "=1\t=2") == -1);
+	progress();
+}
+
+static int merge_kinds(
+	void *ref, dmp_merge_t kind, const char *base, uint32_t base_len,
+	const char *a, uint32_t a_len, const char *b, uint32_t b_len)
+{
+	uint32_t *kinds = ref;
+	(void)base; (void)base_len; (void)a; (void)a_len; (void)b; (void)b_len;
+	kinds[kind]++;
+	return 0;
+}
+
+static dmp_merge *expect_merge(
+	const char *base, const char *a, const char *b,
+	const char *expected, uint32_t conflicts)
+{
+	dmp_merge *merge;
+	char *text;
+	uint32_t len;
+
+	assert(dmp_merge3(&merge, NULL, base, strlen(base),
+		a, strlen(a), b, strlen(b)) == 0);
+	assert(dmp_merge_conflicts(merge) == conflicts);
+	assert(dmp_merge_text(&text, &len, merge) == 0);
+	assert(len == strlen(expected) && !strcmp(text, expected));
+	free(text);
+
+	progress();
+	return merge;
+}
+
+void test_merge3_0(void)
+{
+	dmp_merge *merge;
+	uint32_t kinds[5];
+	const char *base = "The quick brown fox jumps over the lazy dog.";
+
+	/* edits to different parts of the base are combined */
+	merge = expect_merge(base,
+		"The quick red fox jumps over the lazy dog.",
+		"The quick brown fox jumps over the lazy cat.",
+		"The quick red fox jumps over the lazy cat.", 0);
+	memset(kinds, 0, sizeof(kinds));
+	assert(dmp_merge_foreach(merge, merge_kinds, kinds) == 0);
+	assert(kinds[DMP_MERGE_A] > 0 && kinds[DMP_MERGE_B] > 0);
+	assert(kinds[DMP_MERGE_BOTH] == 0 && kinds[DMP_MERGE_CONFLICT] == 0);
+	dmp_merge_free(merge);
+
+	/* the same edit on both sides is not a conflict */
+	merge = expect_merge(base,
+		"The quick brown fox leaps over the lazy dog.",
+		"The quick brown fox leaps over the lazy dog!",
+		"The quick brown fox leaps over the lazy dog!", 0);
+	memset(kinds, 0, sizeof(kinds));
+	assert(dmp_merge_foreach(merge, merge_kinds, kinds) == 0);
+	assert(kinds[DMP_MERGE_BOTH] > 0 && kinds[DMP_MERGE_B] == 1);
+	dmp_merge_free(merge);
+
+	/* different edits of the same text conflict and keep `a` */
+	merge = expect_merge(base,
+		"The slow brown fox jumps over the lazy dog.",
+		"The fast brown fox jumps over the lazy dog?",
+		"The slow brown fox jumps over the lazy dog?", 1);
+	dmp_merge_free(merge);
+
+	/* insertions at the same spot conflict */
+	dmp_merge_free(expect_merge("ab", "aXb", "aYb", "aXb", 1));
+	dmp_merge_free(expect_merge("", "", "new", "new", 0));
+}
+
+static void edit_text(
+	char *text, uint32_t *len, uint32_t offset, uint32_t removed,
+	const char *inserted)
+{
+	uint32_t inslen = strlen(inserted);
+
+	memmove(text + offset + inslen, text + offset + removed,
+		*len - offset - removed + 1);
+	memcpy(text + offset, inserted, inslen);
+	*len = *len - removed + inslen;
+}
+
+void test_diff_update_0(void)
+{
+	dmp_diff *diff;
+	dmp_cache *cache;
+	dmp_stats st;
+	struct diff_text_data d;
+	char t2[128], *b1, *b2;
+	uint32_t l2, i, n, offsets[4], mapped[4];
+	const char *t1 = "The quick brown fox jumps over the lazy dog.";
+
+	strcpy(t2, t1);
+	l2 = strlen(t2);
+	assert(dmp_diff_new(&diff, NULL, t1, strlen(t1), t2, l2) == 0);
+
+	/* type into the middle of unchanged text */
+	edit_text(t2, &l2, 35, 0, "very ");
+	assert(dmp_diff_update(diff, NULL, t2, 35, 0, 5) == 0);
+	expect_diff_texts(diff, t1, "The quick brown fox jumps over the very lazy dog.");
+	expect_diff_stat(diff, 0, 2, 1, 0x2);
+
+	/* an edit next to an existing change is merged with it */
+	edit_text(t2, &l2, 40, 0, "very ");
+	assert(dmp_diff_update(diff, NULL, t2, 40, 0, 5) == 0);
+	expect_diff_texts(diff, t1, "The quick brown fox jumps over the very very lazy dog.");
+	expect_diff_stat(diff, 0, 2, 1, 0x2);
+
+	/* delete and replace */
+	edit_text(t2, &l2, 4, 6, "");
+	assert(dmp_diff_update(diff, NULL, t2, 4, 6, 0) == 0);
+	edit_text(t2, &l2, 44, 3, "cat");
+	assert(dmp_diff_update(diff, NULL, t2, 44, 3, 3) == 0);
+	expect_diff_texts(diff, t1, "The brown fox jumps over the very very lazy cat.");
+	dmp_diff_stats(diff, &st);
+	assert(st.equal_bytes + st.delete_bytes == strlen(t1));
+	assert(st.equal_bytes + st.insert_bytes == l2);
+	progress();
+
+	/* undo everything */
+	strcpy(t2, t1);
+	assert(dmp_diff_update(diff, NULL, t2, 0, l2, strlen(t1)) == 0);
+	expect_diff_stat(diff, 0, 1, 0, 0x0);
+
+	/* out of range edits are refused */
+	assert(dmp_diff_update(diff, NULL, t2, 50, 0, 1) == -1);
+	assert(dmp_diff_update(diff, NULL, t2, 40, 5, 0) == -1);
+	dmp_diff_free(diff);
+
+	/* a diff emptied by an edit drops its hunk index before growing
+	 * hunks again
+	 */
+	strcpy(t2, "x");
+	l2 = 1;
+	assert(dmp_diff_new(&diff, NULL, "", 0, t2, l2) == 0);
+	(void)dmp_diff_map_offset(diff, 0);
+	edit_text(t2, &l2, 0, 1, "");
+	assert(dmp_diff_update(diff, NULL, t2, 0, 1, 0) == 0);
+	expect_diff_stat(diff, 0, 0, 0, 0x0);
+	edit_text(t2, &l2, 0, 0, "y");
+	assert(dmp_diff_update(diff, NULL, t2, 0, 0, 1) == 0);
+	expect_diff_texts(diff, "", "y");
+	expect_diff_stat(diff, 0, 0, 1, 0x1);
+	offsets[0] = 0;
+	dmp_diff_map_offsets(diff, mapped, offsets, 1);
+	assert(dmp_diff_map_offset(diff, 0) == mapped[0]);
+	dmp_diff_free(diff);
+
+	/* a long diff keeps its hunk index and totals up to date, including
+	 * through edits that reach its last hunk
+	 */
+	b1 = malloc(20001);
+	b2 = malloc(20101);
+	for (i = 0; i < 20000; ++i)
+		b1[i] = b2[i] = (char)('a' + (i * 7) % 26);
+	for (i = 50; i < 20000; i += 100)
+		b2[i] = '#';
+	b1[20000] = b2[20000] = '\0';
+	l2 = 20000;
+
+	assert(dmp_diff_new(&diff, NULL, b1, 20000, b2, l2) == 0);
+	n = dmp_diff_hunks(diff);
+	assert(dmp_diff_map_offset(diff, 10000) == 10000);
+
+	edit_text(b2, &l2, 10010, 0, "xyz");
+	assert(dmp_diff_update(diff, NULL, b2, 10010, 0, 3) == 0);
+	assert(dmp_diff_hunks(diff) == n + 2);
+	edit_text(b2, &l2, 19990, 10, "END");
+	assert(dmp_diff_update(diff, NULL, b2, 19990, 10, 3) == 0);
+	edit_text(b2, &l2, l2, 0, "!");
+	assert(dmp_diff_update(diff, NULL, b2, l2 - 1, 0, 1) == 0);
+
+	d.t1 = malloc(20000);
+	d.t2 = malloc(l2);
+	d.l1 = d.l2 = 0;
+	assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+	assert(d.l1 == 20000 && !memcmp(d.t1, b1, 20000));
+	assert(d.l2 == l2 && !memcmp(d.t2, b2, l2));
+	free(d.t1);
+	free(d.t2);
+
+	dmp_diff_stats(diff, &st);
+	assert(st.equal_bytes + st.delete_bytes == 20000);
+	assert(st.equal_bytes + st.insert_bytes == l2);
+	assert(st.equals + st.inserts + st.deletes == dmp_diff_hunks(diff));
+
+	offsets[0] = 5000;
+	offsets[1] = 10012;
+	offsets[2] = 15000;
+	offsets[3] = 19995;
+	dmp_diff_map_offsets(diff, mapped, offsets, 4);
+	for (i = 0; i < 4; ++i)
+		assert(dmp_diff_map_offset(diff, offsets[i]) == mapped[i]);
+	assert(mapped[2] == 15003);
+	dmp_diff_free(diff);
+	free(b1);
+	free(b2);
+	progress();
+
+	/* shared diffs cannot be updated */
+	assert(dmp_cache_new(&cache, 4096) == 0);
+	assert(dmp_cache_diff(&diff, cache, NULL, "abc", 3, "abd", 3) == 0);
+	assert(dmp_diff_update(diff, NULL, "abde", 3, 0, 1) == -1);
+	dmp_diff_free(diff);
+	dmp_cache_free(cache);
+	progress();
+}
+
+
+void test_diff_presize_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_cache *cache;
+	dmp_stats st;
+	char *t1 = malloc(20000), *t2 = malloc(20000);
+	uint32_t i, hunks, grows;
+
+	for (i = 0; i < 20000; ++i)
+		t1[i] = t2[i] = (char)('a' + (i * 7) % 26);
+	for (i = 100; i < 20000; i += 50)
+		t2[i] = '#';
+
+	dmp_options_init(&opts);
+	opts.timeout = 0;
+
+	/* a pool sized from the texts grows less than one started small */
+	assert(dmp_diff_new(&diff, &opts, t1, 20000, t2, 20000) == 0);
+	dmp_diff_stats(diff, &st);
+	hunks = dmp_diff_hunks(diff);
+	grows = st.pool_grows;
+	assert(hunks > 700);
+	dmp_diff_free(diff);
+
+	opts.expected_hunks = 1;
+	assert(dmp_diff_new(&diff, &opts, t1, 20000, t2, 20000) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.pool_grows > grows);
+	assert(dmp_diff_hunks(diff) == hunks);
+	dmp_diff_free(diff);
+
+	/* and with the number of hunks known up front it never does */
+	opts.expected_hunks = hunks;
+	assert(dmp_diff_new(&diff, &opts, t1, 20000, t2, 20000) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.pool_grows == 0);
+	assert(dmp_diff_hunks(diff) == hunks);
+	dmp_diff_free(diff);
+
+	/* a silly hint is limited by the size of the texts */
+	opts.expected_hunks = UINT32_MAX;
+	assert(dmp_diff_new(&diff, &opts, "abc", 3, "abd", 3) == 0);
+	expect_diff_texts(diff, "abc", "abd");
+	dmp_diff_free(diff);
+	progress();
+
+	/* a cache sizes new diffs for the biggest one it has made */
+	opts.expected_hunks = 0;
+	assert(dmp_cache_new(&cache, 1 << 20) == 0);
+	assert(dmp_cache_diff(&diff, cache, &opts, t1, 20000, t2, 20000) == 0);
+	dmp_diff_free(diff);
+	t2[0] = '#';
+	assert(dmp_cache_diff(&diff, cache, &opts, t1, 20000, t2, 20000) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.pool_grows == 0);
+	assert(dmp_diff_hunks(diff) >= hunks);
+	dmp_diff_free(diff);
+	dmp_cache_free(cache);
+
+	free(t1);
+	free(t2);
+	progress();
+}
+
+struct phase_log {
+	uint32_t begun[DMP_PHASE_COUNT], ended[DMP_PHASE_COUNT];
+	int open[DMP_PHASE_COUNT], bad;
+};
+
+static void log_phase(
+	void *ref, dmp_phase_t phase, int done, uint32_t len1, uint32_t len2)
+{
+	struct phase_log *log = ref;
+
+	(void)len1;
+	(void)len2;
+
+	/* no phase is ever nested inside itself */
+	if (done != log->open[phase])
+		log->bad = 1;
+	log->open[phase] = !done;
+
+	if (done)
+		log->ended[phase]++;
+	else
+		log->begun[phase]++;
+}
+
+void test_diff_profile_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_profile prof;
+	struct phase_log log;
+	int i;
+
+	memset(&log, 0, sizeof(log));
+	dmp_options_init(&opts);
+	opts.phase_cb = log_phase;
+	opts.phase_cb_ref = &log;
+
+	/* long enough to bisect rather than use the bit-parallel diff */
+	assert(dmp_diff_from_strs(&diff, &opts,
+		"The quick brown fox jumps over the lazy dog. "
+		"The quick brown fox jumps over the lazy dog.",
+		"That quick brown fox jumped over a lazy dog. "
+		"That quick brown fox jumped over a lazy cat.") == 0);
+
+	if (dmp_diff_profile(diff, &prof) < 0) {
+		/* built without DMP_PROFILE: nothing is gathered or called */
+		for (i = 0; i < DMP_PHASE_COUNT; ++i)
+			assert(prof.calls[i] == 0 && log.begun[i] == 0);
+		dmp_diff_free(diff);
+		progress();
+		return;
+	}
+
+	assert(!log.bad);
+	for (i = 0; i < DMP_PHASE_COUNT; ++i) {
+		assert(prof.calls[i] > 0);
+		assert(log.begun[i] == prof.calls[i]);
+		assert(log.ended[i] == prof.calls[i]);
+		assert(!log.open[i]);
+	}
+	assert(prof.calls[DMP_PHASE_BISECT] >= 1);
+	assert(prof.bisect_steps >= prof.bisect_max_d && prof.bisect_max_d > 0);
+	assert(prof.bytes[DMP_PHASE_TRIM] >= 88);
+	dmp_diff_free(diff);
+	progress();
+}
+
+#define N_THREADS	4
+#define THREAD_ROUNDS	20
+
+static int stop_at_second(
+	void *ref, dmp_operation_t op, const void *data, uint32_t len)
+{
+	(void)op; (void)data; (void)len;
+	return ++*(int *)ref == 2 ? 42 : 0;
+}
+
+struct reader {
+	dmp_diff *diff;
+	const dmp_hunk *hunks;
+	const char *t1, *t2;
+	const uint32_t *offsets, *mapped;
+	uint32_t n_offsets, n_hunks, slice, bad;
+};
+
+static void *read_diff(void *ref)
+{
+	struct reader *r = ref;
+	uint32_t round, i, per = r->n_hunks / N_THREADS;
+
+	for (round = 0; round < THREAD_ROUNDS; ++round) {
+		/* this thread's share, and then somebody else's */
+		uint32_t part = (r->slice + round) % N_THREADS;
+		uint32_t from = part * per;
+		uint32_t to = (part == N_THREADS - 1) ? r->n_hunks : from + per;
+		struct array_check ac = { r->hunks, r->t1, r->t2, from };
+		dmp_stats st;
+
+		if (dmp_diff_foreach_range(r->diff, from, to, check_hunk, &ac) != 0 ||
+			ac.at != to)
+			r->bad++;
+
+		for (i = 0; i < r->n_offsets; ++i)
+			if (dmp_diff_map_offset(r->diff, r->offsets[i]) != r->mapped[i])
+				r->bad++;
+
+		dmp_diff_stats(r->diff, &st);
+		if (dmp_diff_hunks(r->diff) != r->n_hunks ||
+			st.equals + st.inserts + st.deletes != r->n_hunks)
+			r->bad++;
+	}
+
+	/* the last thread out frees the shared diff */
+	dmp_diff_free(r->diff);
+	return NULL;
+}
+
+void test_diff_threads_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_cache *cache;
+	dmp_hunk *hunks;
+	pthread_t threads[N_THREADS];
+	struct reader readers[N_THREADS];
+	struct array_check ac;
+	char *t1 = malloc(20000), *t2 = malloc(20000);
+	uint32_t i, n, offsets[64], mapped[64];
+	int calls = 0;
+
+	for (i = 0; i < 20000; ++i)
+		t1[i] = t2[i] = (char)('a' + (i * 7) % 26);
+	for (i = 100; i < 20000; i += 50)
+		t2[i] = '#';
+
+	dmp_options_init(&opts);
+	opts.timeout = 0;
+
+	/* slices of the diff cover it exactly once, in order */
+	assert(dmp_diff_new(&diff, &opts, t1, 20000, t2, 20000) == 0);
+	assert(dmp_diff_to_array(&hunks, &n, diff) == 0);
+	assert(n == dmp_diff_hunks(diff) && n > 700);
+
+	ac.hunks = hunks; ac.t1 = t1; ac.t2 = t2; ac.at = 0;
+	for (i = 0; i < n; i += 97)
+		assert(dmp_diff_foreach_range(diff, i, i + 97, check_hunk, &ac) == 0);
+	assert(ac.at == n);
+
+	ac.at = 5;
+	assert(dmp_diff_foreach_range(diff, 5, 5, check_hunk, &ac) == 0);
+	assert(dmp_diff_foreach_range(diff, 9, 3, check_hunk, &ac) == 0);
+	assert(dmp_diff_foreach_range(diff, n, n + 10, check_hunk, &ac) == 0);
+	assert(ac.at == 5);
+	assert(dmp_diff_foreach_range(diff, 10, 20, stop_at_second, &calls) == 42);
+	assert(calls == 2);
+	progress();
+
+	for (i = 0; i < 64; ++i)
+		offsets[i] = i * 313;
+	dmp_diff_map_offsets(diff, mapped, offsets, 64);
+	dmp_diff_free(diff);
+
+	/* many readers of one shared diff, racing to build its hunk index and
+	 * to drop their references (run `make tsan` to check for data races)
+	 */
+	assert(dmp_cache_new(&cache, 1 << 20) == 0);
+	for (i = 0; i < N_THREADS; ++i) {
+		assert(dmp_cache_diff(&readers[i].diff, cache, &opts,
+			t1, 20000, t2, 20000) == 0);
+		readers[i].hunks = hunks;
+		readers[i].t1 = t1;
+		readers[i].t2 = t2;
+		readers[i].offsets = offsets;
+		readers[i].mapped = mapped;
+		readers[i].n_offsets = 64;
+		readers[i].n_hunks = n;
+		readers[i].slice = i;
+		readers[i].bad = 0;
+	}
+	assert(readers[0].diff == readers[N_THREADS - 1].diff);
+
+	/* the cache lets go of its reference first */
+	dmp_cache_free(cache);
+
+	for (i = 0; i < N_THREADS; ++i)
+		assert(pthread_create(
+			&threads[i], NULL, read_diff, &readers[i]) == 0);
+	for (i = 0; i < N_THREADS; ++i) {
+		assert(pthread_join(threads[i], NULL) == 0);
+		assert(readers[i].bad == 0);
+	}
+
+	free(hunks);
+	free(t1);
+	free(t2);
+	progress();
+}
+
+/* check that the hunks of a sequence diff turn `a` into `b` */
+static void expect_diff_seq(
+	const dmp_diff *diff, size_t size,
+	const void *a, uint32_t na, const void *b, uint32_t nb)
+{
+	dmp_hunk *hunks;
+	uint32_t i, count, at1 = 0, at2 = 0;
+	const char *t1 = a, *t2 = b;
+
+	assert(dmp_diff_to_array(&hunks, &count, diff) == 0);
+	for (i = 0; i < count; ++i) {
+		const dmp_hunk *h = &hunks[i];
+
+		if (h->op == DMP_DIFF_INSERT)
+			assert(h->side == 1 && h->offset == at2);
+		else
+			assert(h->side == 0 && h->offset == at1);
+
+		if (h->op == DMP_DIFF_EQUAL)
+			assert(!memcmp(t1 + at1 * size, t2 + at2 * size, h->len * size));
+
+		if (h->op != DMP_DIFF_INSERT)
+			at1 += h->len;
+		if (h->op != DMP_DIFF_DELETE)
+			at2 += h->len;
+	}
+	assert(at1 == na && at2 == nb);
+	free(hunks);
+}
+
+static int seq_same_mod(void *ref, const void *a, const void *b)
+{
+	int mod = *(int *)ref;
+	return *(const int *)a % mod == *(const int *)b % mod;
+}
+
+void test_diff_seq_0(void)
+{
+	static const uint32_t a32[] = { 1, 2, 3, 4, 5 };
+	static const uint32_t b32[] = { 1, 2, 9, 4, 5, 6 };
+	static const int ai[] = { 10, 21, 32, 43 };
+	static const int bi[] = { 20, 31, 42, 14 };
+	char a3[3 * 300], b3[3 * 300];
+	uint64_t *a64, *b64;
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_stats st;
+	char *delta;
+	uint32_t i, dlen;
+	int mod = 10;
+
+	assert(dmp_diff_seq(&diff, NULL, 4, a32, 5, b32, 6, NULL, NULL) == 0);
+	expect_diff_stat(diff, 1, 2, 2, 0x0d);
+	expect_diff_seq(diff, 4, a32, 5, b32, 6);
+	dmp_diff_stats(diff, &st);
+	assert(st.equal_bytes == 4 && st.delete_bytes == 1 && st.insert_bytes == 2);
+	assert(dmp_diff_map_offset(diff, 3) == 3);
+	assert(dmp_diff_map_offset(diff, 5) == 6);
+
+	/* there is no text to encode */
+	assert(dmp_diff_to_binary(&delta, &dlen, diff) == -1);
+	assert(dmp_diff_to_delta(&delta, &dlen, diff) == -1);
+	dmp_diff_free(diff);
+	progress();
+
+	/* words that differ only in their high bytes are different */
+	a64 = calloc(2000, sizeof(uint64_t));
+	b64 = calloc(2000, sizeof(uint64_t));
+	for (i = 0; i < 2000; ++i)
+		a64[i] = b64[i] = (uint64_t)(i * 7919 % 613) << 40 | i % 3;
+	for (i = 0; i < 2000; i += 97)
+		b64[i] ^= (uint64_t)1 << 63;
+	memmove(b64 + 500, b64 + 510, 1490 * sizeof(uint64_t));
+
+	assert(dmp_diff_seq(&diff, NULL, 8, a64, 2000, b64, 1990, NULL, NULL) == 0);
+	expect_diff_seq(diff, 8, a64, 2000, b64, 1990);
+	dmp_diff_stats(diff, &st);
+	assert(st.equal_bytes == 2000 - 10 - 21);
+	dmp_diff_free(diff);
+	progress();
+
+	/* elements of any size, here 3 bytes */
+	for (i = 0; i < sizeof(a3); ++i)
+		a3[i] = b3[i] = (char)(i % 3 ? i / 3 % 5 : 'a' + i / 3 % 7);
+	b3[3 * 100 + 2] = 'x';
+	b3[3 * 200] = 'y';
+
+	assert(dmp_diff_seq(&diff, NULL, 3, a3, 300, b3, 300, NULL, NULL) == 0);
+	expect_diff_seq(diff, 3, a3, 300, b3, 300);
+	expect_diff_stat(diff, 2, 3, 2, 0x36);
+	dmp_diff_free(diff);
+
+	dmp_options_init(&opts);
+	opts.max_edits = 3;
+	assert(dmp_diff_seq(&diff, &opts, 3, a3, 300, b3, 300, NULL, NULL) ==
+		DMP_TOO_DIFFERENT);
+	expect_diff_seq(diff, 3, a3, 300, b3, 300);
+	dmp_diff_free(diff);
+	progress();
+
+	/* a callback decides what is equal */
+	assert(dmp_diff_seq(&diff, NULL, sizeof(int), ai, 4, bi, 4,
+		seq_same_mod, &mod) == 0);
+	expect_diff_stat(diff, 1, 1, 1, 0x03);
+	dmp_diff_stats(diff, &st);
+	assert(st.equal_bytes == 3);
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_seq(&diff, NULL, 0, a32, 5, b32, 6, NULL, NULL) == -1);
+	assert(diff == NULL);
+	assert(dmp_diff_seq(&diff, NULL, 4, a32, 0, b32, 0, NULL, NULL) == 0);
+	assert(dmp_diff_hunks(diff) == 0);
+	dmp_diff_free(diff);
+
+	free(a64);
+	free(b64);
+	progress();
+}
+
+void test_diff_records_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_hunk *serial, *threaded;
+	uint32_t n1, n2, i, l1 = 0, l2 = 0, size = 2 << 20;
+	struct diff_text_data d;
+	dmp_stats st;
+	char *t1, *t2;
+	const char *csv1 = "id,name\n1,apple\n2,banana\n3,cherry\n";
+	const char *csv2 = "id,name\n1,apple\n2,blueberry\n3,cherry\n4,date";
+
+	dmp_options_init(&opts);
+	opts.algorithm = DMP_ALGORITHM_RECORDS;
+
+	assert(dmp_diff_from_strs(&diff, &opts, csv1, csv2) == 0);
+	expect_diff_texts(diff, csv1, csv2);
+	expect_diff_stat(diff, 1, 2, 2, 0x0d);
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_from_strs(&diff, &opts, "", csv2) == 0);
+	expect_diff_stat(diff, 0, 0, 1, 0x01);
+	dmp_diff_free(diff);
+	progress();
+
+	/* a log big enough to be scanned and hashed in parts, with records
+	 * changed, dropped and added along the way
+	 */
+	t1 = malloc(size);
+	t2 = malloc(size);
+	for (i = 0; l1 + 64 < size; ++i) {
+		int n = sprintf(t1 + l1, "%u,event-%u,%u\n", i, i % 13, i * 7919);
+		l1 += n;
+		if (i % 1000 == 10)
+			l2 += sprintf(t2 + l2, "%u,changed-%u,%u\n", i, i % 13, i);
+		else if (i % 1000 != 500)
+			memcpy(t2 + l2, t1 + l1 - n, n), l2 += n;
+		if (i % 5000 == 7)
+			l2 += sprintf(t2 + l2, "added record %u\n", i);
+	}
+
+	assert(dmp_diff_new(&diff, &opts, t1, l1, t2, l2) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.equal_bytes > l1 - l1 / 100);
+	assert(dmp_diff_to_array(&serial, &n1, diff) == 0);
+	dmp_diff_free(diff);
+
+	opts.threads = 4;
+	assert(dmp_diff_new(&diff, &opts, t1, l1, t2, l2) == 0);
+	assert(dmp_diff_to_array(&threaded, &n2, diff) == 0);
+	assert(n1 == n2 && !memcmp(serial, threaded, n1 * sizeof(dmp_hunk)));
+
+	memset(&d, 0, sizeof(d));
+	d.t1 = malloc(size);
+	d.t2 = malloc(size);
+	assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+	assert(d.l1 == l1 && !memcmp(d.t1, t1, l1));
+	assert(d.l2 == l2 && !memcmp(d.t2, t2, l2));
+	dmp_diff_free(diff);
+
+	free(serial);
+	free(threaded);
+	free(d.t1);
+	free(d.t2);
+	free(t1);
+	free(t2);
+	progress();
+}
+
+struct move_data {
+	uint32_t deletes, inserts, last;
+	const char *moved;
+	uint32_t moved_len;
+};
+
+/* checks that each move is one DELETE and then one INSERT of the same text */
+static int collect_moves(
+	void *ref, dmp_operation_t op, const void *data, uint32_t len,
+	uint32_t move)
+{
+	struct move_data *d = ref;
+
+	if (!move)
+		return 0;
+
+	if (op == DMP_DIFF_DELETE) {
+		assert(move == d->last + 1);
+		d->deletes++;
+		d->moved = data;
+		d->moved_len = len;
+	} else {
+		assert(op == DMP_DIFF_INSERT && move == d->last);
+		assert(len == d->moved_len && !memcmp(data, d->moved, len));
+		d->inserts++;
+	}
+	d->last = move;
+	return 0;
+}
+
+void test_diff_moves_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_stats st;
+	struct move_data d;
+	const char *t1 =
+		"The first paragraph stays right where it was.\n"
+		"This second paragraph is going to move to the end.\n"
+		"The third paragraph stays too, and so does the last.\n";
+	const char *t2 =
+		"The first paragraph stays right where it was.\n"
+		"The third paragraph stays too, and so does the last.\n"
+		"This second paragraph is going to move to the end.\n";
+
+	dmp_options_init(&opts);
+	opts.move_min_len = 32;
+
+	/* the second paragraph is moved, the others are left in place */
+	assert(dmp_diff_from_strs(&diff, &opts, t1, t2) == 0);
+	expect_diff_texts(diff, t1, t2);
+	memset(&d, 0, sizeof(d));
+	assert(dmp_diff_foreach_moves(diff, collect_moves, &d) == 0);
+	assert(d.deletes == 1 && d.inserts == 1);
+	assert(d.moved_len >= 32);
+	dmp_diff_stats(diff, &st);
+	assert(st.moves == 1);
+
+	/* an edit forgets the moves */
+	assert(dmp_diff_update(diff, NULL, t2, 0, 0, 0) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.moves == 0);
+	dmp_diff_free(diff);
+	progress();
+
+	/* without the option there is nothing to find */
+	opts.move_min_len = 0;
+	assert(dmp_diff_from_strs(&diff, &opts, t1, t2) == 0);
+	expect_diff_texts(diff, t1, t2);
+	memset(&d, 0, sizeof(d));
+	assert(dmp_diff_foreach_moves(diff, collect_moves, &d) == 0);
+	assert(d.deletes == 0 && d.inserts == 0);
+	dmp_diff_free(diff);
+
+	/* blocks shorter than the minimum do not count */
+	opts.move_min_len = 60;
+	assert(dmp_diff_from_strs(&diff, &opts, t1, t2) == 0);
+	expect_diff_texts(diff, t1, t2);
+	dmp_diff_stats(diff, &st);
+	assert(st.moves == 0);
+	dmp_diff_free(diff);
+	progress();
+}
+
+void test_edit_distance_0(void)
+{
+	dmp_diff *diff;
+	dmp_stats st;
+	struct diff_text_data d;
+	char t1[300], t2[300], b1[300], b2[300];
+	uint32_t dist, bounded, i, round, l1, l2, seed = 7;
+
+	assert(dmp_edit_distance(&dist, NULL, "abc", 3, "abc", 3) == 0);
+	assert(dist == 0);
+	assert(dmp_edit_distance(&dist, NULL, "", 0, "abc", 3) == 0);
+	assert(dist == 3);
+	assert(dmp_edit_distance(&dist, NULL, "kitten", 6, "sitting", 7) == 0);
+	assert(dist == 5);
+
+	assert(dmp_edit_distance(&dist, &diff, "kitten", 6, "sitting", 7) == 0);
+	assert(dist == 5);
+	expect_diff_texts(diff, "kitten", "sitting");
+	dmp_diff_free(diff);
+
+	assert(dmp_edit_distance(&dist, &diff, "same", 4, "same", 4) == 0);
+	assert(dist == 0);
+	expect_diff_stat(diff, 0, 1, 0, 0x00);
+	dmp_diff_free(diff);
+	progress();
+
+	/* one word, two words and more, against the Myers distance */
+	d.t1 = b1;
+	d.t2 = b2;
+	for (round = 0; round < 300; ++round) {
+		l1 = round % 150 + round / 150 * 100;
+		l2 = l1 + round % 7;
+		for (i = 0; i < l2; ++i) {
+			seed = seed * 1103515245 + 12345;
+			t2[i] = (char)('a' + (seed >> 16) % 4);
+			/* a third of the bytes of text1 are changed */
+			if (i < l1 && (seed >> 24) % 3)
+				t1[i] = t2[i];
+			else if (i < l1)
+				t1[i] = (char)('a' + (seed >> 8) % 4);
+		}
+
+		assert(dmp_diff_distance_bounded(
+			&bounded, t1, l1, t2, l2, l1 + l2) == 0);
+		assert(dmp_edit_distance(&dist, NULL, t1, l1, t2, l2) == 0);
+		assert(dist == bounded);
+		assert(dmp_edit_distance(&dist, NULL, t2, l2, t1, l1) == 0);
+		assert(dist == bounded);
+
+		assert(dmp_edit_distance(&dist, &diff, t1, l1, t2, l2) == 0);
+		assert(dist == bounded);
+		dmp_diff_stats(diff, &st);
+		assert(st.insert_bytes + st.delete_bytes == dist);
+		d.l1 = d.l2 = 0;
+		assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+		assert(d.l1 == l1 && !memcmp(d.t1, t1, l1));
+		assert(d.l2 == l2 && !memcmp(d.t2, t2, l2));
+		dmp_diff_free(diff);
+	}
+	progress();
+
+	/* dmp_diff_main takes the same path for texts that fit in a word */
+	assert(dmp_diff_new(&diff, NULL, t1, 60, t2, 63) == 0);
+	assert(dmp_edit_distance(&dist, NULL, t1, 60, t2, 63) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.bitpar_calls == 1 && st.bisect_calls == 0);
+	assert(st.insert_bytes + st.delete_bytes == dist);
+	dmp_diff_free(diff);
+	progress();
+}
+
+void test_diff_job_0(void)
+{
+	dmp_options opts;
+	dmp_diff_job *job;
+	dmp_diff *diff, *whole;
+	dmp_stats st, whole_st;
+	struct diff_text_data d;
+	char *t1, *t2;
+	uint32_t i, l1 = 0, l2 = 0, seed = 11, steps = 0;
+	int error;
+
+	/* finishing right away does all the work */
+	assert(dmp_diff_job_start(&job, NULL,
+		"Apples are a fruit.", 19, "Bananas are also fruit.", 23) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+	expect_diff_stat(diff, 1, 2, 2, 0x1a);
+	dmp_diff_free(diff);
+
+	dmp_options_init(&opts);
+	opts.max_edits = 4;
+	assert(dmp_diff_job_start(&job, &opts, "kitten", 6, "sitting", 7) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == DMP_TOO_DIFFERENT);
+	expect_diff_texts(diff, "kitten", "sitting");
+	dmp_diff_free(diff);
+	progress();
+
+	/* empty and identical texts, with little or nothing to step through */
+	assert(dmp_diff_job_start(&job, NULL, "", 0, "", 0) == 0);
+	assert(dmp_diff_job_step(job, 1) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+	assert(dmp_diff_hunks(diff) == 0);
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_job_start(&job, NULL, "", 0, "kitten", 6) == 0);
+	assert(dmp_diff_job_step(job, 1) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+	assert(dmp_diff_hunks(diff) == 1);
+	expect_diff_texts(diff, "", "kitten");
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_job_start(&job, NULL, "kitten", 6, "", 0) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+	assert(dmp_diff_hunks(diff) == 1);
+	expect_diff_texts(diff, "kitten", "");
+	dmp_diff_free(diff);
+
+	assert(dmp_diff_job_start(&job, NULL, "kitten", 6, "kitten", 6) == 0);
+	assert(dmp_diff_job_step(job, 1) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+	assert(dmp_diff_hunks(diff) == 1);
+	expect_diff_texts(diff, "kitten", "kitten");
+	dmp_diff_free(diff);
+	progress();
+
+	/* texts that need bisects, diffed a small budget at a time */
+	t1 = malloc(8000);
+	t2 = malloc(8000);
+	for (i = 0; i < 8000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) % 10 != 0)
+			t1[l1++] = (char)('a' + (seed >> 8) % 4);
+		if ((seed >> 16) % 10 != 1)
+			t2[l2++] = (char)('a' + (seed >> 8) % 4);
+	}
+
+	dmp_options_init(&opts);
+	opts.timeout = 0;
+	assert(dmp_diff_new(&whole, &opts, t1, l1, t2, l2) == 0);
+	dmp_diff_stats(whole, &whole_st);
+
+	assert(dmp_diff_job_start(&job, &opts, t1, l1, t2, l2) == 0);
+	while ((error = dmp_diff_job_step(job, 100)) == DMP_JOB_MORE)
+		steps++;
+	assert(error == 0 && steps > 10);
+	assert(dmp_diff_job_step(job, 100) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+
+	/* both are minimal, if not always split into the same hunks */
+	dmp_diff_stats(diff, &st);
+	assert(st.insert_bytes + st.delete_bytes ==
+		whole_st.insert_bytes + whole_st.delete_bytes);
+	assert(st.bisect_calls > 0);
+	d.t1 = malloc(l1);
+	d.t2 = malloc(l2);
+	d.l1 = d.l2 = 0;
+	assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+	assert(d.l1 == l1 && !memcmp(d.t1, t1, l1));
+	assert(d.l2 == l2 && !memcmp(d.t2, t2, l2));
+	dmp_diff_free(diff);
+	dmp_diff_free(whole);
+	progress();
+
+	/* cancel part way through */
+	assert(dmp_diff_job_start(&job, &opts, t1, l1, t2, l2) == 0);
+	assert(dmp_diff_job_step(job, 100) == DMP_JOB_MORE);
+	dmp_diff_job_cancel(job);
+	dmp_diff_job_cancel(NULL);
+
+	/* other algorithms run in one go */
+	opts.algorithm = DMP_ALGORITHM_HISTOGRAM;
+	assert(dmp_diff_job_start(&job, &opts, t1, l1, t2, l2) == 0);
+	assert(dmp_diff_job_step(job, 1) == 0);
+	assert(dmp_diff_job_finish(job, &diff) == 0);
+	d.l1 = d.l2 = 0;
+	assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+	assert(d.l1 == l1 && !memcmp(d.t1, t1, l1));
+	assert(d.l2 == l2 && !memcmp(d.t2, t2, l2));
+	dmp_diff_free(diff);
+
+	free(d.t1);
+	free(d.t2);
+	free(t1);
+	free(t2);
+	progress();
+}
+
+void test_diff_stack_0(void)
+{
+	dmp_options opts;
+	dmp_diff *diff;
+	dmp_stats st;
+	struct diff_text_data d;
+	uint32_t i, n = 200000, *a, *b;
+	char *t1 = malloc(n), *t2 = malloc(n);
+
+	/* an edit every few dozen bytes splits the texts thousands of times,
+	 * but the parts waiting on the stack only grow with the log of that
+	 */
+	for (i = 0; i < n; ++i)
+		t1[i] = t2[i] = (char)('a' + (i * 7) % 26);
+	for (i = 16; i < n; i += 32)
+		t2[i] = '#';
+
+	dmp_options_init(&opts);
+	opts.timeout = 0;
+	assert(dmp_diff_new(&diff, &opts, t1, n, t2, n) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.insert_bytes == n / 32 && st.delete_bytes == n / 32);
+	assert(st.bisect_calls > 1000);
+	assert(st.max_depth > 1 && st.max_depth < 64);
+
+	d.t1 = malloc(n);
+	d.t2 = malloc(n);
+	d.l1 = d.l2 = 0;
+	assert(dmp_diff_foreach(diff, diff_texts, &d) == 0);
+	assert(d.l1 == n && !memcmp(d.t1, t1, n));
+	assert(d.l2 == n && !memcmp(d.t2, t2, n));
+	dmp_diff_free(diff);
+	progress();
+
+	/* the same goes for arrays */
+	a = malloc(n / 4 * sizeof(uint32_t));
+	b = malloc(n / 4 * sizeof(uint32_t));
+	for (i = 0; i < n / 4; ++i)
+		a[i] = b[i] = i % 26;
+	for (i = 8; i < n / 4; i += 16)
+		b[i] = 100;
+
+	assert(dmp_diff_seq(&diff, &opts, sizeof(uint32_t),
+		a, n / 4, b, n / 4, NULL, NULL) == 0);
+	dmp_diff_stats(diff, &st);
+	assert(st.insert_bytes == n / 64 && st.delete_bytes == n / 64);
+	assert(st.max_depth > 1 && st.max_depth < 64);
+	dmp_diff_free(diff);
+
+	free(a);
+	free(b);
+	free(d.t1);
+	free(d.t2);
+	free(t1);
+	free(t2);
+	progress();
+}
 
 static test_fn g_tests[] = {
 	test_util_0,
+	test_strstr_0,
 	test_ranges_0,
+	test_pool_reserve_0,
+	test_cpu_kernels_0,
 	test_diff_0,
+	test_diff_lines_0,
+	test_diff_bounded_0,
+	test_diff_stats_0,
+	test_diff_same_0,
+	test_diff_cache_0,
+	test_diff_array_0,
+	test_diff_map_0,
+	test_diff_binary_0,
+	test_diff_delta_0,
+	test_merge3_0,
+	test_diff_update_0,
+	test_diff_presize_0,
+	test_diff_profile_0,
+	test_diff_threads_0,
+	test_diff_seq_0,
+	test_diff_records_0,
+	test_diff_moves_0,
+	test_edit_distance_0,
+	test_diff_job_0,
+	test_diff_stack_0,
 	NULL
 };
 
@@ -7,6 +7,7 @@
 #define INCLUDE_dmp_test_h__
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <dmp.h>
 
@@ -15,7 +16,30 @@ typedef void (*test_fn)(void);
 #define progress()	fputs(".", stderr)
 
 extern void test_util_0(void);
+extern void test_strstr_0(void);
 extern void test_ranges_0(void);
+extern void test_pool_reserve_0(void);
+extern void test_cpu_kernels_0(void);
 extern void test_diff_0(void);
+extern void test_diff_lines_0(void);
+extern void test_diff_bounded_0(void);
+extern void test_diff_stats_0(void);
+extern void test_diff_same_0(void);
+extern void test_diff_cache_0(void);
+extern void test_diff_array_0(void);
+extern void test_diff_map_0(void);
+extern void test_diff_binary_0(void);
+extern void test_diff_delta_0(void);
+extern void test_merge3_0(void);
+extern void test_diff_update_0(void);
+extern void test_diff_presize_0(void);
+extern void test_diff_profile_0(void);
+extern void test_diff_threads_0(void);
+extern void test_diff_seq_0(void);
+extern void test_diff_records_0(void);
+extern void test_diff_moves_0(void);
+extern void test_edit_distance_0(void);
+extern void test_diff_job_0(void);
+extern void test_diff_stack_0(void);
 
 #endif
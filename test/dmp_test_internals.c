@@ -6,6 +6,7 @@
 
 #include "dmp_test.h"
 #include "../src/dmp_pool.h"
+#include "../src/dmp_cpu.h"
 
 void test_ranges_0(void)
 {
@@ -50,3 +51,134 @@ void test_ranges_0(void)
 	assert(p->pool_used == used + 1);
 	progress();
 }
+
+void test_pool_reserve_0(void)
+{
+	dmp_pool pool, *p = &pool;
+	dmp_range range, *r = &range;
+	dmp_node *nodes;
+	uint32_t size, i;
+
+	assert(dmp_pool_alloc(p, 4) == 0);
+	assert(dmp_range_init(p, r, 0, "ab", 0, 2) > 0);
+
+	/* reserved nodes are handed out without moving the pool */
+	assert(dmp_pool_reserve(p, 100) == 0);
+	assert(p->pool_size >= p->pool_used + 100);
+	nodes = p->pool;
+	size  = p->pool_size;
+	for (i = 0; i < 100; ++i)
+		assert(dmp_range_insert(p, r, -1, 1, "cd", 0, 2) > 0);
+	assert(p->pool == nodes && p->pool_size == size);
+	assert(dmp_range_len(p, r) == 101);
+	assert(dmp_pool_reserve(p, 0) == 0);
+	progress();
+
+	/* a reservation that cannot be met leaves the pool as it was */
+	assert(dmp_pool_reserve(p, UINT32_MAX) == -1);
+	assert(p->error == -1);
+	assert(p->pool == nodes && p->pool_size == size);
+	assert(dmp_range_len(p, r) == 101);
+	assert(strcmp(dmp_node_at(p, r->end)->text, "cd") == 0);
+
+	/* and later requests keep failing until the error is dealt with */
+	assert(dmp_pool_reserve(p, 1) == -1);
+	p->error = 0;
+	assert(dmp_pool_reserve(p, 1) == 0);
+
+	dmp_pool_free(p);
+	progress();
+}
+
+static uint32_t bytewise_prefix(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0;
+	while (n < l1 && n < l2 && t1[n] == t2[n])
+		n++;
+	return n;
+}
+
+static uint32_t bytewise_suffix(
+	const char *t1, uint32_t l1, const char *t2, uint32_t l2)
+{
+	uint32_t n = 0;
+	while (n < l1 && n < l2 && t1[l1 - n - 1] == t2[l2 - n - 1])
+		n++;
+	return n;
+}
+
+void test_cpu_kernels_0(void)
+{
+	char a[300], b[300];
+	uint32_t level, len, off, at, i, pos[300];
+
+	assert(dmp_cpu_kernels() != NULL);
+	assert(dmp_cpu_kernels_at(DMP_CPU_GENERIC) != NULL);
+	assert(dmp_cpu_kernels_at(DMP_CPU_LEVELS) == NULL);
+	assert(!strcmp(dmp_cpu_name(), dmp_cpu_kernels()->name));
+
+	for (i = 0; i < sizeof(a); ++i)
+		a[i] = b[i] = (char)('a' + i % 23);
+
+	/* every level the CPU can run agrees with a plain byte loop, for
+	 * mismatches anywhere in and around each block size
+	 */
+	for (level = 0; level < DMP_CPU_LEVELS; ++level) {
+		const dmp_kernels *k = dmp_cpu_kernels_at((dmp_cpu_level)level);
+		if (!k)
+			continue;
+
+		for (len = 0; len <= 140; ++len) {
+			for (off = 0; off < 3; ++off) {
+				const char *t1 = a + off, *t2 = b + 2 * off;
+
+				/* same text at different alignments */
+				memcpy(b + 2 * off, a + off, 200);
+
+				assert(k->common_prefix(t1, len, t2, len + off) ==
+					bytewise_prefix(t1, len, t2, len + off));
+				assert(k->common_suffix(t1, len + off, t2, len) ==
+					bytewise_suffix(t1, len + off, t2, len));
+
+				for (at = 0; at < len; at += (at < 70) ? 1 : 7) {
+					b[2 * off + at] = '#';
+					assert(k->common_prefix(t1, len, t2, len) == at);
+					assert(k->common_suffix(t1, len, t2, len) ==
+						len - at - 1);
+					b[2 * off + at] = a[off + at];
+				}
+			}
+		}
+
+		for (len = 2; len < 100; len += 3) {
+			memcpy(b, a, sizeof(b));
+			memcpy(b + 200 - len, "#needle#needle#needle#needle#needle"
+				"#needle#needle#needle#needle#needle#needle#needle"
+				"#needle#needle#needle#needle#needle#needle#needle",
+				len);
+			assert(k->strstr(b, 200, b + 200 - len, len) ==
+				dmp_strstr_generic(b, 200, b + 200 - len, len));
+			assert(k->strstr(a, 200, b + 200 - len, len) ==
+				dmp_strstr_generic(a, 200, b + 200 - len, len));
+		}
+
+		/* separators in and around each block, reported from any base */
+		for (i = 0; i < sizeof(b); ++i)
+			b[i] = (i % 67 == 0 || i % 29 == 5) ? '\n' : 'x';
+		for (off = 0; off < 3; ++off) {
+			for (len = 0; len <= 260; len += (len < 130) ? 1 : 13) {
+				uint32_t n = 0;
+
+				assert(k->find_all(b + off, len, '\n', 0, NULL) ==
+					k->find_all(b + off, len, '\n', 7, pos));
+				for (at = 0; at < len; ++at)
+					if (b[off + at] == '\n')
+						assert(pos[n++] == at + 7);
+				assert(k->find_all(b + off, len, '\n', 0, NULL) == n);
+			}
+		}
+
+		progress();
+	}
+}